@@ -227,6 +227,20 @@ class Blob {
   Dtype* mutable_cpu_diff();
   Dtype* mutable_gpu_diff();
   void Update();
+  /**
+   * @brief The version of the data, see SyncedMemory::version().
+   *
+   * It changes when a mutable data pointer is handed out, not when the data
+   * is written, e.g. by Update, CopyFrom, FromProto, ShareData or
+   * mutable_cpu_data. Layers keep packed or transformed copies of their
+   * weights for this version, so code holding on to a mutable pointer, as
+   * pycaffe's Blob.data does, must call mutable_cpu_data or mutable_gpu_data
+   * again after writing through it and before the next Forward.
+   */
+  inline uint64_t data_version() const {
+    CHECK(data_);
+    return data_->version();
+  }
   void FromProto(const BlobProto& proto, bool reshape = true);
   void ToProto(BlobProto* proto, bool write_diff = false) const;
 
@@ -1,6 +1,7 @@
 #ifndef CAFFE_COMMON_HPP_
 #define CAFFE_COMMON_HPP_
 
+#include <boost/function.hpp>
 #include <boost/shared_ptr.hpp>
 #include <gflags/gflags.h>
 #include <glog/logging.h>
@@ -163,6 +164,11 @@ class Caffe {
   inline static void set_solver_count(int val) { Get().solver_count_ = val; }
   inline static bool root_solver() { return Get().root_solver_; }
   inline static void set_root_solver(bool val) { Get().root_solver_ = val; }
+  // The number of threads caffe_parallel_for splits CPU loops between, 1 by
+  // default. Unlike the above, it is shared by all the threads of the
+  // process, e.g. the data prefetching threads.
+  static int cpu_threads();
+  static void set_cpu_threads(int num_threads);
 
  protected:
 #ifndef CPU_ONLY
@@ -182,6 +188,37 @@ class Caffe {
   DISABLE_COPY_AND_ASSIGN(Caffe);
 };
 
+// Splits fn between the threads of the pool; see caffe_parallel_for.
+void caffe_parallel_for_pool(const int n, const int grain,
+    const boost::function<void(int, int)>& fn);
+
+// Calls fn(begin, end) on consecutive ranges covering [0, n), spread over
+// the Caffe::cpu_threads() threads of a process-wide pool, and returns once
+// all calls have completed; see ThreadPool::ParallelForRange. The ranges
+// hold at most grain indices, which should amount to a few microseconds of
+// work. A call made while the pool is busy, from one of its own ranges or
+// from another thread, runs fn(0, n) on the calling thread instead.
+// fn is a functor, e.g. made with boost::bind, which is only wrapped in a
+// boost::function when the loop is split: loops of up to grain indices and
+// single-threaded processes call fn(0, n) right away.
+template <typename Fn>
+inline void caffe_parallel_for(const int n, const int grain, const Fn& fn) {
+  if (n <= 0) {
+    return;
+  }
+  if (n <= grain || Caffe::cpu_threads() == 1) {
+    fn(0, n);
+    return;
+  }
+  caffe_parallel_for_pool(n, grain, fn);
+}
+
+// Grains of caffe_parallel_for for element-wise loops: arithmetic ones are
+// bound by the memory bandwidth, transcendental ones (exp, log, pow...) by
+// the computation.
+const int CAFFE_CPU_ARITHMETIC_GRAIN = 1 << 15;
+const int CAFFE_CPU_TRANSCENDENTAL_GRAIN = 1 << 12;
+
 }  // namespace caffe
 
 #endif  // CAFFE_COMMON_HPP_
@@ -8,7 +8,10 @@
 #include "caffe/common.hpp"
 #include "caffe/internal_thread.hpp"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/datum_cache.hpp"
 #include "caffe/util/db.hpp"
+#include "caffe/util/lock_free_queue.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -19,28 +22,33 @@ namespace caffe {
  * databases are read sequentially, and that each solver accesses a different
  * subset of the database. Data is distributed to solvers in a round-robin
  * way to keep parallel training deterministic.
+ *
+ * Datums are handed over a whole batch at a time, so each batch costs one
+ * queue operation on each side instead of one per datum.
  */
 class DataReader {
  public:
   explicit DataReader(const LayerParameter& param);
   ~DataReader();
 
-  inline BlockingQueue<Datum*>& free() const {
+  // Queues of batches of data_param.batch_size datums.
+  inline LockFreeQueue<vector<Datum*>*>& free() const {
     return queue_pair_->free_;
   }
-  inline BlockingQueue<Datum*>& full() const {
+  inline LockFreeQueue<vector<Datum*>*>& full() const {
     return queue_pair_->full_;
   }
 
  protected:
-  // Queue pairs are shared between a body and its readers
+  // Queue pairs are shared between a body and its readers. A fixed set of
+  // batches goes back and forth, so bounded lock-free queues are used.
   class QueuePair {
    public:
-    explicit QueuePair(int size);
+    QueuePair(int batches, int batch_size);
     ~QueuePair();
 
-    BlockingQueue<Datum*> free_;
-    BlockingQueue<Datum*> full_;
+    LockFreeQueue<vector<Datum*>*> free_;
+    LockFreeQueue<vector<Datum*>*> full_;
 
   DISABLE_COPY_AND_ASSIGN(QueuePair);
   };
@@ -53,10 +61,35 @@ class DataReader {
 
    protected:
     void InternalThreadEntry();
-    void read_one(db::Cursor* cursor, QueuePair* qp);
+    // Fills the next free batch of qp and hands it over.
+    void read_batch(db::Cursor* cursor, QueuePair* qp);
+    // Parses the current record, through the cache if there is one.
+    void parse_one(db::Cursor* cursor, Datum* datum);
+    // Moves the cursor to the next record of this shard, wrapping around.
+    void next_record(db::Cursor* cursor);
+
+    // Reads the keys of the source, and opens the cursors of the readers.
+    void index_keys(db::DB* db, db::Cursor* cursor);
+    // Reads the records of the next keys in the random order.
+    void read_shuffled(const vector<Datum*>& batch);
+    // Reads every read_threads-th item of the batch, starting at thread_id.
+    void read_shuffled_slice(int thread_id, const vector<Datum*>& batch);
 
     const LayerParameter param_;
     BlockingQueue<shared_ptr<QueuePair> > new_queue_pairs_;
+    // Decoded samples of the source, set if data_param.cache_bytes > 0.
+    shared_ptr<DatumCache> cache_;
+    // Index of the current record in the source.
+    int record_id_;
+
+    // Random order reading, used if data_param.shuffle is set. The keys of
+    // the shard are reshuffled every epoch, key_pos_ being the next one.
+    vector<string> keys_;
+    int key_pos_;
+    vector<string> batch_keys_;
+    // One cursor per reader thread.
+    vector<shared_ptr<db::Cursor> > cursors_;
+    shared_ptr<ThreadPool> thread_pool_;
 
     friend class DataReader;
 
@@ -68,6 +101,8 @@ class DataReader {
   static inline string source_key(const LayerParameter& param) {
     return param.name() + ":" + param.data_param().source();
   }
+  // Cached samples only depend on the source and on how they are decoded.
+  static string cache_key(const LayerParameter& param);
 
   const shared_ptr<QueuePair> queue_pair_;
   shared_ptr<Body> body_;
@@ -6,6 +6,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -77,6 +78,52 @@ class DataTransformer {
   void Transform(const cv::Mat& cv_img, Blob<Dtype>* transformed_blob);
 #endif  // USE_OPENCV
 
+  /**
+   * @brief Applies the transformation defined in the data layer's
+   * transform_param block to a whole batch of Datum at once.
+   *
+   * Crop offsets and mirror flags are drawn for every item up front, then
+   * the items are decoded (if encoded) and transformed in parallel over
+   * transform_param.num_threads threads.
+   *
+   * @param datum_vector
+   *    A vector of pointers to the Datum to be transformed.
+   * @param transformed_blob
+   *    This is destination blob. Item i is written at offset(i), so its num
+   *    must be at least the size of datum_vector. See data_layer.cpp for an
+   *    example.
+   */
+  void TransformBatch(const vector<Datum*>& datum_vector,
+                      Blob<Dtype>* transformed_blob);
+
+#ifdef USE_OPENCV
+  /**
+   * @brief Applies the transformation defined in the data layer's
+   * transform_param block to a whole batch of Mat at once. See the Datum
+   * version above.
+   *
+   * @param mat_vector
+   *    A vector of Mat containing the data to be transformed.
+   * @param transformed_blob
+   *    This is destination blob. Item i is written at offset(i). See
+   *    image_data_layer.cpp for an example.
+   */
+  void TransformBatch(const vector<cv::Mat>& mat_vector,
+                      Blob<Dtype>* transformed_blob);
+
+  /**
+   * @brief Same as resizing every Mat to resize_height x resize_width and
+   * calling TransformBatch, without the resized copies.
+   *
+   * The crop is drawn in the resized frame first, then only the cropped
+   * region of the original image is interpolated (bilinearly, as
+   * cv::resize) and normalized straight into transformed_blob. The crops
+   * and mirrors drawn are the same as with the two separate steps.
+   */
+  void TransformBatch(const vector<cv::Mat>& mat_vector, int resize_height,
+                      int resize_width, Blob<Dtype>* transformed_blob);
+#endif  // USE_OPENCV
+
   /**
    * @brief Applies the same transformation defined in the data layer's
    * transform_param block to all the num images in a input_blob.
@@ -126,6 +173,11 @@ class DataTransformer {
    */
   vector<int> InferBlobShape(const cv::Mat& cv_img);
 #endif  // USE_OPENCV
+  /**
+   * @brief Infers the shape of transformed_blob will have when
+   *    the transformation is applied to an image of the given size.
+   */
+  vector<int> InferBlobShape(int channels, int height, int width);
 
  protected:
    /**
@@ -139,11 +191,69 @@ class DataTransformer {
   virtual int Rand(int n);
 
   void Transform(const Datum& datum, Dtype* transformed_data);
+
+  // Crop offsets and mirror flag of one item, drawn before transforming it.
+  struct ItemTransform {
+    int h_off;
+    int w_off;
+    bool mirror;
+  };
+
+  /**
+   * @brief Checks an input of the given dimensions against the output
+   *    blob and draws its crop offsets and mirror flag.
+   */
+  ItemTransform PlanItem(int channels, int height, int width,
+      const Blob<Dtype>& transformed_blob);
+  // Draws the crop offsets and mirror flag of an input of the given size.
+  ItemTransform PlanItem(int height, int width);
+  // Reads the output dimensions of transformed_blob in the configured layout.
+  void OutputDims(const Blob<Dtype>& transformed_blob, int* channels,
+      int* height, int* width) const;
+  // Element strides of the c, h and w axes of one output item.
+  void OutputStrides(int channels, int height, int width, int* c_stride,
+      int* h_stride, int* w_stride) const;
+  // Shape of a single output item in the configured layout.
+  vector<int> OutputShape(int channels, int height, int width) const;
+  // Replicates a single mean_value over channels and checks the mean_file
+  // dimensions. Returns the mean_file data, or NULL if there is none.
+  const Dtype* PrepareMean(int channels, int height, int width);
+
+  void Transform(const Datum& datum, const ItemTransform& item,
+      const Dtype* mean, int height, int width, Dtype* transformed_data);
+  // Batch items: decoded holds the decoded images of encoded datums, or is
+  // NULL when there are none.
+  void TransformDatumBatchItem(int item_id, const vector<Datum*>& datum_vector,
+      const cv::Mat* decoded, const Dtype* mean, int height, int width,
+      Dtype* transformed_data);
+#ifdef USE_OPENCV
+  void Transform(const cv::Mat& cv_img, const ItemTransform& item,
+      const Dtype* mean, int height, int width, Dtype* transformed_data);
+  // Decodes an encoded datum honoring force_color and force_gray.
+  cv::Mat DecodeDatum(const Datum& datum);
+  void DecodeBatchItem(int item_id, const vector<Datum*>& datum_vector,
+      cv::Mat* decoded);
+  void TransformMatBatchItem(int item_id, const vector<cv::Mat>& mat_vector,
+      const Dtype* mean, int height, int width, Dtype* transformed_data);
+  // Transforms cv_img as if it was first resized to resize_height x
+  // resize_width. item and mean are relative to the resized image.
+  void TransformResized(const cv::Mat& cv_img, const ItemTransform& item,
+      const Dtype* mean, int resize_height, int resize_width, int height,
+      int width, Dtype* transformed_data);
+  void TransformResizedBatchItem(int item_id,
+      const vector<cv::Mat>& mat_vector, const Dtype* mean, int resize_height,
+      int resize_width, int height, int width, Dtype* transformed_data);
+#endif  // USE_OPENCV
+
   // Tranformation parameters
   TransformationParameter param_;
 
 
   shared_ptr<Caffe::RNG> rng_;
+  // Runs TransformBatch items in parallel, created if num_threads > 1.
+  shared_ptr<ThreadPool> thread_pool_;
+  // Per-item plans of the batch being transformed.
+  vector<ItemTransform> batch_items_;
   Phase phase_;
   Blob<Dtype> data_mean_;
   vector<Dtype> mean_values_;
@@ -1,12 +1,15 @@
 #ifndef CAFFE_BASE_CONVOLUTION_LAYER_HPP_
 #define CAFFE_BASE_CONVOLUTION_LAYER_HPP_
 
+#include <algorithm>
 #include <vector>
 
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/gemm.hpp"
 #include "caffe/util/im2col.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -18,7 +21,8 @@ template <typename Dtype>
 class BaseConvolutionLayer : public Layer<Dtype> {
  public:
   explicit BaseConvolutionLayer(const LayerParameter& param)
-      : Layer<Dtype>(param) {}
+      : Layer<Dtype>(param), winograd_weights_version_(0),
+        packed_weights_version_(0) {}
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
@@ -40,6 +44,36 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   void weight_cpu_gemm(const Dtype* input, const Dtype* output, Dtype*
       weights);
   void backward_cpu_bias(Dtype* bias, const Dtype* input);
+  // The same, with a column buffer of col_buffer_.count() elements given by
+  // the caller, so that several images can be processed concurrently.
+  void forward_cpu_gemm(const Dtype* input, const Dtype* weights,
+      Dtype* output, Dtype* col_buff, bool skip_im2col);
+  void backward_cpu_gemm(const Dtype* input, const Dtype* weights,
+      Dtype* output, Dtype* col_buff);
+  void weight_cpu_gemm(const Dtype* input, const Dtype* output, Dtype*
+      weights, Dtype* col_buff);
+
+  /// @brief The number of threads the images of a batch are split between.
+  inline int num_image_threads() const {
+    return std::min(num_threads_, num_);
+  }
+  /// @brief The first image processed by thread t.
+  inline int thread_image_begin(int t) const {
+    return static_cast<int64_t>(num_) * t / num_image_threads();
+  }
+  /// @brief The column buffer of thread t, col_buffer_ for thread 0.
+  Dtype* thread_col_buffer(int t);
+  /// @brief The pool im2col and col2im split the channels between, when
+  ///        a single image leaves the threads nothing else to do.
+  inline ThreadPool* channel_pool() const {
+    return num_image_threads() == 1 ? thread_pool_.get() : NULL;
+  }
+  /// @brief Transforms the weights for the WINOGRAD engine, unless they are
+  ///        the ones last transformed.
+  void update_winograd_weights(const Dtype* weights);
+  /// @brief Packs the weights for the GEMMs of forward_cpu_gemm, unless
+  ///        they are the ones last packed, for the same GEMM backend.
+  void update_packed_weights();
 
 #ifndef CPU_ONLY
   void forward_gpu_gemm(const Dtype* col_input, const Dtype* weights,
@@ -52,9 +86,10 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   void backward_gpu_bias(Dtype* bias, const Dtype* input);
 #endif
 
-  /// @brief The spatial dimensions of the input.
+  /// @brief The channels (i == 0) and spatial dimensions of the input.
   inline int input_shape(int i) {
-    return (*bottom_shape_)[channel_axis_ + i];
+    return (i == 0) ? (*bottom_shape_)[bottom_channel_axis_] :
+        (*bottom_shape_)[bottom_first_spatial_axis_ + i - 1];
   }
   // reverse_dimensions should return true iff we are implementing deconv, so
   // that conv helpers know which dimensions are which.
@@ -83,6 +118,10 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   int top_dim_;
 
   int channel_axis_;
+  // Where channels and spatial axes live in the bottom: they differ from
+  // channel_axis_ for channels-last (NHWC) bottoms.
+  int bottom_channel_axis_;
+  int bottom_first_spatial_axis_;
   int num_;
   int channels_;
   int group_;
@@ -92,17 +131,48 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   bool bias_term_;
   bool is_1x1_;
   bool force_nd_im2col_;
+  bool channels_last_;
+  // Whether the forward pass uses direct_conv_cpu instead of im2col + GEMM.
+  bool direct_;
+  // Whether the forward pass uses winograd_conv_cpu, with the weights
+  // transformed by update_winograd_weights and the version of blobs_[0]
+  // they were transformed from. The column buffers double as its workspace.
+  bool winograd_;
+  int winograd_tile_;
+  Blob<Dtype> winograd_weights_;
+  uint64_t winograd_weights_version_;
+  // The weights of each group packed by update_packed_weights, and the
+  // version of blobs_[0] they were packed from; forward_cpu_gemm uses the
+  // plain weights when they are out of date.
+  vector<shared_ptr<GemmPackedA<Dtype> > > packed_weights_;
+  uint64_t packed_weights_version_;
+
+  int num_threads_;
+  shared_ptr<ThreadPool> thread_pool_;
+  // Column buffers and parameter gradients of threads 1 and up; thread 0
+  // uses col_buffer_ and the parameter diffs.
+  vector<shared_ptr<Blob<Dtype> > > thread_col_buffers_;
+  vector<shared_ptr<Blob<Dtype> > > thread_weight_diffs_;
+  vector<shared_ptr<Blob<Dtype> > > thread_bias_diffs_;
 
  private:
   // wrap im2col/col2im so we don't have to remember the (long) argument lists
   inline void conv_im2col_cpu(const Dtype* data, Dtype* col_buff) {
-    if (!force_nd_im2col_ && num_spatial_axes_ == 2) {
-      im2col_cpu(data, conv_in_channels_,
+    if (channels_last_) {
+      im2col_nhwc_cpu(data, conv_in_channels_,
           conv_input_shape_.cpu_data()[1], conv_input_shape_.cpu_data()[2],
           kernel_shape_.cpu_data()[0], kernel_shape_.cpu_data()[1],
           pad_.cpu_data()[0], pad_.cpu_data()[1],
           stride_.cpu_data()[0], stride_.cpu_data()[1],
           dilation_.cpu_data()[0], dilation_.cpu_data()[1], col_buff);
+    } else if (!force_nd_im2col_ && num_spatial_axes_ == 2) {
+      im2col_cpu(data, conv_in_channels_,
+          conv_input_shape_.cpu_data()[1], conv_input_shape_.cpu_data()[2],
+          kernel_shape_.cpu_data()[0], kernel_shape_.cpu_data()[1],
+          pad_.cpu_data()[0], pad_.cpu_data()[1],
+          stride_.cpu_data()[0], stride_.cpu_data()[1],
+          dilation_.cpu_data()[0], dilation_.cpu_data()[1], col_buff,
+          channel_pool());
     } else {
       im2col_nd_cpu(data, num_spatial_axes_, conv_input_shape_.cpu_data(),
           col_buffer_shape_.data(), kernel_shape_.cpu_data(),
@@ -110,13 +180,21 @@ class BaseConvolutionLayer : public Layer<Dtype> {
     }
   }
   inline void conv_col2im_cpu(const Dtype* col_buff, Dtype* data) {
-    if (!force_nd_im2col_ && num_spatial_axes_ == 2) {
-      col2im_cpu(col_buff, conv_in_channels_,
+    if (channels_last_) {
+      col2im_nhwc_cpu(col_buff, conv_in_channels_,
           conv_input_shape_.cpu_data()[1], conv_input_shape_.cpu_data()[2],
           kernel_shape_.cpu_data()[0], kernel_shape_.cpu_data()[1],
           pad_.cpu_data()[0], pad_.cpu_data()[1],
           stride_.cpu_data()[0], stride_.cpu_data()[1],
           dilation_.cpu_data()[0], dilation_.cpu_data()[1], data);
+    } else if (!force_nd_im2col_ && num_spatial_axes_ == 2) {
+      col2im_cpu(col_buff, conv_in_channels_,
+          conv_input_shape_.cpu_data()[1], conv_input_shape_.cpu_data()[2],
+          kernel_shape_.cpu_data()[0], kernel_shape_.cpu_data()[1],
+          pad_.cpu_data()[0], pad_.cpu_data()[1],
+          stride_.cpu_data()[0], stride_.cpu_data()[1],
+          dilation_.cpu_data()[0], dilation_.cpu_data()[1], data,
+          channel_pool());
     } else {
       col2im_nd_cpu(col_buff, num_spatial_axes_, conv_input_shape_.cpu_data(),
           col_buffer_shape_.data(), kernel_shape_.cpu_data(),
@@ -125,6 +203,7 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   }
 #ifndef CPU_ONLY
   inline void conv_im2col_gpu(const Dtype* data, Dtype* col_buff) {
+    CHECK(!channels_last_) << "NHWC bottoms are only supported on CPU.";
     if (!force_nd_im2col_ && num_spatial_axes_ == 2) {
       im2col_gpu(data, conv_in_channels_,
           conv_input_shape_.cpu_data()[1], conv_input_shape_.cpu_data()[2],
@@ -140,6 +219,7 @@ class BaseConvolutionLayer : public Layer<Dtype> {
     }
   }
   inline void conv_col2im_gpu(const Dtype* col_buff, Dtype* data) {
+    CHECK(!channels_last_) << "NHWC bottoms are only supported on CPU.";
     if (!force_nd_im2col_ && num_spatial_axes_ == 2) {
       col2im_gpu(col_buff, conv_in_channels_,
           conv_input_shape_.cpu_data()[1], conv_input_shape_.cpu_data()[2],
@@ -60,7 +60,18 @@ class BatchNormLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  /// @brief Sets global_scale_ and global_shift_ from the stored statistics,
+  ///        unless they have not changed since the last call.
+  void UpdateGlobalScaleShift();
+
   Blob<Dtype> mean_, variance_, temp_, x_norm_;
+  // With use_global_stats, the normalization is the per-channel affine
+  // transform x * global_scale_ + global_shift_, with global_scale_ =
+  // 1 / sqrt(variance + eps) and global_shift_ = -mean * global_scale_. They
+  // are computed once per change of the statistics, whose data versions are
+  // kept in global_stats_versions_, e.g. when the weights are loaded.
+  Blob<Dtype> global_scale_, global_shift_;
+  vector<uint64_t> global_stats_versions_;
   bool use_global_stats_;
   Dtype moving_average_fraction_;
   int channels_;
@@ -59,7 +59,11 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
    *  group.
    *  - bias_term (\b optional, default true). Whether to have a bias.
    *  - engine: convolution has CAFFE (matrix multiplication) and CUDNN (library
-   *    kernels + stream parallelism) engines.
+   *    kernels + stream parallelism) engines, and the DIRECT and WINOGRAD
+   *    variants of CAFFE whose CPU forward pass avoids im2col for some
+   *    kernel shapes.
+   *  - num_threads (\b optional, default 1). The number of threads the CAFFE
+   *    engine splits the images of a batch between on CPU.
    */
   explicit ConvolutionLayer(const LayerParameter& param)
       : BaseConvolutionLayer<Dtype>(param) {}
@@ -77,6 +81,13 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual inline bool reverse_dimensions() { return false; }
   virtual void compute_output_shape();
+
+  // Forward and backward passes over the images of thread t.
+  void ForwardImages(int t, const Dtype* bottom_data, const Dtype* weight,
+      const Dtype* bias, Dtype* top_data);
+  void BackwardImages(int t, const Dtype* top_diff, const Dtype* bottom_data,
+      const Dtype* weight, Dtype* bottom_diff, bool propagate_down,
+      Dtype* weight_diff, Dtype* bias_diff);
 };
 
 }  // namespace caffe
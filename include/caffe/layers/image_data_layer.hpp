@@ -2,7 +2,6 @@
 #define CAFFE_IMAGE_DATA_LAYER_HPP_
 
 #include <string>
-#include <utility>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -11,6 +10,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/datum_cache.hpp"
 
 namespace caffe {
 
@@ -36,9 +36,28 @@ class ImageDataLayer : public BasePrefetchingDataLayer<Dtype> {
   shared_ptr<Caffe::RNG> prefetch_rng_;
   virtual void ShuffleImages();
   virtual void load_batch(Batch<Dtype>* batch);
+  // Reads, decodes and resizes the image of a line, unless it is cached.
+  shared_ptr<const Datum> ReadCachedImage(int line_id);
+  // Parses the "<name> <label>" lines of the list that belong to the shard.
+  void ParseImageList(const string& list, int shard_id, int num_shards);
 
-  vector<std::pair<std::string, int> > lines_;
+  // A line of the list. Names are stored back to back in names_, so a large
+  // list costs one allocation, and shuffling only moves these entries.
+  struct Line {
+    size_t name_offset;
+    int name_length;
+    int label;
+  };
+  inline string line_name(int line_id) const {
+    return names_.substr(lines_[line_id].name_offset,
+                         lines_[line_id].name_length);
+  }
+
+  vector<Line> lines_;
+  string names_;
   int lines_id_;
+  // Decoded images, set if image_data_param.cache_bytes > 0.
+  shared_ptr<DatumCache> cache_;
 };
 
 
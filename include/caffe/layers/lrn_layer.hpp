@@ -55,6 +55,13 @@ class LRNLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void WithinChannelBackward(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  // The CPU ACROSS_CHANNELS passes over the images [begin, end), each call
+  // with its own scratch blobs.
+  void CrossChannelForwardImages(const Dtype* bottom_data, Dtype* scale_data,
+      int begin, int end);
+  void CrossChannelBackwardImages(const Dtype* top_diff,
+      const Dtype* top_data, const Dtype* bottom_data,
+      const Dtype* scale_data, Dtype* bottom_diff, int begin, int end);
 
   int size_;
   int pre_pad_;
@@ -1,26 +1,46 @@
 #ifndef CAFFE_MEMORY_DATA_LAYER_HPP_
 #define CAFFE_MEMORY_DATA_LAYER_HPP_
 
+#include <boost/function.hpp>
 #include <vector>
 
 #include "caffe/blob.hpp"
+#include "caffe/internal_thread.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 
 #include "caffe/layers/base_data_layer.hpp"
+#include "caffe/util/lock_free_queue.hpp"
 
 namespace caffe {
 
 /**
  * @brief Provides data to the Net from memory.
  *
+ * The top blobs alias the memory given to Reset or Enqueue, no copy is
+ * made.
+ *
  * TODO(dox): thorough documentation for Forward and proto params.
  */
 template <typename Dtype>
-class MemoryDataLayer : public BaseDataLayer<Dtype> {
+class MemoryDataLayer : public BaseDataLayer<Dtype>, public InternalThread {
  public:
+  typedef boost::function<void()> ReleaseCallback;
+
+  // Caller memory queued with Enqueue.
+  struct Buffer {
+    Dtype* data;
+    Dtype* labels;
+    int n;
+    ReleaseCallback release;
+    // Whether it comes from one of the Stage calls.
+    bool staged;
+  };
+
   explicit MemoryDataLayer(const LayerParameter& param)
-      : BaseDataLayer<Dtype>(param), has_new_data_(false) {}
+      : BaseDataLayer<Dtype>(param), has_new_data_(false), current_(NULL),
+        pending_(0) {}
+  virtual ~MemoryDataLayer();
   virtual void DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
 
@@ -35,8 +55,45 @@ class MemoryDataLayer : public BaseDataLayer<Dtype> {
 #endif  // USE_OPENCV
 
   // Reset should accept const pointers, but can't, because the memory
-  //  will be given to Blob, which is mutable
+  //  will be given to Blob, which is mutable. Batches queued or staged
+  //  before are released without being served.
   void Reset(Dtype* data, Dtype* label, int n);
+  /**
+   * @brief Queues n items of caller memory, n being a multiple of the batch
+   *    size, to be served once, in order, after the current ones.
+   *
+   * Unlike Reset, this can be called from another thread while the net
+   * runs, so that batches are queued ahead; it waits while queue_size
+   * buffers are already queued. release is called once the net is done
+   * with the buffer, i.e. when the Forward after its last batch starts, or
+   * when the layer is reset or destroyed. Once a queued buffer is served,
+   * Forward waits for the next one rather than going back to earlier data.
+   */
+  void Enqueue(Dtype* data, Dtype* labels, int n,
+      const ReleaseCallback& release);
+
+  /**
+   * @brief Like Reset, AddDatumVector and AddMatVector, except that the
+   *    copy or the transformation runs on a helper thread and the batches
+   *    are queued as with Enqueue, so they can be staged while the net is
+   *    still busy with the previous ones.
+   *
+   * They must be called from the thread running Forward, which waits for
+   * the staged batches it gets to. The data given to StageArrays must stay
+   * valid until the batch is served, unless copy_now is set: the data is
+   * then copied to the staging buffer before StageArrays returns, and may
+   * be reused right away, e.g. by pycaffe. Each batch holds one of queue_size
+   * staging buffers until it is released, and the calls wait for a free
+   * one, so the thread running Forward should stage at most queue_size - 1
+   * batches ahead of the one being served.
+   */
+  void StageArrays(const Dtype* data, const Dtype* labels, int n,
+      bool copy_now = false);
+  void StageDatumVector(const vector<Datum>& datum_vector);
+#ifdef USE_OPENCV
+  void StageMatVector(const vector<cv::Mat>& mat_vector,
+      const vector<int>& labels);
+#endif  // USE_OPENCV
   void set_batch_size(int new_size);
 
   int batch_size() { return batch_size_; }
@@ -47,6 +104,30 @@ class MemoryDataLayer : public BaseDataLayer<Dtype> {
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
+  // Calls the release callback of the buffer being served, if any.
+  void ReleaseCurrent();
+  // Releases the queued buffers, waiting for the staged ones in flight.
+  void DrainQueue();
+
+  // Memory a batch is copied or transformed to by the staging thread.
+  struct Staging {
+    Blob<Dtype> data;
+    Blob<Dtype> labels;
+    // Fills data and labels, on the staging thread, unless it is empty.
+    boost::function<void(Staging*)> fill;
+  };
+  // Fills a free staging buffer, on the calling thread if fill_now is set,
+  // and queues it.
+  void Stage(int n, const boost::function<void(Staging*)>& fill,
+      bool fill_now = false);
+  virtual void InternalThreadEntry();
+  void ReleaseStaging(int id);
+  void CopyArrays(const Dtype* data, const Dtype* labels, Staging* staging);
+  void TransformDatums(const vector<Datum>& datum_vector, Staging* staging);
+#ifdef USE_OPENCV
+  void TransformMats(const vector<cv::Mat>& mat_vector,
+      const vector<int>& labels, Staging* staging);
+#endif  // USE_OPENCV
 
   int batch_size_, channels_, height_, width_, size_;
   Dtype* data_;
@@ -56,6 +137,18 @@ class MemoryDataLayer : public BaseDataLayer<Dtype> {
   Blob<Dtype> added_data_;
   Blob<Dtype> added_label_;
   bool has_new_data_;
+  // Buffers given to Enqueue, and the one being served.
+  shared_ptr<LockFreeQueue<Buffer*> > queue_;
+  Buffer* current_;
+  // Staging buffers, and the indices of the free ones and of the ones
+  // waiting for the staging thread.
+  vector<shared_ptr<Staging> > staging_;
+  shared_ptr<LockFreeQueue<int> > staging_free_;
+  shared_ptr<LockFreeQueue<int> > staging_full_;
+  // Staged batches not served yet.
+  int pending_;
+  // Transforms the staged Datums and Mats on the staging thread.
+  shared_ptr<DataTransformer<Dtype> > staging_transformer_;
 };
 
 }  // namespace caffe
@@ -44,6 +44,17 @@ class PoolingLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  // MAX and AVE pooling over the (n, c) planes [begin, end). The MAX passes
+  // use top_mask, or mask if it is NULL.
+  void ForwardMaxPlanes(const Dtype* bottom_data, Dtype* top_data,
+      Dtype* top_mask, int* mask, int begin, int end);
+  void ForwardAvePlanes(const Dtype* bottom_data, Dtype* top_data, int begin,
+      int end);
+  void BackwardMaxPlanes(const Dtype* top_diff, const Dtype* top_mask,
+      const int* mask, Dtype* bottom_diff, int begin, int end);
+  void BackwardAvePlanes(const Dtype* top_diff, Dtype* bottom_diff,
+      int begin, int end);
+
   int kernel_h_, kernel_w_;
   int stride_h_, stride_w_;
   int pad_h_, pad_w_;
@@ -11,6 +11,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -37,6 +38,19 @@ class WindowDataLayer : public BasePrefetchingDataLayer<Dtype> {
   virtual unsigned int PrefetchRand();
   virtual void load_batch(Batch<Dtype>* batch);
 
+  // A window sampled for the batch being loaded.
+  struct WindowSample {
+    const vector<float>* window;
+    bool mirror;
+    // Index of the window's image in batch_images_.
+    int image_slot;
+  };
+  // Decodes the slot-th distinct image of the batch.
+  void DecodeImage(int slot, vector<cv::Mat>* images);
+  // Crops and warps the window of a batch item into its place in top_data.
+  void WarpWindow(int item_id, const vector<cv::Mat>& images,
+      Dtype* top_data);
+
   shared_ptr<Caffe::RNG> prefetch_rng_;
   vector<std::pair<std::string, vector<int> > > image_database_;
   enum WindowField { IMAGE_INDEX, LABEL, OVERLAP, X1, Y1, X2, Y2, NUM };
@@ -48,6 +62,12 @@ class WindowDataLayer : public BasePrefetchingDataLayer<Dtype> {
   bool has_mean_values_;
   bool cache_images_;
   vector<std::pair<std::string, Datum > > image_database_cache_;
+  // Plan of the batch being loaded: the sampled windows and the distinct
+  // images they come from, so that each image is decoded once.
+  vector<WindowSample> batch_windows_;
+  vector<int> batch_images_;
+  // Decodes images and warps windows in parallel.
+  shared_ptr<ThreadPool> thread_pool_;
 };
 
 }  // namespace caffe
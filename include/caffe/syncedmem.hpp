@@ -47,11 +47,11 @@ class SyncedMemory {
   SyncedMemory()
       : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(0), head_(UNINITIALIZED),
         own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false),
-        gpu_device_(-1) {}
+        gpu_device_(-1), version_(NextVersion()) {}
   explicit SyncedMemory(size_t size)
       : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(size), head_(UNINITIALIZED),
         own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false),
-        gpu_device_(-1) {}
+        gpu_device_(-1), version_(NextVersion()) {}
   ~SyncedMemory();
   const void* cpu_data();
   void set_cpu_data(void* data);
@@ -62,6 +62,16 @@ class SyncedMemory {
   enum SyncedHead { UNINITIALIZED, HEAD_AT_CPU, HEAD_AT_GPU, SYNCED };
   SyncedHead head() { return head_; }
   size_t size() { return size_; }
+  /**
+   * @brief Identifies the contents of the memory, e.g. to cache something
+   *        derived from them.
+   *
+   * A new version is drawn from a process-wide counter whenever a mutable
+   * pointer is handed out or the memory is replaced, so no two contents
+   * share a version, even across SyncedMemory objects. Writes through a
+   * pointer handed out before go unnoticed until the next one is asked for.
+   */
+  uint64_t version() const { return version_; }
 
 #ifndef CPU_ONLY
   void async_gpu_push(const cudaStream_t& stream);
@@ -70,6 +80,7 @@ class SyncedMemory {
  private:
   void to_cpu();
   void to_gpu();
+  static uint64_t NextVersion();
   void* cpu_ptr_;
   void* gpu_ptr_;
   size_t size_;
@@ -78,6 +89,7 @@ class SyncedMemory {
   bool cpu_malloc_use_cuda_;
   bool own_gpu_data_;
   int gpu_device_;
+  uint64_t version_;
 
   DISABLE_COPY_AND_ASSIGN(SyncedMemory);
 };  // class SyncedMemory
@@ -0,0 +1,63 @@
+#ifndef CAFFE_UTIL_DATUM_CACHE_HPP_
+#define CAFFE_UTIL_DATUM_CACHE_HPP_
+
+#include <map>
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief An in-memory cache of decoded samples, stored as raw uint8 Datum
+ * after decoding and resizing, so later epochs skip reading and decoding.
+ *
+ * Caches are shared by every layer that requests the same key, e.g. the
+ * TRAIN and TEST nets reading the same source. Samples are inserted until
+ * the byte budget is reached and are never evicted, which suits datasets
+ * that (mostly) fit in memory.
+ */
+class DatumCache {
+ public:
+  /**
+   * @brief Returns the cache shared under the given key, creating it with
+   *    the given byte budget if no layer holds it yet.
+   */
+  static shared_ptr<DatumCache> Get(const string& key, uint64_t capacity);
+  ~DatumCache();
+
+  // Returns the cached sample, or an empty pointer on a miss.
+  shared_ptr<const Datum> Lookup(const string& name) const;
+  // Caches a copy of datum, unless it is already cached or does not fit.
+  // Returns whether it was added.
+  bool Insert(const string& name, const Datum& datum);
+
+  inline uint64_t capacity() const { return capacity_; }
+  uint64_t size_bytes() const;
+  int size() const;
+
+ protected:
+  explicit DatumCache(const string& key, uint64_t capacity);
+
+  /**
+   Move synchronization fields out instead of including boost/thread.hpp
+   to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+   */
+  class sync;
+
+  const string key_;
+  const uint64_t capacity_;
+  uint64_t size_bytes_;
+  bool full_logged_;
+  map<string, shared_ptr<const Datum> > datums_;
+  shared_ptr<sync> sync_;
+
+  static map<const string, boost::weak_ptr<DatumCache> > caches_;
+
+DISABLE_COPY_AND_ASSIGN(DatumCache);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_DATUM_CACHE_HPP_
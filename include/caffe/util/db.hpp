@@ -15,6 +15,8 @@ class Cursor {
   Cursor() { }
   virtual ~Cursor() { }
   virtual void SeekToFirst() = 0;
+  // Positions the cursor at the first record whose key is not less than key.
+  virtual void Seek(const string& key) = 0;
   virtual void Next() = 0;
   virtual string key() = 0;
   virtual string value() = 0;
@@ -0,0 +1,24 @@
+#ifndef _CAFFE_UTIL_DIRECT_CONV_HPP_
+#define _CAFFE_UTIL_DIRECT_CONV_HPP_
+
+namespace caffe {
+
+// Whether direct_conv_cpu has a kernel for this (square) kernel size and
+// stride: 3x3, 5x5 and 7x7 kernels with stride 1 or 2.
+bool direct_conv_supported(const int kernel_h, const int kernel_w,
+    const int stride_h, const int stride_w);
+
+// Convolves one image with num_output filters of channels x kernel_h x
+// kernel_w weights without building columns, giving the same output as
+// im2col_cpu followed by a GEMM, without dilation. The kernel size and
+// stride must be supported.
+template <typename Dtype>
+void direct_conv_cpu(const Dtype* data_im, const int channels,
+    const int height, const int width, const Dtype* weights,
+    const int num_output, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int output_h, const int output_w, Dtype* data_out);
+
+}  // namespace caffe
+
+#endif  // _CAFFE_UTIL_DIRECT_CONV_HPP_
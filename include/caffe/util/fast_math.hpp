@@ -0,0 +1,257 @@
+#ifndef CAFFE_UTIL_FAST_MATH_H_
+#define CAFFE_UTIL_FAST_MATH_H_
+
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+// The kernels have to be inlined into the loops over them to vectorize,
+// and some are larger than what -O2 inlines on its own.
+#ifdef __GNUC__
+#define CAFFE_FAST_MATH_INLINE inline __attribute__((always_inline))
+#else
+#define CAFFE_FAST_MATH_INLINE inline
+#endif
+
+namespace caffe {
+
+// Single precision exp, log, tanh and sigmoid without branches or library
+// calls, so that loops over them vectorize. They follow the Cephes range
+// reductions and polynomials; against the exact result the maximum errors
+// are 2 ulp for fast_exp, fast_log and fast_tanh and 3 ulp for fast_sigmoid,
+// over the whole float range, denormals included. Infinities and NaNs give
+// the same results as the <cmath> functions.
+//
+// The double overloads call <cmath>, so that templated code can use these
+// names for both types.
+
+namespace fast_math_internal {
+
+inline float FloatFromBits(const int32_t bits) {
+  float x;
+  memcpy(&x, &bits, sizeof(x));  // NOLINT(caffe/alt_fn)
+  return x;
+}
+
+inline int32_t BitsFromFloat(const float x) {
+  int32_t bits;
+  memcpy(&bits, &x, sizeof(bits));  // NOLINT(caffe/alt_fn)
+  return bits;
+}
+
+// Returns condition ? a : b. The selection is done on the bits: the
+// compiler does not if-convert a ?: between floats, which might trap.
+inline float Select(const bool condition, const float a, const float b) {
+  const int32_t mask = -static_cast<int32_t>(condition);
+  return FloatFromBits((BitsFromFloat(a) & mask) | (BitsFromFloat(b) & ~mask));
+}
+
+}  // namespace fast_math_internal
+
+CAFFE_FAST_MATH_INLINE float fast_exp(const float x) {
+  using namespace fast_math_internal;  // NOLINT(build/namespaces)
+  // exp(x) = 2^n * exp(r), with n = round(x / ln 2), |r| <= ln 2 / 2 and
+  // ln 2 split in two so that n * ln 2 is exact.
+  const float kMax = 88.7228394f;   // log(FLT_MAX)
+  const float kMin = -103.972084f;  // log of the smallest denormal
+  const float kRound = 12582912.f;  // 1.5 * 2^23
+  // Clamped with Select, as std::min and std::max keep branches; NaN
+  // becomes kMin.
+  float clamped = Select(x > kMin, x, kMin);
+  clamped = Select(clamped < kMax, clamped, kMax);
+  const float n = (clamped * 1.44269504088896341f + kRound) - kRound;
+  float r = clamped - n * 0.693359375f;
+  r = r - n * -2.12194440e-4f;
+  float p = 1.9875691500e-4f;
+  p = p * r + 1.3981999507e-3f;
+  p = p * r + 8.3334519073e-3f;
+  p = p * r + 4.1665795894e-2f;
+  p = p * r + 1.6666665459e-1f;
+  p = p * r + 5.0000001201e-1f;
+  p = p * r * r + r + 1.f;
+  // 2^n is applied in two halves, each a normal float, to reach both
+  // FLT_MAX and the denormals.
+  const int32_t e = static_cast<int32_t>(n);
+  const int32_t e1 = e >> 1;
+  const int32_t e2 = e - e1;
+  float y = p * FloatFromBits((e1 + 127) << 23)
+      * FloatFromBits((e2 + 127) << 23);
+  y = Select(x > kMax, std::numeric_limits<float>::infinity(), y);
+  y = Select(x < kMin, 0.f, y);
+  return Select(x != x, x, y);
+}
+
+CAFFE_FAST_MATH_INLINE float fast_log(const float x) {
+  using namespace fast_math_internal;  // NOLINT(build/namespaces)
+  // log(x) = e * ln 2 + log(1 + f), with 1 + f in [sqrt(1/2), sqrt(2)).
+  // Denormals are scaled by 2^23 first.
+  const bool denormal = x < std::numeric_limits<float>::min();
+  const int32_t bits = BitsFromFloat(Select(denormal, x * 8388608.f, x));
+  float e = static_cast<float>((bits >> 23) - 127);
+  e = Select(denormal, e - 23.f, e);
+  float m = FloatFromBits((bits & 0x007fffff) | 0x3f800000);
+  const bool above_sqrt2 = m > 1.41421356f;
+  m = Select(above_sqrt2, m * 0.5f, m);
+  e = Select(above_sqrt2, e + 1.f, e);
+  const float f = m - 1.f;
+  const float f2 = f * f;
+  float p = 7.0376836292e-2f;
+  p = p * f - 1.1514610310e-1f;
+  p = p * f + 1.1676998740e-1f;
+  p = p * f - 1.2420140846e-1f;
+  p = p * f + 1.4249322787e-1f;
+  p = p * f - 1.6668057665e-1f;
+  p = p * f + 2.0000714765e-1f;
+  p = p * f - 2.4999993993e-1f;
+  p = p * f + 3.3333331174e-1f;
+  float y = p * f * f2 + e * -2.12194440e-4f - 0.5f * f2;
+  y = f + y + e * 0.693359375f;
+  y = Select(x == std::numeric_limits<float>::infinity(), x, y);
+  y = Select(x == 0.f, -std::numeric_limits<float>::infinity(), y);
+  // Negative and NaN.
+  return Select(!(x >= 0.f), std::numeric_limits<float>::quiet_NaN(), y);
+}
+
+CAFFE_FAST_MATH_INLINE float fast_tanh(const float x) {
+  using namespace fast_math_internal;  // NOLINT(build/namespaces)
+  // An odd polynomial near 0, where 1 - 2 / (exp(2|x|) + 1) would cancel.
+  const float x2 = x * x;
+  float p = -5.70498872745e-3f;
+  p = p * x2 + 2.06390887954e-2f;
+  p = p * x2 - 5.37397155531e-2f;
+  p = p * x2 + 1.33314422036e-1f;
+  p = p * x2 - 3.33332819422e-1f;
+  const float small = p * x2 * x + x;
+  const float abs_x = std::fabs(x);
+  float large = 1.f - 2.f / (fast_exp(2.f * abs_x) + 1.f);
+  large = Select(x < 0.f, -large, large);
+  return Select(abs_x < 0.625f, small, large);
+}
+
+CAFFE_FAST_MATH_INLINE float fast_sigmoid(const float x) {
+  using namespace fast_math_internal;  // NOLINT(build/namespaces)
+  // exp(-|x|) does not overflow; for x < 0, sigmoid(x) = e / (1 + e).
+  const float e = fast_exp(-std::fabs(x));
+  const float s = 1.f / (1.f + e);
+  return Select(x < 0.f, e * s, s);
+}
+
+inline double fast_exp(const double x) { return std::exp(x); }
+inline double fast_log(const double x) { return std::log(x); }
+inline double fast_tanh(const double x) { return std::tanh(x); }
+inline double fast_sigmoid(const double x) { return 1. / (1. + std::exp(-x)); }
+
+// Functors over the kernels above, for fast_math_map.
+struct FastExp {
+  template <typename Dtype>
+  CAFFE_FAST_MATH_INLINE Dtype operator()(const Dtype x) const {
+    return fast_exp(x);
+  }
+};
+
+struct FastLog {
+  template <typename Dtype>
+  CAFFE_FAST_MATH_INLINE Dtype operator()(const Dtype x) const {
+    return fast_log(x);
+  }
+};
+
+struct FastTanh {
+  template <typename Dtype>
+  CAFFE_FAST_MATH_INLINE Dtype operator()(const Dtype x) const {
+    return fast_tanh(x);
+  }
+};
+
+struct FastSigmoid {
+  template <typename Dtype>
+  CAFFE_FAST_MATH_INLINE Dtype operator()(const Dtype x) const {
+    return fast_sigmoid(x);
+  }
+};
+
+// Sets y[i] = op(a[i]) for i in [0, n); y may be a. The elements go through
+// a local buffer in blocks of fixed size, the last one padded, which the
+// compiler vectorizes without alias checks or a scalar epilogue.
+template <typename Dtype, typename Op>
+inline void fast_math_map(const int n, const Dtype* a, Dtype* y,
+    const Op& op) {
+  const int kBlock = 16;
+  Dtype buffer[kBlock] = {0};
+  for (int i = 0; i < n; i += kBlock) {
+    // Full blocks are copied by fixed size loops, faster than memcpy.
+    const int size = std::min(kBlock, n - i);
+    if (size == kBlock) {
+      for (int j = 0; j < kBlock; ++j) {
+        buffer[j] = a[i + j];
+      }
+    } else {
+      memcpy(buffer, a + i, size * sizeof(Dtype));  // NOLINT(caffe/alt_fn)
+    }
+    for (int j = 0; j < kBlock; ++j) {
+      buffer[j] = op(buffer[j]);
+    }
+    if (size == kBlock) {
+      for (int j = 0; j < kBlock; ++j) {
+        y[i + j] = buffer[j];
+      }
+    } else {
+      memcpy(y + i, buffer, size * sizeof(Dtype));  // NOLINT(caffe/alt_fn)
+    }
+  }
+}
+
+// Sets y[i] = pow(a[i], b) for i in [0, n), as exp(b * log|a[i]|); y may be
+// a. The error grows with the magnitude of the exponent: it is within
+// 2 (1 + |log y[i]|) ulp of the exact y[i]. Negative bases and the special
+// values of a are handled as in std::pow; b has to be finite and nonzero.
+// The logarithms and the exponentials of a block run as separate loops,
+// which need fewer registers than one loop over exp(b * log|a|).
+inline void fast_powx(const int n, const float* a, const float b, float* y) {
+  using namespace fast_math_internal;  // NOLINT(build/namespaces)
+  // Odd powers keep the sign of a, -0 and -inf included; non integral
+  // powers of finite negative numbers are NaN.
+  const bool integer = std::floor(b) == b;
+  const int32_t odd_mask = integer && std::fabs(std::fmod(b, 2.f)) == 1.f ?
+      std::numeric_limits<int32_t>::min() : 0;
+  const float inf = std::numeric_limits<float>::infinity();
+  const int kBlock = 16;
+  float x[kBlock] = {0};
+  float t[kBlock];
+  for (int i = 0; i < n; i += kBlock) {
+    const int size = std::min(kBlock, n - i);
+    if (size == kBlock) {
+      for (int j = 0; j < kBlock; ++j) {
+        x[j] = a[i + j];
+      }
+    } else {
+      memcpy(x, a + i, size * sizeof(float));  // NOLINT(caffe/alt_fn)
+    }
+    for (int j = 0; j < kBlock; ++j) {
+      t[j] = b * fast_log(std::fabs(x[j]));
+    }
+    for (int j = 0; j < kBlock; ++j) {
+      t[j] = fast_exp(t[j]);
+    }
+    // The conditions are combined with & rather than &&, which branches.
+    for (int j = 0; j < kBlock; ++j) {
+      const float signed_t =
+          FloatFromBits(BitsFromFloat(t[j]) ^ (BitsFromFloat(x[j]) & odd_mask));
+      t[j] = Select(!integer & (x[j] < 0.f) & (x[j] > -inf),
+          std::numeric_limits<float>::quiet_NaN(), signed_t);
+    }
+    if (size == kBlock) {
+      for (int j = 0; j < kBlock; ++j) {
+        y[i + j] = t[j];
+      }
+    } else {
+      memcpy(y + i, t, size * sizeof(float));  // NOLINT(caffe/alt_fn)
+    }
+  }
+}
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_FAST_MATH_H_
@@ -0,0 +1,26 @@
+#ifndef CAFFE_UTIL_FOLD_BATCH_NORM_HPP_
+#define CAFFE_UTIL_FOLD_BATCH_NORM_HPP_
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Folds, for inference, each BatchNorm layer that uses its stored statistics
+// and directly follows a Convolution or InnerProduct layer into the weights
+// and bias of that layer, together with a per-channel Scale layer directly
+// after it, if any. Both are then per-output-channel affine transforms of
+// the convolution or inner product output, so the folded net computes the
+// same function, up to rounding, without the two passes over the data.
+//
+// param is the net definition and weights its trained parameters, e.g. from
+// a .caffemodel; folded_param and folded_weights get the net without the
+// folded layers and its parameters. The top of a folded chain keeps its
+// name, and folded layers get a bias term. A layer is only folded if the
+// blobs it reads are not read by any other layer. Returns the number of
+// BatchNorm layers folded.
+int FoldBatchNorm(const NetParameter& param, const NetParameter& weights,
+    NetParameter* folded_param, NetParameter* folded_weights);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_FOLD_BATCH_NORM_HPP_
@@ -0,0 +1,120 @@
+#ifndef CAFFE_UTIL_GEMM_HPP_
+#define CAFFE_UTIL_GEMM_HPP_
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/mkl_alternate.hpp"
+
+namespace caffe {
+
+/**
+ * @brief An implementation of the row-major matrix multiplications behind
+ *        caffe_cpu_gemm, selected by name at run time.
+ *
+ * Two backends are built in: "blas", the default, forwards to the CBLAS
+ * Caffe was linked with (ATLAS, OpenBLAS, MKL...), and "caffe" is a
+ * cache-blocked GEMM that splits its work between set_num_threads()
+ * threads and can reuse operands packed once, see GemmPackedA and
+ * GemmPackedB. Other backends can be added with Register.
+ */
+class GemmBackend {
+ public:
+  virtual ~GemmBackend() {}
+
+  virtual void Gemm(const CBLAS_TRANSPOSE TransA,
+      const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+      const float alpha, const float* A, const float* B, const float beta,
+      float* C) = 0;
+  virtual void Gemm(const CBLAS_TRANSPOSE TransA,
+      const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+      const double alpha, const double* A, const double* B,
+      const double beta, double* C) = 0;
+
+  /// @brief Adds a backend, which is then owned by the registry.
+  static void Register(const string& name, GemmBackend* backend);
+  /// @brief The names of the registered backends.
+  static vector<string> Names();
+  /// @brief The backend used by caffe_cpu_gemm, in all threads.
+  static GemmBackend* Get();
+  static const string& name();
+  static void Set(const string& name);
+  /// @brief The number of threads of the "caffe" backend, 1 by default.
+  static int num_threads();
+  static void set_num_threads(int num_threads);
+};
+
+/**
+ * @brief op(A) of a M x K by K x N product, packed in the layout of the
+ *        "caffe" backend once to be multiplied by many matrices, typically
+ *        the weights of a layer.
+ *
+ * When another backend was selected at Pack time, the products use A
+ * itself, which must then outlive this object and keep the values it was
+ * packed with. Pack again after selecting another backend, see backend().
+ */
+template <typename Dtype>
+class GemmPackedA {
+ public:
+  GemmPackedA() : A_(NULL), M_(0), K_(0), backend_(NULL) {}
+  void Pack(const CBLAS_TRANSPOSE TransA, const int M, const int K,
+      const Dtype* A);
+
+  inline CBLAS_TRANSPOSE trans() const { return TransA_; }
+  inline int M() const { return M_; }
+  inline int K() const { return K_; }
+  inline const Dtype* source() const { return A_; }
+  inline const vector<Dtype>& packed() const { return packed_; }
+  /// @brief The backend selected at Pack time, NULL before.
+  inline const GemmBackend* backend() const { return backend_; }
+
+ protected:
+  CBLAS_TRANSPOSE TransA_;
+  const Dtype* A_;
+  int M_, K_;
+  const GemmBackend* backend_;
+  vector<Dtype> packed_;
+
+  DISABLE_COPY_AND_ASSIGN(GemmPackedA);
+};
+
+/// @brief The same for op(B), e.g. the transposed weights of InnerProduct.
+template <typename Dtype>
+class GemmPackedB {
+ public:
+  GemmPackedB() : B_(NULL), K_(0), N_(0), backend_(NULL) {}
+  void Pack(const CBLAS_TRANSPOSE TransB, const int K, const int N,
+      const Dtype* B);
+
+  inline CBLAS_TRANSPOSE trans() const { return TransB_; }
+  inline int K() const { return K_; }
+  inline int N() const { return N_; }
+  inline const Dtype* source() const { return B_; }
+  inline const vector<Dtype>& packed() const { return packed_; }
+  inline const GemmBackend* backend() const { return backend_; }
+
+ protected:
+  CBLAS_TRANSPOSE TransB_;
+  const Dtype* B_;
+  int K_, N_;
+  const GemmBackend* backend_;
+  vector<Dtype> packed_;
+
+  DISABLE_COPY_AND_ASSIGN(GemmPackedB);
+};
+
+// caffe_cpu_gemm with a packed left- or right-hand side.
+template <typename Dtype>
+void caffe_cpu_gemm(const GemmPackedA<Dtype>& A,
+    const CBLAS_TRANSPOSE TransB, const int N, const Dtype alpha,
+    const Dtype* B, const Dtype beta, Dtype* C);
+
+template <typename Dtype>
+void caffe_cpu_gemm(const CBLAS_TRANSPOSE TransA, const int M,
+    const Dtype alpha, const Dtype* A, const GemmPackedB<Dtype>& B,
+    const Dtype beta, Dtype* C);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_GEMM_HPP_
@@ -90,6 +90,9 @@ inline void WriteProtoToBinaryFile(
   WriteProtoToBinaryFile(proto, filename.c_str());
 }
 
+// Reads a whole local or hdfs:// file into contents, in a single read.
+bool ReadFileToString(const string& filename, string* contents);
+
 bool ReadFileToDatum(const string& filename, const int label, Datum* datum);
 
 inline bool ReadFileToDatum(const string& filename, Datum* datum) {
@@ -130,6 +133,12 @@ bool DecodeDatumNative(Datum* datum);
 bool DecodeDatum(Datum* datum, bool is_color);
 
 #ifdef USE_OPENCV
+// Reads an image that is to be resized to height x width, without resizing
+// it: JPEG images may come out decoded at 1/2, 1/4 or 1/8 of their size,
+// but never smaller than height x width.
+cv::Mat ReadImageToCVMatReduced(const string& filename,
+    const int height, const int width, const bool is_color);
+
 cv::Mat ReadImageToCVMat(const string& filename,
     const int height, const int width, const bool is_color);
 
@@ -0,0 +1,69 @@
+#ifndef CAFFE_UTIL_LOCK_FREE_QUEUE_HPP_
+#define CAFFE_UTIL_LOCK_FREE_QUEUE_HPP_
+
+#include <string>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A bounded lock-free queue, usable in place of BlockingQueue when
+ * the number of items in flight is known, e.g. a fixed pool of buffers
+ * going back and forth between two threads.
+ *
+ * It is a ring buffer where each slot carries a sequence number, so any
+ * number of producers and consumers can use it; the common single producer,
+ * single consumer case never contends on a shared counter. Blocking calls
+ * spin for a while, then yield, and only then park on a condition variable,
+ * which is signaled by the other side only when someone is parked.
+ */
+template<typename T>
+class LockFreeQueue {
+ public:
+  // capacity is rounded up to a power of two.
+  explicit LockFreeQueue(int capacity);
+  ~LockFreeQueue();
+
+  // Waits while the queue is full.
+  void push(const T& t);
+
+  bool try_push(const T& t);
+
+  bool try_pop(T* t);
+
+  // This logs a message if the threads needs to be blocked
+  // useful for detecting e.g. when data feeding is too slow
+  T pop(const string& log_on_wait = "");
+
+  // Peeking is only meaningful when there is a single consumer.
+  bool try_peek(T* t);
+
+  // Return element without removing it
+  T peek();
+
+  // Number of items in the queue, only exact when no call is in progress.
+  size_t size() const;
+
+  inline int capacity() const { return capacity_; }
+
+ protected:
+  /**
+   Move synchronization fields out instead of including boost/thread.hpp
+   and boost/atomic.hpp to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+   */
+  class sync;
+
+  // Spins, yields, then parks until try_op succeeds.
+  template<typename Op>
+  void wait(Op try_op, const string& log_on_wait);
+
+  int capacity_;
+  shared_ptr<sync> sync_;
+
+DISABLE_COPY_AND_ASSIGN(LockFreeQueue);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_LOCK_FREE_QUEUE_HPP_
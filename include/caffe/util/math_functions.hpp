@@ -13,7 +13,8 @@
 namespace caffe {
 
 // Caffe gemm provides a simpler interface to the gemm functions, with the
-// limitation that the data has to be contiguous in memory.
+// limitation that the data has to be contiguous in memory. It runs on the
+// GemmBackend selected at run time, see caffe/util/gemm.hpp.
 template <typename Dtype>
 void caffe_cpu_gemm(const CBLAS_TRANSPOSE TransA,
     const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
@@ -85,12 +86,40 @@ void caffe_rng_bernoulli(const int n, const Dtype p, int* r);
 template <typename Dtype>
 void caffe_rng_bernoulli(const int n, const Dtype p, unsigned int* r);
 
+// In single precision, caffe_tanh and caffe_sigmoid run the vectorized
+// approximations of caffe/util/fast_math.hpp, and so do caffe_exp, caffe_log
+// and caffe_powx unless MKL provides them.
 template <typename Dtype>
 void caffe_exp(const int n, const Dtype* a, Dtype* y);
 
 template <typename Dtype>
 void caffe_log(const int n, const Dtype* a, Dtype* y);
 
+template <typename Dtype>
+void caffe_tanh(const int n, const Dtype* a, Dtype* y);
+
+// y = 1 / (1 + exp(-a))
+template <typename Dtype>
+void caffe_sigmoid(const int n, const Dtype* a, Dtype* y);
+
+// Softmax over the middle axis of x, seen as outer_num x channels x
+// inner_num: y = exp(x - max) / sum(exp(x - max)). y may be x. Each row (or
+// group of inner_num rows) is reduced and normalized while it is in cache.
+// If log_sum is not NULL, it gets the outer_num x inner_num logs of the
+// normalizers, max + log(sum(exp(x - max))), so that log(y) = x - log_sum
+// without rounding y first.
+template <typename Dtype>
+void caffe_cpu_softmax(const int outer_num, const int channels,
+    const int inner_num, const Dtype* x, Dtype* y, Dtype* log_sum = NULL);
+
+// Per-channel affine transform of x, seen as outer_num x channels x
+// inner_num: y = scale[c] * x + shift[c] in channel c, in one pass. y may
+// be x. shift may be NULL for a scale only.
+template <typename Dtype>
+void caffe_cpu_scale_shift(const int outer_num, const int channels,
+    const int inner_num, const Dtype* scale, const Dtype* shift,
+    const Dtype* x, Dtype* y);
+
 template <typename Dtype>
 void caffe_abs(const int n, const Dtype* a, Dtype* y);
 
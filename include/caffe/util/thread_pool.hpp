@@ -0,0 +1,68 @@
+#ifndef CAFFE_UTIL_THREAD_POOL_HPP_
+#define CAFFE_UTIL_THREAD_POOL_HPP_
+
+#include <boost/function.hpp>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+/**
+ Forward declare boost::thread instead of including boost/thread.hpp
+ to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+ */
+namespace boost { class thread; }
+
+namespace caffe {
+
+/**
+ * @brief A fixed set of worker threads executing index ranges in parallel.
+ *
+ * The calling thread takes part in the work, so a pool created with
+ * num_threads == 1 spawns no thread at all and runs everything inline.
+ */
+class ThreadPool {
+ public:
+  explicit ThreadPool(int num_threads);
+  ~ThreadPool();
+
+  inline int num_threads() const { return num_threads_; }
+
+  /**
+   * @brief Calls fn(i) for every i in [0, n) and returns once all calls
+   *    have completed. Calls may run concurrently and in any order.
+   */
+  void ParallelFor(int n, const boost::function<void(int)>& fn);
+
+  /**
+   * @brief Calls fn(begin, end) on consecutive ranges covering [0, n), and
+   *    returns once all calls have completed.
+   *
+   * Split between threads, the ranges hold at most grain indices. Each
+   * thread starts on an equal share of [0, n); a thread that runs out
+   * steals the second half of what remains of the largest share, so uneven
+   * ranges still keep all the threads busy.
+   */
+  void ParallelForRange(int n, int grain,
+      const boost::function<void(int, int)>& fn);
+
+ protected:
+  /**
+   Move synchronization fields out instead of including boost/thread.hpp
+   to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+   */
+  class sync;
+
+  void WorkerEntry();
+  // Runs items of the current job until none is left.
+  void RunItems();
+
+  const int num_threads_;
+  std::vector<shared_ptr<boost::thread> > threads_;
+  shared_ptr<sync> sync_;
+
+DISABLE_COPY_AND_ASSIGN(ThreadPool);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_THREAD_POOL_HPP_
@@ -0,0 +1,42 @@
+#ifndef _CAFFE_UTIL_WINOGRAD_HPP_
+#define _CAFFE_UTIL_WINOGRAD_HPP_
+
+namespace caffe {
+
+// Whether winograd_conv_cpu can compute this convolution: 3x3 kernels with
+// stride 1, with tile 2 for F(2x2, 3x3) or tile 4 for F(4x4, 3x3).
+bool winograd_supported(const int tile, const int kernel_h,
+    const int kernel_w, const int stride_h, const int stride_w);
+
+// The number of elements of the transformed weights of num_output filters
+// of channels x 3 x 3.
+int winograd_weights_size(const int tile, const int channels,
+    const int num_output);
+
+// The number of elements of the workspace of winograd_conv_cpu.
+int winograd_workspace_size(const int tile, const int channels,
+    const int num_output, const int output_h, const int output_w);
+
+// Transforms num_output filters of channels x 3 x 3 weights into
+// (tile + 2)^2 matrices of num_output x channels, one per point of the
+// transform domain.
+template <typename Dtype>
+void winograd_transform_weights_cpu(const int tile, const Dtype* weights,
+    const int channels, const int num_output, Dtype* transformed_weights);
+
+// Convolves one image with the filters transformed by
+// winograd_transform_weights_cpu, giving the same output as im2col_cpu
+// followed by a GEMM up to rounding. The input is split in tiles of
+// (tile + 2)^2 that are transformed, multiplied by the transformed weights
+// with one GEMM per point of the transform domain, and transformed back to
+// tile x tile outputs.
+template <typename Dtype>
+void winograd_conv_cpu(const int tile, const Dtype* data_im,
+    const int channels, const int height, const int width,
+    const Dtype* transformed_weights, const int num_output, const int pad_h,
+    const int pad_w, const int output_h, const int output_w,
+    Dtype* workspace, Dtype* data_out);
+
+}  // namespace caffe
+
+#endif  // _CAFFE_UTIL_WINOGRAD_HPP_
@@ -147,8 +147,10 @@ void Net_LoadHDF5(Net<Dtype>* net, string filename) {
   net->CopyTrainedLayersFromHDF5(filename.c_str());
 }
 
-void Net_SetInputArrays(Net<Dtype>* net, bp::object data_obj,
-    bp::object labels_obj) {
+// Checks that net takes its input from a MemoryDataLayer that data_arr and
+// labels_arr fit, and returns that layer.
+shared_ptr<MemoryDataLayer<Dtype> > InputMemoryDataLayer(Net<Dtype>* net,
+    PyArrayObject* data_arr, PyArrayObject* labels_arr) {
   // check that this network has an input MemoryDataLayer
   shared_ptr<MemoryDataLayer<Dtype> > md_layer =
     boost::dynamic_pointer_cast<MemoryDataLayer<Dtype> >(net->layers()[0]);
@@ -158,10 +160,6 @@ void Net_SetInputArrays(Net<Dtype>* net, bp::object data_obj,
   }
 
   // check that we were passed appropriately-sized contiguous memory
-  PyArrayObject* data_arr =
-      reinterpret_cast<PyArrayObject*>(data_obj.ptr());
-  PyArrayObject* labels_arr =
-      reinterpret_cast<PyArrayObject*>(labels_obj.ptr());
   CheckContiguousArray(data_arr, "data array", md_layer->channels(),
       md_layer->height(), md_layer->width());
   CheckContiguousArray(labels_arr, "labels array", 1, 1, 1);
@@ -173,12 +171,37 @@ void Net_SetInputArrays(Net<Dtype>* net, bp::object data_obj,
     throw std::runtime_error("first dimensions of input arrays must be a"
         " multiple of batch size");
   }
+  return md_layer;
+}
 
+void Net_SetInputArrays(Net<Dtype>* net, bp::object data_obj,
+    bp::object labels_obj) {
+  PyArrayObject* data_arr =
+      reinterpret_cast<PyArrayObject*>(data_obj.ptr());
+  PyArrayObject* labels_arr =
+      reinterpret_cast<PyArrayObject*>(labels_obj.ptr());
+  shared_ptr<MemoryDataLayer<Dtype> > md_layer =
+      InputMemoryDataLayer(net, data_arr, labels_arr);
   md_layer->Reset(static_cast<Dtype*>(PyArray_DATA(data_arr)),
       static_cast<Dtype*>(PyArray_DATA(labels_arr)),
       PyArray_DIMS(data_arr)[0]);
 }
 
+void Net_StageInputArrays(Net<Dtype>* net, bp::object data_obj,
+    bp::object labels_obj) {
+  PyArrayObject* data_arr =
+      reinterpret_cast<PyArrayObject*>(data_obj.ptr());
+  PyArrayObject* labels_arr =
+      reinterpret_cast<PyArrayObject*>(labels_obj.ptr());
+  shared_ptr<MemoryDataLayer<Dtype> > md_layer =
+      InputMemoryDataLayer(net, data_arr, labels_arr);
+  // The arrays are copied before returning, so no reference to them is kept
+  // and the caller may reuse them right away.
+  md_layer->StageArrays(static_cast<Dtype*>(PyArray_DATA(data_arr)),
+      static_cast<Dtype*>(PyArray_DATA(labels_arr)),
+      PyArray_DIMS(data_arr)[0], true);
+}
+
 Solver<Dtype>* GetSolverFromFile(const string& filename) {
   SolverParameter param;
   ReadSolverParamsFromTextFileOrDie(filename, &param);
@@ -328,6 +351,7 @@ BOOST_PYTHON_MODULE(_caffe) {
         bp::return_value_policy<bp::copy_const_reference>()))
     .def("_set_input_arrays", &Net_SetInputArrays,
         bp::with_custodian_and_ward<1, 2, bp::with_custodian_and_ward<1, 3> >())
+    .def("_stage_input_arrays", &Net_StageInputArrays)
     .def("save", &Net_Save)
     .def("save_hdf5", &Net_SaveHDF5)
     .def("load_hdf5", &Net_LoadHDF5);
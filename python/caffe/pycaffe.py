@@ -259,6 +259,20 @@ def _Net_set_input_arrays(self, data, labels):
     return self._set_input_arrays(data, labels)
 
 
+def _Net_stage_input_arrays(self, data, labels):
+    """
+    Queue input arrays on the in-memory MemoryDataLayer, to be served after
+    the current ones, so the next batch can be staged before calling
+    forward() on the current one. The arrays are copied before this returns:
+    the caller may reuse or modify them right away.
+    (Note: this is only for networks declared with the memory data layer.)
+    """
+    if labels.ndim == 1:
+        labels = np.ascontiguousarray(labels[:, np.newaxis, np.newaxis,
+                                             np.newaxis])
+    return self._stage_input_arrays(data, labels)
+
+
 def _Net_batch(self, blobs):
     """
     Batch blob lists according to net's batch size.
@@ -327,6 +341,7 @@ Net.backward = _Net_backward
 Net.forward_all = _Net_forward_all
 Net.forward_backward_all = _Net_forward_backward_all
 Net.set_input_arrays = _Net_set_input_arrays
+Net.stage_input_arrays = _Net_stage_input_arrays
 Net._batch = _Net_batch
 Net.inputs = _Net_inputs
 Net.outputs = _Net_outputs
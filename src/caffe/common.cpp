@@ -6,6 +6,7 @@
 
 #include "caffe/common.hpp"
 #include "caffe/util/rng.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -40,6 +41,44 @@ int64_t cluster_seedgen(void) {
 }
 
 
+// The pool of caffe_parallel_for, shared by all threads.
+struct CpuThreads {
+  CpuThreads() : num_threads(1) {}
+
+  // Held by the caller for the duration of a caffe_parallel_for.
+  boost::mutex mutex;
+  int num_threads;
+  shared_ptr<ThreadPool> pool;
+};
+
+static CpuThreads& cpu_threads_instance() {
+  static CpuThreads instance;
+  return instance;
+}
+
+int Caffe::cpu_threads() {
+  return cpu_threads_instance().num_threads;
+}
+
+void Caffe::set_cpu_threads(int num_threads) {
+  CHECK_GT(num_threads, 0);
+  CpuThreads& threads = cpu_threads_instance();
+  boost::mutex::scoped_lock lock(threads.mutex);
+  threads.num_threads = num_threads;
+  threads.pool.reset(num_threads > 1 ? new ThreadPool(num_threads) : NULL);
+}
+
+void caffe_parallel_for_pool(const int n, const int grain,
+    const boost::function<void(int, int)>& fn) {
+  CpuThreads& threads = cpu_threads_instance();
+  boost::unique_lock<boost::mutex> lock(threads.mutex, boost::try_to_lock);
+  if (lock.owns_lock() && threads.pool) {
+    threads.pool->ParallelForRange(n, grain, fn);
+    return;
+  }
+  fn(0, n);
+}
+
 void GlobalInit(int* pargc, char*** pargv) {
   // Google flags.
   ::gflags::ParseCommandLineFlags(pargc, pargv, true);
@@ -1,3 +1,4 @@
+#include <boost/bind.hpp>
 #include <boost/thread.hpp>
 #include <map>
 #include <string>
@@ -7,6 +8,8 @@
 #include "caffe/data_reader.hpp"
 #include "caffe/layers/data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/io.hpp"
+#include "caffe/util/rng.hpp"
 
 namespace caffe {
 
@@ -16,8 +19,8 @@ map<const string, weak_ptr<DataReader::Body> > DataReader::bodies_;
 static boost::mutex bodies_mutex_;
 
 DataReader::DataReader(const LayerParameter& param)
-    : queue_pair_(new QueuePair(  //
-        param.data_param().prefetch() * param.data_param().batch_size())) {
+    : queue_pair_(new QueuePair(param.data_param().prefetch(),
+                                param.data_param().batch_size())) {
   // Get or create a body
   boost::mutex::scoped_lock lock(bodies_mutex_);
   string key = source_key(param);
@@ -30,6 +33,17 @@ DataReader::DataReader(const LayerParameter& param)
   body_->new_queue_pairs_.push(queue_pair_);
 }
 
+string DataReader::cache_key(const LayerParameter& param) {
+  const TransformationParameter& transform_param = param.transform_param();
+  string key = param.data_param().source();
+  if (transform_param.force_color()) {
+    key += ":color";
+  } else if (transform_param.force_gray()) {
+    key += ":gray";
+  }
+  return key;
+}
+
 DataReader::~DataReader() {
   string key = source_key(body_->param_);
   body_.reset();
@@ -41,20 +55,32 @@ DataReader::~DataReader() {
 
 //
 
-DataReader::QueuePair::QueuePair(int size) {
-  // Initialize the free queue with requested number of datums
-  for (int i = 0; i < size; ++i) {
-    free_.push(new Datum());
+DataReader::QueuePair::QueuePair(int batches, int batch_size)
+    : free_(batches), full_(batches) {
+  // Initialize the free queue with requested number of batches
+  for (int i = 0; i < batches; ++i) {
+    vector<Datum*>* batch = new vector<Datum*>(batch_size);
+    for (int j = 0; j < batch_size; ++j) {
+      (*batch)[j] = new Datum();
+    }
+    free_.push(batch);
+  }
+}
+
+static void DeleteBatch(vector<Datum*>* batch) {
+  for (int i = 0; i < batch->size(); ++i) {
+    delete (*batch)[i];
   }
+  delete batch;
 }
 
 DataReader::QueuePair::~QueuePair() {
-  Datum* datum;
-  while (free_.try_pop(&datum)) {
-    delete datum;
+  vector<Datum*>* batch;
+  while (free_.try_pop(&batch)) {
+    DeleteBatch(batch);
   }
-  while (full_.try_pop(&datum)) {
-    delete datum;
+  while (full_.try_pop(&batch)) {
+    DeleteBatch(batch);
   }
 }
 
@@ -62,7 +88,16 @@ DataReader::QueuePair::~QueuePair() {
 
 DataReader::Body::Body(const LayerParameter& param)
     : param_(param),
-      new_queue_pairs_() {
+      new_queue_pairs_(),
+      record_id_(0),
+      key_pos_(0) {
+  CHECK_GT(param_.data_param().num_shards(), 0);
+  CHECK_LT(param_.data_param().shard_id(), param_.data_param().num_shards())
+      << "shard_id must be less than num_shards";
+  if (param_.data_param().cache_bytes() > 0) {
+    cache_ = DatumCache::Get(cache_key(param_),
+                             param_.data_param().cache_bytes());
+  }
   StartInternalThread();
 }
 
@@ -75,21 +110,27 @@ void DataReader::Body::InternalThreadEntry() {
   db->Open(param_.data_param().source(), db::READ);
   shared_ptr<db::Cursor> cursor(db->NewCursor());
   vector<shared_ptr<QueuePair> > qps;
+  if (param_.data_param().shuffle()) {
+    index_keys(db.get(), cursor.get());
+  } else if (param_.data_param().shard_id() > 0) {
+    // The cursor starts on the first record, i.e. of shard 0
+    next_record(cursor.get());
+  }
   try {
     int solver_count = param_.phase() == TRAIN ? Caffe::solver_count() : 1;
 
     // To ensure deterministic runs, only start running once all solvers
     // are ready. But solvers need to peek on one item during initialization,
-    // so read one item, then wait for the next solver.
+    // so read one batch, then wait for the next solver.
     for (int i = 0; i < solver_count; ++i) {
       shared_ptr<QueuePair> qp(new_queue_pairs_.pop());
-      read_one(cursor.get(), qp.get());
+      read_batch(cursor.get(), qp.get());
       qps.push_back(qp);
     }
     // Main loop
     while (!must_stop()) {
       for (int i = 0; i < solver_count; ++i) {
-        read_one(cursor.get(), qps[i].get());
+        read_batch(cursor.get(), qps[i].get());
       }
       // Check no additional readers have been created. This can happen if
       // more than one net is trained at a time per process, whether single
@@ -100,19 +141,112 @@ void DataReader::Body::InternalThreadEntry() {
   } catch (boost::thread_interrupted&) {
     // Interrupted exception is expected on shutdown
   }
+  // Cursors must be closed before the db
+  cursors_.clear();
 }
 
-void DataReader::Body::read_one(db::Cursor* cursor, QueuePair* qp) {
-  Datum* datum = qp->free_.pop();
-  // TODO deserialize in-place instead of copy?
+void DataReader::Body::read_batch(db::Cursor* cursor, QueuePair* qp) {
+  vector<Datum*>* batch = qp->free_.pop();
+  if (!keys_.empty()) {
+    read_shuffled(*batch);
+    qp->full_.push(batch);
+    return;
+  }
+  for (int i = 0; i < batch->size(); ++i) {
+    parse_one(cursor, (*batch)[i]);
+    next_record(cursor);
+  }
+  qp->full_.push(batch);
+}
+
+void DataReader::Body::parse_one(db::Cursor* cursor, Datum* datum) {
+  if (!cache_) {
+    // TODO deserialize in-place instead of copy?
+    datum->ParseFromString(cursor->value());
+    return;
+  }
+  const string key = cursor->key();
+  shared_ptr<const Datum> cached = cache_->Lookup(key);
+  if (cached) {
+    datum->CopyFrom(*cached);
+    return;
+  }
   datum->ParseFromString(cursor->value());
-  qp->full_.push(datum);
+#ifdef USE_OPENCV
+  // Decode once here so cached samples skip decoding too. The transformer
+  // rejects force_color/force_gray on raw datums, so these stay encoded.
+  const TransformationParameter& transform_param = param_.transform_param();
+  if (!transform_param.force_color() && !transform_param.force_gray()) {
+    DecodeDatumNative(datum);
+  }
+#endif  // USE_OPENCV
+  cache_->Insert(key, *datum);
+}
+
+void DataReader::Body::next_record(db::Cursor* cursor) {
+  const int shard_id = param_.data_param().shard_id();
+  const int num_shards = param_.data_param().num_shards();
+  bool restarted = false;
+  do {
+    // go to the next iter
+    cursor->Next();
+    ++record_id_;
+    if (!cursor->valid()) {
+      CHECK(!restarted) << "No record of shard " << shard_id << " in "
+          << param_.data_param().source();
+      restarted = true;
+      DLOG(INFO) << "Restarting data prefetching from start.";
+      cursor->SeekToFirst();
+      record_id_ = 0;
+    }
+  } while (record_id_ % num_shards != shard_id);
+}
+
+void DataReader::Body::index_keys(db::DB* db, db::Cursor* cursor) {
+  const int shard_id = param_.data_param().shard_id();
+  const int num_shards = param_.data_param().num_shards();
+  int record_id = 0;
+  for (cursor->SeekToFirst(); cursor->valid(); cursor->Next()) {
+    if (record_id++ % num_shards == shard_id) {
+      keys_.push_back(cursor->key());
+    }
+  }
+  CHECK(!keys_.empty()) << "No records of shard " << shard_id << " in "
+      << param_.data_param().source();
+  cursor->SeekToFirst();
+  LOG(INFO) << "Shuffling " << keys_.size() << " records of "
+      << param_.data_param().source();
+  shuffle(keys_.begin(), keys_.end());
+  const int read_threads = param_.data_param().read_threads();
+  CHECK_GT(read_threads, 0);
+  for (int i = 0; i < read_threads; ++i) {
+    cursors_.push_back(shared_ptr<db::Cursor>(db->NewCursor()));
+  }
+  thread_pool_.reset(new ThreadPool(read_threads));
+}
+
+void DataReader::Body::read_shuffled(const vector<Datum*>& batch) {
+  batch_keys_.resize(batch.size());
+  for (int i = 0; i < batch.size(); ++i) {
+    batch_keys_[i] = keys_[key_pos_];
+    if (++key_pos_ == keys_.size()) {
+      DLOG(INFO) << "Restarting data prefetching from start.";
+      key_pos_ = 0;
+      shuffle(keys_.begin(), keys_.end());
+    }
+  }
+  thread_pool_->ParallelFor(cursors_.size(),
+      boost::bind(&Body::read_shuffled_slice, this, _1, boost::cref(batch)));
+}
 
-  // go to the next iter
-  cursor->Next();
-  if (!cursor->valid()) {
-    DLOG(INFO) << "Restarting data prefetching from start.";
-    cursor->SeekToFirst();
+void DataReader::Body::read_shuffled_slice(int thread_id,
+    const vector<Datum*>& batch) {
+  db::Cursor* cursor = cursors_[thread_id].get();
+  for (int i = thread_id; i < batch.size(); i += cursors_.size()) {
+    const string& key = batch_keys_[i];
+    cursor->Seek(key);
+    CHECK(cursor->valid() && cursor->key() == key) << "Missing record " << key;
+    parse_one(cursor, batch[i]);
   }
 }
 
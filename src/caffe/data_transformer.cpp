@@ -2,6 +2,9 @@
 #include <opencv2/core/core.hpp>
 #endif  // USE_OPENCV
 
+#include <boost/bind.hpp>
+#include <algorithm>
+#include <cmath>
 #include <string>
 #include <vector>
 
@@ -36,62 +39,159 @@ DataTransformer<Dtype>::DataTransformer(const TransformationParameter& param,
       mean_values_.push_back(param_.mean_value(c));
     }
   }
+  thread_pool_.reset(new ThreadPool(param_.num_threads()));
+}
+
+template<typename Dtype>
+const Dtype* DataTransformer<Dtype>::PrepareMean(int channels, int height,
+    int width) {
+  if (mean_values_.size() > 0) {
+    CHECK(mean_values_.size() == 1 || mean_values_.size() == channels) <<
+     "Specify either 1 mean_value or as many as channels: " << channels;
+    if (channels > 1 && mean_values_.size() == 1) {
+      // Replicate the mean_value for simplicity
+      for (int c = 1; c < channels; ++c) {
+        mean_values_.push_back(mean_values_[0]);
+      }
+    }
+  }
+  if (param_.has_mean_file()) {
+    CHECK_EQ(channels, data_mean_.channels());
+    CHECK_EQ(height, data_mean_.height());
+    CHECK_EQ(width, data_mean_.width());
+    return data_mean_.cpu_data();
+  }
+  return NULL;
+}
+
+template<typename Dtype>
+typename DataTransformer<Dtype>::ItemTransform
+DataTransformer<Dtype>::PlanItem(int height, int width) {
+  const int crop_size = param_.crop_size();
+  ItemTransform item;
+  item.mirror = param_.mirror() && Rand(2);
+  item.h_off = 0;
+  item.w_off = 0;
+  if (crop_size) {
+    // We only do random crop when we do training.
+    if (phase_ == TRAIN) {
+      item.h_off = Rand(height - crop_size + 1);
+      item.w_off = Rand(width - crop_size + 1);
+    } else {
+      item.h_off = (height - crop_size) / 2;
+      item.w_off = (width - crop_size) / 2;
+    }
+  }
+  return item;
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::OutputDims(const Blob<Dtype>& transformed_blob,
+    int* channels, int* height, int* width) const {
+  if (param_.layout() == TransformationParameter_Layout_NHWC) {
+    CHECK_EQ(transformed_blob.num_axes(), 4)
+        << "NHWC output requires a 4D blob";
+    *height = transformed_blob.shape(1);
+    *width = transformed_blob.shape(2);
+    *channels = transformed_blob.shape(3);
+  } else {
+    *channels = transformed_blob.channels();
+    *height = transformed_blob.height();
+    *width = transformed_blob.width();
+  }
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::OutputStrides(int channels, int height,
+    int width, int* c_stride, int* h_stride, int* w_stride) const {
+  if (param_.layout() == TransformationParameter_Layout_NHWC) {
+    *c_stride = 1;
+    *h_stride = width * channels;
+    *w_stride = channels;
+  } else {
+    *c_stride = height * width;
+    *h_stride = width;
+    *w_stride = 1;
+  }
+}
+
+template<typename Dtype>
+vector<int> DataTransformer<Dtype>::OutputShape(int channels, int height,
+    int width) const {
+  vector<int> shape(4);
+  shape[0] = 1;
+  if (param_.layout() == TransformationParameter_Layout_NHWC) {
+    shape[1] = height;
+    shape[2] = width;
+    shape[3] = channels;
+  } else {
+    shape[1] = channels;
+    shape[2] = height;
+    shape[3] = width;
+  }
+  return shape;
+}
+
+template<typename Dtype>
+typename DataTransformer<Dtype>::ItemTransform
+DataTransformer<Dtype>::PlanItem(int channels, int height, int width,
+    const Blob<Dtype>& transformed_blob) {
+  const int crop_size = param_.crop_size();
+  int out_channels, out_height, out_width;
+  OutputDims(transformed_blob, &out_channels, &out_height, &out_width);
+  CHECK_GT(channels, 0);
+  CHECK_GE(height, crop_size);
+  CHECK_GE(width, crop_size);
+  CHECK_EQ(out_channels, channels);
+  if (crop_size) {
+    CHECK_EQ(crop_size, out_height);
+    CHECK_EQ(crop_size, out_width);
+  } else {
+    CHECK_EQ(height, out_height);
+    CHECK_EQ(width, out_width);
+  }
+  return PlanItem(height, width);
 }
 
 template<typename Dtype>
 void DataTransformer<Dtype>::Transform(const Datum& datum,
                                        Dtype* transformed_data) {
-  const string& data = datum.data();
   const int datum_channels = datum.channels();
   const int datum_height = datum.height();
   const int datum_width = datum.width();
-
   const int crop_size = param_.crop_size();
-  const Dtype scale = param_.scale();
-  const bool do_mirror = param_.mirror() && Rand(2);
-  const bool has_mean_file = param_.has_mean_file();
-  const bool has_uint8 = data.size() > 0;
-  const bool has_mean_values = mean_values_.size() > 0;
 
   CHECK_GT(datum_channels, 0);
   CHECK_GE(datum_height, crop_size);
   CHECK_GE(datum_width, crop_size);
 
-  Dtype* mean = NULL;
-  if (has_mean_file) {
-    CHECK_EQ(datum_channels, data_mean_.channels());
-    CHECK_EQ(datum_height, data_mean_.height());
-    CHECK_EQ(datum_width, data_mean_.width());
-    mean = data_mean_.mutable_cpu_data();
-  }
-  if (has_mean_values) {
-    CHECK(mean_values_.size() == 1 || mean_values_.size() == datum_channels) <<
-     "Specify either 1 mean_value or as many as channels: " << datum_channels;
-    if (datum_channels > 1 && mean_values_.size() == 1) {
-      // Replicate the mean_value for simplicity
-      for (int c = 1; c < datum_channels; ++c) {
-        mean_values_.push_back(mean_values_[0]);
-      }
-    }
-  }
+  const ItemTransform item = PlanItem(datum_height, datum_width);
+  const Dtype* mean = PrepareMean(datum_channels, datum_height, datum_width);
+  const int height = crop_size ? crop_size : datum_height;
+  const int width = crop_size ? crop_size : datum_width;
+  Transform(datum, item, mean, height, width, transformed_data);
+}
 
-  int height = datum_height;
-  int width = datum_width;
+template<typename Dtype>
+void DataTransformer<Dtype>::Transform(const Datum& datum,
+    const ItemTransform& item, const Dtype* mean, int height, int width,
+    Dtype* transformed_data) {
+  const string& data = datum.data();
+  const int datum_channels = datum.channels();
+  const int datum_height = datum.height();
+  const int datum_width = datum.width();
 
-  int h_off = 0;
-  int w_off = 0;
-  if (crop_size) {
-    height = crop_size;
-    width = crop_size;
-    // We only do random crop when we do training.
-    if (phase_ == TRAIN) {
-      h_off = Rand(datum_height - crop_size + 1);
-      w_off = Rand(datum_width - crop_size + 1);
-    } else {
-      h_off = (datum_height - crop_size) / 2;
-      w_off = (datum_width - crop_size) / 2;
-    }
-  }
+  const Dtype scale = param_.scale();
+  const bool do_mirror = item.mirror;
+  const int h_off = item.h_off;
+  const int w_off = item.w_off;
+  const bool has_mean_file = mean != NULL;
+  const bool has_uint8 = data.size() > 0;
+  const bool has_mean_values = mean_values_.size() > 0;
+
+  int c_stride, h_stride, w_stride;
+  OutputStrides(datum_channels, height, width, &c_stride, &h_stride,
+                &w_stride);
 
   Dtype datum_element;
   int top_index, data_index;
@@ -100,9 +200,9 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
       for (int w = 0; w < width; ++w) {
         data_index = (c * datum_height + h_off + h) * datum_width + w_off + w;
         if (do_mirror) {
-          top_index = (c * height + h) * width + (width - 1 - w);
+          top_index = c * c_stride + h * h_stride + (width - 1 - w) * w_stride;
         } else {
-          top_index = (c * height + h) * width + w;
+          top_index = c * c_stride + h * h_stride + w * w_stride;
         }
         if (has_uint8) {
           datum_element =
@@ -133,17 +233,8 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
   // If datum is encoded, decoded and transform the cv::image.
   if (datum.encoded()) {
 #ifdef USE_OPENCV
-    CHECK(!(param_.force_color() && param_.force_gray()))
-        << "cannot set both force_color and force_gray";
-    cv::Mat cv_img;
-    if (param_.force_color() || param_.force_gray()) {
-    // If force_color then decode in color otherwise decode in gray.
-      cv_img = DecodeDatumToCVMat(datum, param_.force_color());
-    } else {
-      cv_img = DecodeDatumToCVMatNative(datum);
-    }
     // Transform the cv::image into blob.
-    return Transform(cv_img, transformed_blob);
+    return Transform(DecodeDatum(datum), transformed_blob);
 #else
     LOG(FATAL) << "Encoded datum requires OpenCV; compile with USE_OPENCV.";
 #endif  // USE_OPENCV
@@ -159,9 +250,8 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
   const int datum_width = datum.width();
 
   // Check dimensions.
-  const int channels = transformed_blob->channels();
-  const int height = transformed_blob->height();
-  const int width = transformed_blob->width();
+  int channels, height, width;
+  OutputDims(*transformed_blob, &channels, &height, &width);
   const int num = transformed_blob->num();
 
   CHECK_EQ(channels, datum_channels);
@@ -184,41 +274,287 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
 template<typename Dtype>
 void DataTransformer<Dtype>::Transform(const vector<Datum> & datum_vector,
                                        Blob<Dtype>* transformed_blob) {
+  vector<Datum*> datum_ptrs(datum_vector.size());
+  for (int item_id = 0; item_id < datum_vector.size(); ++item_id) {
+    datum_ptrs[item_id] = const_cast<Datum*>(&datum_vector[item_id]);
+  }
+  TransformBatch(datum_ptrs, transformed_blob);
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::TransformBatch(const vector<Datum*>& datum_vector,
+                                            Blob<Dtype>* transformed_blob) {
   const int datum_num = datum_vector.size();
   const int num = transformed_blob->num();
-  const int channels = transformed_blob->channels();
-  const int height = transformed_blob->height();
-  const int width = transformed_blob->width();
+  int channels, height, width;
+  OutputDims(*transformed_blob, &channels, &height, &width);
 
   CHECK_GT(datum_num, 0) << "There is no datum to add";
   CHECK_LE(datum_num, num) <<
     "The size of datum_vector must be no greater than transformed_blob->num()";
-  Blob<Dtype> uni_blob(1, channels, height, width);
+
+  bool has_encoded = false;
   for (int item_id = 0; item_id < datum_num; ++item_id) {
-    int offset = transformed_blob->offset(item_id);
-    uni_blob.set_cpu_data(transformed_blob->mutable_cpu_data() + offset);
-    Transform(datum_vector[item_id], &uni_blob);
+    has_encoded |= datum_vector[item_id]->encoded();
+  }
+  cv::Mat* decoded = NULL;
+#ifdef USE_OPENCV
+  // Decoding dominates for encoded datums, so it is spread over the pool too.
+  vector<cv::Mat> decoded_mats;
+  if (has_encoded) {
+    decoded_mats.resize(datum_num);
+    decoded = &decoded_mats[0];
+    thread_pool_->ParallelFor(datum_num, boost::bind(
+        &DataTransformer<Dtype>::DecodeBatchItem, this, _1,
+        boost::cref(datum_vector), decoded));
+  }
+#else
+  if (has_encoded) {
+    LOG(FATAL) << "Encoded datum requires OpenCV; compile with USE_OPENCV.";
+  }
+#endif  // USE_OPENCV
+  if (!has_encoded && (param_.force_color() || param_.force_gray())) {
+    LOG(ERROR) << "force_color and force_gray only for encoded datum";
+  }
+
+  // Draw all crop offsets and mirror flags up front, in item order, so the
+  // result does not depend on how the items are scheduled.
+  batch_items_.resize(datum_num);
+  const Dtype* mean = NULL;
+  for (int item_id = 0; item_id < datum_num; ++item_id) {
+    const Datum& datum = *datum_vector[item_id];
+    int item_channels = datum.channels();
+    int item_height = datum.height();
+    int item_width = datum.width();
+#ifdef USE_OPENCV
+    if (datum.encoded()) {
+      CHECK(decoded[item_id].data) << "Could not decode datum " << item_id;
+      CHECK(decoded[item_id].depth() == CV_8U)
+          << "Image data type must be unsigned byte";
+      item_channels = decoded[item_id].channels();
+      item_height = decoded[item_id].rows;
+      item_width = decoded[item_id].cols;
+    }
+#endif  // USE_OPENCV
+    batch_items_[item_id] = PlanItem(item_channels, item_height, item_width,
+                                     *transformed_blob);
+    mean = PrepareMean(item_channels, item_height, item_width);
   }
+
+  Dtype* transformed_data = transformed_blob->mutable_cpu_data();
+  thread_pool_->ParallelFor(datum_num, boost::bind(
+      &DataTransformer<Dtype>::TransformDatumBatchItem, this, _1,
+      boost::cref(datum_vector), decoded, mean, height, width,
+      transformed_data));
 }
 
+template<typename Dtype>
+void DataTransformer<Dtype>::TransformDatumBatchItem(int item_id,
+    const vector<Datum*>& datum_vector, const cv::Mat* decoded,
+    const Dtype* mean, int height, int width, Dtype* transformed_data) {
+  const Datum& datum = *datum_vector[item_id];
+  const ItemTransform& item = batch_items_[item_id];
 #ifdef USE_OPENCV
+  if (datum.encoded()) {
+    const cv::Mat& cv_img = decoded[item_id];
+    Transform(cv_img, item, mean, height, width,
+        transformed_data + item_id * cv_img.channels() * height * width);
+    return;
+  }
+#endif  // USE_OPENCV
+  Transform(datum, item, mean, height, width,
+      transformed_data + item_id * datum.channels() * height * width);
+}
+
+#ifdef USE_OPENCV
+template<typename Dtype>
+cv::Mat DataTransformer<Dtype>::DecodeDatum(const Datum& datum) {
+  CHECK(!(param_.force_color() && param_.force_gray()))
+      << "cannot set both force_color and force_gray";
+  if (param_.force_color() || param_.force_gray()) {
+    // If force_color then decode in color otherwise decode in gray.
+    return DecodeDatumToCVMat(datum, param_.force_color());
+  }
+  return DecodeDatumToCVMatNative(datum);
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::DecodeBatchItem(int item_id,
+    const vector<Datum*>& datum_vector, cv::Mat* decoded) {
+  if (datum_vector[item_id]->encoded()) {
+    decoded[item_id] = DecodeDatum(*datum_vector[item_id]);
+  }
+}
+
 template<typename Dtype>
 void DataTransformer<Dtype>::Transform(const vector<cv::Mat> & mat_vector,
                                        Blob<Dtype>* transformed_blob) {
   const int mat_num = mat_vector.size();
   const int num = transformed_blob->num();
-  const int channels = transformed_blob->channels();
-  const int height = transformed_blob->height();
-  const int width = transformed_blob->width();
 
   CHECK_GT(mat_num, 0) << "There is no MAT to add";
   CHECK_EQ(mat_num, num) <<
     "The size of mat_vector must be equals to transformed_blob->num()";
-  Blob<Dtype> uni_blob(1, channels, height, width);
+  TransformBatch(mat_vector, transformed_blob);
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::TransformBatch(const vector<cv::Mat>& mat_vector,
+                                            Blob<Dtype>* transformed_blob) {
+  const int mat_num = mat_vector.size();
+  const int num = transformed_blob->num();
+  int channels, height, width;
+  OutputDims(*transformed_blob, &channels, &height, &width);
+
+  CHECK_GT(mat_num, 0) << "There is no MAT to add";
+  CHECK_LE(mat_num, num) <<
+    "The size of mat_vector must be no greater than transformed_blob->num()";
+
+  // Draw all crop offsets and mirror flags up front, in item order, so the
+  // result does not depend on how the items are scheduled.
+  batch_items_.resize(mat_num);
+  const Dtype* mean = NULL;
   for (int item_id = 0; item_id < mat_num; ++item_id) {
-    int offset = transformed_blob->offset(item_id);
-    uni_blob.set_cpu_data(transformed_blob->mutable_cpu_data() + offset);
-    Transform(mat_vector[item_id], &uni_blob);
+    const cv::Mat& cv_img = mat_vector[item_id];
+    CHECK(cv_img.data) << "Empty image at batch item " << item_id;
+    CHECK(cv_img.depth() == CV_8U) << "Image data type must be unsigned byte";
+    batch_items_[item_id] = PlanItem(cv_img.channels(), cv_img.rows,
+                                     cv_img.cols, *transformed_blob);
+    mean = PrepareMean(cv_img.channels(), cv_img.rows, cv_img.cols);
+  }
+
+  Dtype* transformed_data = transformed_blob->mutable_cpu_data();
+  thread_pool_->ParallelFor(mat_num, boost::bind(
+      &DataTransformer<Dtype>::TransformMatBatchItem, this, _1,
+      boost::cref(mat_vector), mean, height, width, transformed_data));
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::TransformMatBatchItem(int item_id,
+    const vector<cv::Mat>& mat_vector, const Dtype* mean, int height,
+    int width, Dtype* transformed_data) {
+  const cv::Mat& cv_img = mat_vector[item_id];
+  Transform(cv_img, batch_items_[item_id], mean, height, width,
+      transformed_data + item_id * cv_img.channels() * height * width);
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::TransformBatch(const vector<cv::Mat>& mat_vector,
+    int resize_height, int resize_width, Blob<Dtype>* transformed_blob) {
+  const int mat_num = mat_vector.size();
+  const int num = transformed_blob->num();
+  int channels, height, width;
+  OutputDims(*transformed_blob, &channels, &height, &width);
+
+  CHECK_GT(mat_num, 0) << "There is no MAT to add";
+  CHECK_LE(mat_num, num) <<
+    "The size of mat_vector must be no greater than transformed_blob->num()";
+  CHECK_GT(resize_height, 0);
+  CHECK_GT(resize_width, 0);
+
+  // Plans are drawn in the resized frame, in item order, as TransformBatch
+  // does on resized images.
+  batch_items_.resize(mat_num);
+  const Dtype* mean = NULL;
+  for (int item_id = 0; item_id < mat_num; ++item_id) {
+    const cv::Mat& cv_img = mat_vector[item_id];
+    CHECK(cv_img.data) << "Empty image at batch item " << item_id;
+    CHECK(cv_img.depth() == CV_8U) << "Image data type must be unsigned byte";
+    batch_items_[item_id] = PlanItem(cv_img.channels(), resize_height,
+                                     resize_width, *transformed_blob);
+    mean = PrepareMean(cv_img.channels(), resize_height, resize_width);
+  }
+
+  Dtype* transformed_data = transformed_blob->mutable_cpu_data();
+  thread_pool_->ParallelFor(mat_num, boost::bind(
+      &DataTransformer<Dtype>::TransformResizedBatchItem, this, _1,
+      boost::cref(mat_vector), mean, resize_height, resize_width, height,
+      width, transformed_data));
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::TransformResizedBatchItem(int item_id,
+    const vector<cv::Mat>& mat_vector, const Dtype* mean, int resize_height,
+    int resize_width, int height, int width, Dtype* transformed_data) {
+  const cv::Mat& cv_img = mat_vector[item_id];
+  TransformResized(cv_img, batch_items_[item_id], mean, resize_height,
+      resize_width, height, width,
+      transformed_data + item_id * cv_img.channels() * height * width);
+}
+
+// Source index and weight of the next pixel for output coordinate dst,
+// mapped the way cv::resize does with INTER_LINEAR.
+static inline void LinearSource(int dst, float scale, int size, int* src,
+    float* weight) {
+  const float pos = (dst + 0.5f) * scale - 0.5f;
+  int i = static_cast<int>(std::floor(pos));
+  float f = pos - i;
+  if (i < 0) {
+    i = 0;
+    f = 0;
+  }
+  if (i >= size - 1) {
+    i = size - 1;
+    f = 0;
+  }
+  *src = i;
+  *weight = f;
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::TransformResized(const cv::Mat& cv_img,
+    const ItemTransform& item, const Dtype* mean, int resize_height,
+    int resize_width, int height, int width, Dtype* transformed_data) {
+  const int img_channels = cv_img.channels();
+  const int img_height = cv_img.rows;
+  const int img_width = cv_img.cols;
+  const float scale_y = static_cast<float>(img_height) / resize_height;
+  const float scale_x = static_cast<float>(img_width) / resize_width;
+
+  const Dtype scale = param_.scale();
+  const bool has_mean_file = mean != NULL;
+  const bool has_mean_values = mean_values_.size() > 0;
+
+  // Columns of the crop: channel offsets of the two source pixels of each,
+  // and the weight of the second one.
+  vector<int> x0(width), x1(width);
+  vector<float> fx(width);
+  for (int w = 0; w < width; ++w) {
+    int x;
+    LinearSource(item.w_off + w, scale_x, img_width, &x, &fx[w]);
+    x0[w] = x * img_channels;
+    x1[w] = std::min(x + 1, img_width - 1) * img_channels;
+  }
+
+  int c_stride, h_stride, w_stride;
+  OutputStrides(img_channels, height, width, &c_stride, &h_stride, &w_stride);
+
+  for (int h = 0; h < height; ++h) {
+    int y;
+    float fy;
+    LinearSource(item.h_off + h, scale_y, img_height, &y, &fy);
+    const uchar* row0 = cv_img.ptr<uchar>(y);
+    const uchar* row1 = cv_img.ptr<uchar>(std::min(y + 1, img_height - 1));
+    for (int w = 0; w < width; ++w) {
+      const int top_w = item.mirror ? width - 1 - w : w;
+      for (int c = 0; c < img_channels; ++c) {
+        const float top = row0[x0[w] + c] +
+            (row0[x1[w] + c] - row0[x0[w] + c]) * fx[w];
+        const float bottom = row1[x0[w] + c] +
+            (row1[x1[w] + c] - row1[x0[w] + c]) * fx[w];
+        const Dtype pixel = top + (bottom - top) * fy;
+        const int top_index = c * c_stride + h * h_stride + top_w * w_stride;
+        if (has_mean_file) {
+          const int mean_index = (c * resize_height + item.h_off + h) *
+              resize_width + item.w_off + w;
+          transformed_data[top_index] = (pixel - mean[mean_index]) * scale;
+        } else if (has_mean_values) {
+          transformed_data[top_index] = (pixel - mean_values_[c]) * scale;
+        } else {
+          transformed_data[top_index] = pixel * scale;
+        }
+      }
+    }
   }
 }
 
@@ -231,9 +567,8 @@ void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
   const int img_width = cv_img.cols;
 
   // Check dimensions.
-  const int channels = transformed_blob->channels();
-  const int height = transformed_blob->height();
-  const int width = transformed_blob->width();
+  int channels, height, width;
+  OutputDims(*transformed_blob, &channels, &height, &width);
   const int num = transformed_blob->num();
 
   CHECK_EQ(channels, img_channels);
@@ -243,69 +578,56 @@ void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
 
   CHECK(cv_img.depth() == CV_8U) << "Image data type must be unsigned byte";
 
-  const Dtype scale = param_.scale();
-  const bool do_mirror = param_.mirror() && Rand(2);
-  const bool has_mean_file = param_.has_mean_file();
-  const bool has_mean_values = mean_values_.size() > 0;
-
   CHECK_GT(img_channels, 0);
   CHECK_GE(img_height, crop_size);
   CHECK_GE(img_width, crop_size);
 
-  Dtype* mean = NULL;
-  if (has_mean_file) {
-    CHECK_EQ(img_channels, data_mean_.channels());
-    CHECK_EQ(img_height, data_mean_.height());
-    CHECK_EQ(img_width, data_mean_.width());
-    mean = data_mean_.mutable_cpu_data();
-  }
-  if (has_mean_values) {
-    CHECK(mean_values_.size() == 1 || mean_values_.size() == img_channels) <<
-     "Specify either 1 mean_value or as many as channels: " << img_channels;
-    if (img_channels > 1 && mean_values_.size() == 1) {
-      // Replicate the mean_value for simplicity
-      for (int c = 1; c < img_channels; ++c) {
-        mean_values_.push_back(mean_values_[0]);
-      }
-    }
-  }
-
-  int h_off = 0;
-  int w_off = 0;
-  cv::Mat cv_cropped_img = cv_img;
   if (crop_size) {
     CHECK_EQ(crop_size, height);
     CHECK_EQ(crop_size, width);
-    // We only do random crop when we do training.
-    if (phase_ == TRAIN) {
-      h_off = Rand(img_height - crop_size + 1);
-      w_off = Rand(img_width - crop_size + 1);
-    } else {
-      h_off = (img_height - crop_size) / 2;
-      w_off = (img_width - crop_size) / 2;
-    }
-    cv::Rect roi(w_off, h_off, crop_size, crop_size);
-    cv_cropped_img = cv_img(roi);
   } else {
     CHECK_EQ(img_height, height);
     CHECK_EQ(img_width, width);
   }
 
-  CHECK(cv_cropped_img.data);
+  const ItemTransform item = PlanItem(img_height, img_width);
+  const Dtype* mean = PrepareMean(img_channels, img_height, img_width);
+  Transform(cv_img, item, mean, height, width,
+            transformed_blob->mutable_cpu_data());
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
+    const ItemTransform& item, const Dtype* mean, int height, int width,
+    Dtype* transformed_data) {
+  const int img_channels = cv_img.channels();
+  const int img_height = cv_img.rows;
+  const int img_width = cv_img.cols;
+
+  const Dtype scale = param_.scale();
+  const bool do_mirror = item.mirror;
+  const int h_off = item.h_off;
+  const int w_off = item.w_off;
+  const bool has_mean_file = mean != NULL;
+  const bool has_mean_values = mean_values_.size() > 0;
+
+  CHECK(cv_img.data);
+
+  int c_stride, h_stride, w_stride;
+  OutputStrides(img_channels, height, width, &c_stride, &h_stride, &w_stride);
 
-  Dtype* transformed_data = transformed_blob->mutable_cpu_data();
   int top_index;
   for (int h = 0; h < height; ++h) {
-    const uchar* ptr = cv_cropped_img.ptr<uchar>(h);
+    // Crop by starting at the (h_off, w_off) pixel of the image row.
+    const uchar* ptr = cv_img.ptr<uchar>(h_off + h) + w_off * img_channels;
     int img_index = 0;
     for (int w = 0; w < width; ++w) {
       for (int c = 0; c < img_channels; ++c) {
         if (do_mirror) {
-          top_index = (c * height + h) * width + (width - 1 - w);
+          top_index = c * c_stride + h * h_stride + (width - 1 - w) * w_stride;
         } else {
-          top_index = (c * height + h) * width + w;
+          top_index = c * c_stride + h * h_stride + w * w_stride;
         }
-        // int top_index = (c * height + h) * width + w;
         Dtype pixel = static_cast<Dtype>(ptr[img_index++]);
         if (has_mean_file) {
           int mean_index = (c * img_height + h_off + h) * img_width + w_off + w;
@@ -328,6 +650,8 @@ void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
 template<typename Dtype>
 void DataTransformer<Dtype>::Transform(Blob<Dtype>* input_blob,
                                        Blob<Dtype>* transformed_blob) {
+  CHECK_EQ(param_.layout(), TransformationParameter_Layout_NCHW)
+      << "Blob inputs are only transformed to NCHW";
   const int crop_size = param_.crop_size();
   const int input_num = input_blob->num();
   const int input_channels = input_blob->channels();
@@ -442,17 +766,8 @@ template<typename Dtype>
 vector<int> DataTransformer<Dtype>::InferBlobShape(const Datum& datum) {
   if (datum.encoded()) {
 #ifdef USE_OPENCV
-    CHECK(!(param_.force_color() && param_.force_gray()))
-        << "cannot set both force_color and force_gray";
-    cv::Mat cv_img;
-    if (param_.force_color() || param_.force_gray()) {
-    // If force_color then decode in color otherwise decode in gray.
-      cv_img = DecodeDatumToCVMat(datum, param_.force_color());
-    } else {
-      cv_img = DecodeDatumToCVMatNative(datum);
-    }
     // InferBlobShape using the cv::image.
-    return InferBlobShape(cv_img);
+    return InferBlobShape(DecodeDatum(datum));
 #else
     LOG(FATAL) << "Encoded datum requires OpenCV; compile with USE_OPENCV.";
 #endif  // USE_OPENCV
@@ -466,12 +781,9 @@ vector<int> DataTransformer<Dtype>::InferBlobShape(const Datum& datum) {
   CHECK_GE(datum_height, crop_size);
   CHECK_GE(datum_width, crop_size);
   // Build BlobShape.
-  vector<int> shape(4);
-  shape[0] = 1;
-  shape[1] = datum_channels;
-  shape[2] = (crop_size)? crop_size: datum_height;
-  shape[3] = (crop_size)? crop_size: datum_width;
-  return shape;
+  return OutputShape(datum_channels,
+                     (crop_size)? crop_size: datum_height,
+                     (crop_size)? crop_size: datum_width);
 }
 
 template<typename Dtype>
@@ -489,21 +801,7 @@ vector<int> DataTransformer<Dtype>::InferBlobShape(
 #ifdef USE_OPENCV
 template<typename Dtype>
 vector<int> DataTransformer<Dtype>::InferBlobShape(const cv::Mat& cv_img) {
-  const int crop_size = param_.crop_size();
-  const int img_channels = cv_img.channels();
-  const int img_height = cv_img.rows;
-  const int img_width = cv_img.cols;
-  // Check dimensions.
-  CHECK_GT(img_channels, 0);
-  CHECK_GE(img_height, crop_size);
-  CHECK_GE(img_width, crop_size);
-  // Build BlobShape.
-  vector<int> shape(4);
-  shape[0] = 1;
-  shape[1] = img_channels;
-  shape[2] = (crop_size)? crop_size: img_height;
-  shape[3] = (crop_size)? crop_size: img_width;
-  return shape;
+  return InferBlobShape(cv_img.channels(), cv_img.rows, cv_img.cols);
 }
 
 template<typename Dtype>
@@ -519,6 +817,20 @@ vector<int> DataTransformer<Dtype>::InferBlobShape(
 }
 #endif  // USE_OPENCV
 
+template<typename Dtype>
+vector<int> DataTransformer<Dtype>::InferBlobShape(int channels, int height,
+                                                   int width) {
+  const int crop_size = param_.crop_size();
+  // Check dimensions.
+  CHECK_GT(channels, 0);
+  CHECK_GE(height, crop_size);
+  CHECK_GE(width, crop_size);
+  // Build BlobShape.
+  return OutputShape(channels,
+                     (crop_size)? crop_size: height,
+                     (crop_size)? crop_size: width);
+}
+
 template <typename Dtype>
 void DataTransformer<Dtype>::InitRand() {
   const bool needs_rand = param_.mirror() ||
@@ -50,12 +50,16 @@ shared_ptr<Layer<Dtype> > GetConvolutionLayer(
   if (engine == ConvolutionParameter_Engine_DEFAULT) {
     engine = ConvolutionParameter_Engine_CAFFE;
 #ifdef USE_CUDNN
-    if (!use_dilation) {
+    // NHWC bottoms are only handled by the Caffe engine.
+    if (!use_dilation &&
+        conv_param.bottom_layout() == ConvolutionParameter_Layout_NCHW) {
       engine = ConvolutionParameter_Engine_CUDNN;
     }
 #endif
   }
-  if (engine == ConvolutionParameter_Engine_CAFFE) {
+  if (engine == ConvolutionParameter_Engine_CAFFE ||
+      engine == ConvolutionParameter_Engine_DIRECT ||
+      engine == ConvolutionParameter_Engine_WINOGRAD) {
     return shared_ptr<Layer<Dtype> >(new ConvolutionLayer<Dtype>(param));
 #ifdef USE_CUDNN
   } else if (engine == ConvolutionParameter_Engine_CUDNN) {
@@ -63,6 +67,10 @@ shared_ptr<Layer<Dtype> > GetConvolutionLayer(
       LOG(FATAL) << "CuDNN doesn't support the dilated convolution at Layer "
                  << param.name();
     }
+    if (conv_param.bottom_layout() != ConvolutionParameter_Layout_NCHW) {
+      LOG(FATAL) << "CuDNN doesn't support NHWC bottoms at Layer "
+                 << param.name();
+    }
     return shared_ptr<Layer<Dtype> >(new CuDNNConvolutionLayer<Dtype>(param));
 #endif
   } else {
@@ -3,8 +3,10 @@
 
 #include "caffe/filler.hpp"
 #include "caffe/layers/base_conv_layer.hpp"
+#include "caffe/util/direct_conv.hpp"
 #include "caffe/util/im2col.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/winograd.hpp"
 
 namespace caffe {
 
@@ -19,6 +21,23 @@ void BaseConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   const int num_axes = bottom[0]->num_axes();
   num_spatial_axes_ = num_axes - first_spatial_axis;
   CHECK_GE(num_spatial_axes_, 0);
+  // Channels-last bottoms are (N, H, W, C): the spatial axes start at the
+  // channel axis of the top and the channels come last.
+  channels_last_ =
+      conv_param.bottom_layout() == ConvolutionParameter_Layout_NHWC;
+  if (channels_last_) {
+    CHECK(!reverse_dimensions())
+        << "NHWC bottoms are only supported by Convolution.";
+    CHECK_EQ(num_spatial_axes_, 2)
+        << "NHWC bottoms are only supported for 2D convolution.";
+    CHECK(!force_nd_im2col_)
+        << "NHWC bottoms do not support force_nd_im2col.";
+    bottom_channel_axis_ = num_axes - 1;
+    bottom_first_spatial_axis_ = channel_axis_;
+  } else {
+    bottom_channel_axis_ = channel_axis_;
+    bottom_first_spatial_axis_ = first_spatial_axis;
+  }
   vector<int> bottom_dim_blob_shape(1, num_spatial_axes_ + 1);
   vector<int> spatial_dim_blob_shape(1, std::max(num_spatial_axes_, 1));
   // Setup filter kernel dimensions (kernel_shape_).
@@ -108,14 +127,54 @@ void BaseConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   }
   // Special case: im2col is the identity for 1x1 convolution with stride 1
   // and no padding, so flag for skipping the buffer and transformation.
-  is_1x1_ = true;
+  // NHWC bottoms always need im2col to reorder the channels.
+  is_1x1_ = !channels_last_;
   for (int i = 0; i < num_spatial_axes_; ++i) {
     is_1x1_ &=
         kernel_shape_data[i] == 1 && stride_data[i] == 1 && pad_data[i] == 0;
     if (!is_1x1_) { break; }
   }
+  // The DIRECT engine convolves 2D NCHW images without building columns
+  // when it has a kernel for their size and stride; otherwise, and for the
+  // backward pass, im2col and GEMM are used. It is slower than GEMM and only
+  // saves the memory of the column buffer, which is never allocated when
+  // the net runs forward only. The backward pass needs the buffer for the
+  // weight gradients, so in the TRAIN phase the engine would cost time and
+  // save nothing, and GEMM is used.
+  direct_ = false;
+  if (conv_param.engine() == ConvolutionParameter_Engine_DIRECT) {
+    direct_ = this->phase_ == TEST && !reverse_dimensions() &&
+        !channels_last_ && !force_nd_im2col_ && num_spatial_axes_ == 2 &&
+        dilation_data[0] == 1 && dilation_data[1] == 1 &&
+        direct_conv_supported(kernel_shape_data[0], kernel_shape_data[1],
+        stride_data[0], stride_data[1]);
+    if (this->phase_ != TEST) {
+      LOG(INFO) << "Layer " << this->layer_param_.name()
+          << " uses im2col + GEMM, as the DIRECT engine only applies to the"
+          << " TEST phase.";
+    } else if (!direct_) {
+      LOG(INFO) << "Layer " << this->layer_param_.name()
+          << " has no direct convolution kernel, using im2col + GEMM.";
+    }
+  }
+  // Likewise for the WINOGRAD engine, limited to 3x3 kernels and stride 1.
+  winograd_ = false;
+  winograd_tile_ = conv_param.winograd_tile();
+  if (conv_param.engine() == ConvolutionParameter_Engine_WINOGRAD) {
+    CHECK(winograd_tile_ == 2 || winograd_tile_ == 4)
+        << "winograd_tile must be 2 or 4.";
+    winograd_ = !reverse_dimensions() && !channels_last_ &&
+        !force_nd_im2col_ && num_spatial_axes_ == 2 &&
+        dilation_data[0] == 1 && dilation_data[1] == 1 &&
+        winograd_supported(winograd_tile_, kernel_shape_data[0],
+        kernel_shape_data[1], stride_data[0], stride_data[1]);
+    if (!winograd_) {
+      LOG(INFO) << "Layer " << this->layer_param_.name()
+          << " is not a 3x3 convolution with stride 1, using im2col + GEMM.";
+    }
+  }
   // Configure output channels and groups.
-  channels_ = bottom[0]->shape(channel_axis_);
+  channels_ = bottom[0]->shape(bottom_channel_axis_);
   num_output_ = this->layer_param_.convolution_param().num_output();
   CHECK_GT(num_output_, 0);
   group_ = this->layer_param_.convolution_param().group();
@@ -180,6 +239,22 @@ void BaseConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   weight_offset_ = conv_out_channels_ * kernel_dim_ / group_;
   // Propagate gradients to the parameters (as directed by backward pass).
   this->param_propagate_down_.resize(this->blobs_.size(), true);
+  // Threads splitting the images of a batch, with their own buffers.
+  num_threads_ = conv_param.num_threads();
+  CHECK_GT(num_threads_, 0) << "num_threads must be positive.";
+  if (num_threads_ > 1) {
+    thread_pool_.reset(new ThreadPool(num_threads_));
+  }
+  thread_col_buffers_.resize(num_threads_);
+  thread_weight_diffs_.resize(num_threads_);
+  thread_bias_diffs_.resize(num_threads_);
+  for (int t = 1; t < num_threads_; ++t) {
+    thread_col_buffers_[t].reset(new Blob<Dtype>());
+    thread_weight_diffs_[t].reset(new Blob<Dtype>(this->blobs_[0]->shape()));
+    if (bias_term_) {
+      thread_bias_diffs_[t].reset(new Blob<Dtype>(this->blobs_[1]->shape()));
+    }
+  }
 }
 
 template <typename Dtype>
@@ -189,7 +264,7 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   CHECK_EQ(bottom[0]->num_axes(), first_spatial_axis + num_spatial_axes_)
       << "bottom num_axes may not change.";
   num_ = bottom[0]->count(0, channel_axis_);
-  CHECK_EQ(bottom[0]->shape(channel_axis_), channels_)
+  CHECK_EQ(bottom[0]->shape(bottom_channel_axis_), channels_)
       << "Input size incompatible with convolution kernel.";
   // TODO: generalize to handle inputs of different shapes.
   for (int bottom_id = 1; bottom_id < bottom.size(); ++bottom_id) {
@@ -223,7 +298,7 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     if (reverse_dimensions()) {
       conv_input_shape_data[i] = top[0]->shape(channel_axis_ + i);
     } else {
-      conv_input_shape_data[i] = bottom[0]->shape(channel_axis_ + i);
+      conv_input_shape_data[i] = input_shape(i);
     }
   }
   // The im2col result buffer will only hold one image at a time to avoid
@@ -238,7 +313,20 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       col_buffer_shape_.push_back(output_shape_[i]);
     }
   }
-  col_buffer_.Reshape(col_buffer_shape_);
+  vector<int> buffer_shape = col_buffer_shape_;
+  if (winograd_) {
+    const int workspace_size = winograd_workspace_size(winograd_tile_,
+        conv_in_channels_ / group_, conv_out_channels_ / group_,
+        output_shape_[0], output_shape_[1]);
+    const int col_count = kernel_dim_ * group_ * conv_out_spatial_dim_;
+    if (workspace_size > col_count) {
+      buffer_shape = vector<int>(1, workspace_size);
+    }
+  }
+  col_buffer_.Reshape(buffer_shape);
+  for (int t = 1; t < num_threads_; ++t) {
+    thread_col_buffers_[t]->Reshape(buffer_shape);
+  }
   bottom_dim_ = bottom[0]->count(channel_axis_);
   top_dim_ = top[0]->count(channel_axis_);
   num_kernels_im2col_ = conv_in_channels_ * conv_out_spatial_dim_;
@@ -256,18 +344,64 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
     const Dtype* weights, Dtype* output, bool skip_im2col) {
+  forward_cpu_gemm(input, weights, output,
+      is_1x1_ ? NULL : col_buffer_.mutable_cpu_data(), skip_im2col);
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
+    const Dtype* weights, Dtype* output, Dtype* col_buffer,
+    bool skip_im2col) {
+  if (direct_) {
+    const int* kernel_shape = kernel_shape_.cpu_data();
+    const int* pad = pad_.cpu_data();
+    const int* stride = stride_.cpu_data();
+    const int* input_shape = conv_input_shape_.cpu_data();
+    for (int g = 0; g < group_; ++g) {
+      direct_conv_cpu(input + input_shape[1] * input_shape[2] *
+          conv_in_channels_ / group_ * g, conv_in_channels_ / group_,
+          input_shape[1], input_shape[2], weights + weight_offset_ * g,
+          conv_out_channels_ / group_, kernel_shape[0], kernel_shape[1],
+          pad[0], pad[1], stride[0], stride[1], output_shape_[0],
+          output_shape_[1], output + output_offset_ * g);
+    }
+    return;
+  }
+  if (winograd_) {
+    const int* pad = pad_.cpu_data();
+    const int* input_shape = conv_input_shape_.cpu_data();
+    const Dtype* transformed_weights = winograd_weights_.cpu_data();
+    for (int g = 0; g < group_; ++g) {
+      winograd_conv_cpu(winograd_tile_, input + input_shape[1] *
+          input_shape[2] * conv_in_channels_ / group_ * g,
+          conv_in_channels_ / group_, input_shape[1], input_shape[2],
+          transformed_weights + winograd_weights_.count() / group_ * g,
+          conv_out_channels_ / group_, pad[0], pad[1], output_shape_[0],
+          output_shape_[1], col_buffer, output + output_offset_ * g);
+    }
+    return;
+  }
   const Dtype* col_buff = input;
   if (!is_1x1_) {
     if (!skip_im2col) {
-      conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
+      conv_im2col_cpu(input, col_buffer);
     }
-    col_buff = col_buffer_.cpu_data();
+    col_buff = col_buffer;
   }
+  const bool packed = packed_weights_version_ ==
+      this->blobs_[0]->data_version() &&
+      packed_weights_[0]->source() == weights;
   for (int g = 0; g < group_; ++g) {
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
-        group_, conv_out_spatial_dim_, kernel_dim_,
-        (Dtype)1., weights + weight_offset_ * g, col_buff + col_offset_ * g,
-        (Dtype)0., output + output_offset_ * g);
+    if (packed) {
+      caffe_cpu_gemm<Dtype>(*packed_weights_[g], CblasNoTrans,
+          conv_out_spatial_dim_, (Dtype)1., col_buff + col_offset_ * g,
+          (Dtype)0., output + output_offset_ * g);
+    } else {
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
+          group_, conv_out_spatial_dim_, kernel_dim_,
+          (Dtype)1., weights + weight_offset_ * g, col_buff + col_offset_ * g,
+          (Dtype)0., output + output_offset_ * g);
+    }
   }
 }
 
@@ -282,7 +416,14 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_bias(Dtype* output,
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::backward_cpu_gemm(const Dtype* output,
     const Dtype* weights, Dtype* input) {
-  Dtype* col_buff = col_buffer_.mutable_cpu_data();
+  backward_cpu_gemm(output, weights, input,
+      is_1x1_ ? NULL : col_buffer_.mutable_cpu_data());
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::backward_cpu_gemm(const Dtype* output,
+    const Dtype* weights, Dtype* input, Dtype* col_buffer) {
+  Dtype* col_buff = col_buffer;
   if (is_1x1_) {
     col_buff = input;
   }
@@ -300,10 +441,17 @@ void BaseConvolutionLayer<Dtype>::backward_cpu_gemm(const Dtype* output,
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::weight_cpu_gemm(const Dtype* input,
     const Dtype* output, Dtype* weights) {
+  weight_cpu_gemm(input, output, weights,
+      is_1x1_ ? NULL : col_buffer_.mutable_cpu_data());
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::weight_cpu_gemm(const Dtype* input,
+    const Dtype* output, Dtype* weights, Dtype* col_buffer) {
   const Dtype* col_buff = input;
   if (!is_1x1_) {
-    conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
-    col_buff = col_buffer_.cpu_data();
+    conv_im2col_cpu(input, col_buffer);
+    col_buff = col_buffer;
   }
   for (int g = 0; g < group_; ++g) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, conv_out_channels_ / group_,
@@ -313,6 +461,59 @@ void BaseConvolutionLayer<Dtype>::weight_cpu_gemm(const Dtype* input,
   }
 }
 
+template <typename Dtype>
+Dtype* BaseConvolutionLayer<Dtype>::thread_col_buffer(int t) {
+  if (is_1x1_) {
+    return NULL;
+  }
+  return t == 0 ? col_buffer_.mutable_cpu_data() :
+      thread_col_buffers_[t]->mutable_cpu_data();
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::update_winograd_weights(
+    const Dtype* weights) {
+  // Solver updates, CopyFrom, net sharing... all go through
+  // mutable_cpu_data or replace the memory, which changes the version.
+  if (winograd_weights_version_ == this->blobs_[0]->data_version()) {
+    return;
+  }
+  winograd_weights_version_ = this->blobs_[0]->data_version();
+  const int in_channels = conv_in_channels_ / group_;
+  const int out_channels = conv_out_channels_ / group_;
+  const int group_size = winograd_weights_size(winograd_tile_, in_channels,
+      out_channels);
+  winograd_weights_.Reshape(vector<int>(1, group_size * group_));
+  Dtype* transformed_weights = winograd_weights_.mutable_cpu_data();
+  for (int g = 0; g < group_; ++g) {
+    winograd_transform_weights_cpu(winograd_tile_,
+        weights + weight_offset_ * g, in_channels, out_channels,
+        transformed_weights + group_size * g);
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::update_packed_weights() {
+  if (direct_ || winograd_) {
+    return;
+  }
+  const uint64_t version = this->blobs_[0]->data_version();
+  if (packed_weights_version_ == version &&
+      packed_weights_[0]->backend() == GemmBackend::Get()) {
+    return;
+  }
+  const Dtype* weights = this->blobs_[0]->cpu_data();
+  packed_weights_.resize(group_);
+  for (int g = 0; g < group_; ++g) {
+    if (!packed_weights_[g]) {
+      packed_weights_[g].reset(new GemmPackedA<Dtype>());
+    }
+    packed_weights_[g]->Pack(CblasNoTrans, conv_out_channels_ / group_,
+        kernel_dim_, weights + weight_offset_ * g);
+  }
+  packed_weights_version_ = version;
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::backward_cpu_bias(Dtype* bias,
     const Dtype* input) {
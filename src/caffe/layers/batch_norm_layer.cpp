@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "caffe/layers/batch_norm_layer.hpp"
@@ -83,6 +84,30 @@ void BatchNormLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+void BatchNormLayer<Dtype>::UpdateGlobalScaleShift() {
+  vector<uint64_t> versions(3);
+  for (int i = 0; i < 3; ++i) {
+    versions[i] = this->blobs_[i]->data_version();
+  }
+  if (versions == global_stats_versions_) {
+    return;
+  }
+  global_stats_versions_ = versions;
+  const Dtype scale_factor = this->blobs_[2]->cpu_data()[0] == 0 ?
+      0 : 1 / this->blobs_[2]->cpu_data()[0];
+  const Dtype* mean = this->blobs_[0]->cpu_data();
+  const Dtype* variance = this->blobs_[1]->cpu_data();
+  global_scale_.Reshape(vector<int>(1, channels_));
+  global_shift_.Reshape(vector<int>(1, channels_));
+  Dtype* scale = global_scale_.mutable_cpu_data();
+  Dtype* shift = global_shift_.mutable_cpu_data();
+  for (int c = 0; c < channels_; ++c) {
+    scale[c] = 1 / std::sqrt(scale_factor * variance[c] + eps_);
+    shift[c] = -scale_factor * mean[c] * scale[c];
+  }
+}
+
 template <typename Dtype>
 void BatchNormLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
@@ -91,28 +116,27 @@ void BatchNormLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   int num = bottom[0]->shape(0);
   int spatial_dim = bottom[0]->count()/(bottom[0]->shape(0)*channels_);
 
+  if (use_global_stats_) {
+    // use the stored mean/variance estimates, folded into one pass.
+    UpdateGlobalScaleShift();
+    caffe_cpu_scale_shift(num, channels_, spatial_dim,
+        global_scale_.cpu_data(), global_shift_.cpu_data(), bottom_data,
+        top_data);
+    return;
+  }
+
   if (bottom[0] != top[0]) {
     caffe_copy(bottom[0]->count(), bottom_data, top_data);
   }
 
-  if (use_global_stats_) {
-    // use the stored mean/variance estimates.
-    const Dtype scale_factor = this->blobs_[2]->cpu_data()[0] == 0 ?
-        0 : 1 / this->blobs_[2]->cpu_data()[0];
-    caffe_cpu_scale(variance_.count(), scale_factor,
-        this->blobs_[0]->cpu_data(), mean_.mutable_cpu_data());
-    caffe_cpu_scale(variance_.count(), scale_factor,
-        this->blobs_[1]->cpu_data(), variance_.mutable_cpu_data());
-  } else {
-    // compute mean
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, channels_ * num, spatial_dim,
-        1. / (num * spatial_dim), bottom_data,
-        spatial_sum_multiplier_.cpu_data(), 0.,
-        num_by_chans_.mutable_cpu_data());
-    caffe_cpu_gemv<Dtype>(CblasTrans, num, channels_, 1.,
-        num_by_chans_.cpu_data(), batch_sum_multiplier_.cpu_data(), 0.,
-        mean_.mutable_cpu_data());
-  }
+  // compute mean
+  caffe_cpu_gemv<Dtype>(CblasNoTrans, channels_ * num, spatial_dim,
+      1. / (num * spatial_dim), bottom_data,
+      spatial_sum_multiplier_.cpu_data(), 0.,
+      num_by_chans_.mutable_cpu_data());
+  caffe_cpu_gemv<Dtype>(CblasTrans, num, channels_, 1.,
+      num_by_chans_.cpu_data(), batch_sum_multiplier_.cpu_data(), 0.,
+      mean_.mutable_cpu_data());
 
   // subtract mean
   caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, channels_, 1, 1,
@@ -122,29 +146,27 @@ void BatchNormLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       spatial_dim, 1, -1, num_by_chans_.cpu_data(),
       spatial_sum_multiplier_.cpu_data(), 1., top_data);
 
-  if (!use_global_stats_) {
-    // compute variance using var(X) = E((X-EX)^2)
-    caffe_powx(top[0]->count(), top_data, Dtype(2),
-        temp_.mutable_cpu_data());  // (X-EX)^2
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, channels_ * num, spatial_dim,
-        1. / (num * spatial_dim), temp_.cpu_data(),
-        spatial_sum_multiplier_.cpu_data(), 0.,
-        num_by_chans_.mutable_cpu_data());
-    caffe_cpu_gemv<Dtype>(CblasTrans, num, channels_, 1.,
-        num_by_chans_.cpu_data(), batch_sum_multiplier_.cpu_data(), 0.,
-        variance_.mutable_cpu_data());  // E((X_EX)^2)
-
-    // compute and save moving average
-    this->blobs_[2]->mutable_cpu_data()[0] *= moving_average_fraction_;
-    this->blobs_[2]->mutable_cpu_data()[0] += 1;
-    caffe_cpu_axpby(mean_.count(), Dtype(1), mean_.cpu_data(),
-        moving_average_fraction_, this->blobs_[0]->mutable_cpu_data());
-    int m = bottom[0]->count()/channels_;
-    Dtype bias_correction_factor = m > 1 ? Dtype(m)/(m-1) : 1;
-    caffe_cpu_axpby(variance_.count(), bias_correction_factor,
-        variance_.cpu_data(), moving_average_fraction_,
-        this->blobs_[1]->mutable_cpu_data());
-  }
+  // compute variance using var(X) = E((X-EX)^2)
+  caffe_powx(top[0]->count(), top_data, Dtype(2),
+      temp_.mutable_cpu_data());  // (X-EX)^2
+  caffe_cpu_gemv<Dtype>(CblasNoTrans, channels_ * num, spatial_dim,
+      1. / (num * spatial_dim), temp_.cpu_data(),
+      spatial_sum_multiplier_.cpu_data(), 0.,
+      num_by_chans_.mutable_cpu_data());
+  caffe_cpu_gemv<Dtype>(CblasTrans, num, channels_, 1.,
+      num_by_chans_.cpu_data(), batch_sum_multiplier_.cpu_data(), 0.,
+      variance_.mutable_cpu_data());  // E((X_EX)^2)
+
+  // compute and save moving average
+  this->blobs_[2]->mutable_cpu_data()[0] *= moving_average_fraction_;
+  this->blobs_[2]->mutable_cpu_data()[0] += 1;
+  caffe_cpu_axpby(mean_.count(), Dtype(1), mean_.cpu_data(),
+      moving_average_fraction_, this->blobs_[0]->mutable_cpu_data());
+  int m = bottom[0]->count()/channels_;
+  Dtype bias_correction_factor = m > 1 ? Dtype(m)/(m-1) : 1;
+  caffe_cpu_axpby(variance_.count(), bias_correction_factor,
+      variance_.cpu_data(), moving_average_fraction_,
+      this->blobs_[1]->mutable_cpu_data());
 
   // normalize variance
   caffe_add_scalar(variance_.count(), eps_, variance_.mutable_cpu_data());
@@ -169,6 +191,15 @@ template <typename Dtype>
 void BatchNormLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
+  int num = bottom[0]->shape()[0];
+  int spatial_dim = bottom[0]->count()/(bottom[0]->shape(0)*channels_);
+  if (use_global_stats_) {
+    // the forward pass is affine: scale the diff, in place or not.
+    caffe_cpu_scale_shift(num, channels_, spatial_dim,
+        global_scale_.cpu_data(), static_cast<const Dtype*>(NULL),
+        top[0]->cpu_diff(), bottom[0]->mutable_cpu_diff());
+    return;
+  }
   const Dtype* top_diff;
   if (bottom[0] != top[0]) {
     top_diff = top[0]->cpu_diff();
@@ -177,13 +208,7 @@ void BatchNormLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     top_diff = x_norm_.cpu_diff();
   }
   Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-  if (use_global_stats_) {
-    caffe_div(temp_.count(), top_diff, temp_.cpu_data(), bottom_diff);
-    return;
-  }
   const Dtype* top_data = x_norm_.cpu_data();
-  int num = bottom[0]->shape()[0];
-  int spatial_dim = bottom[0]->count()/(bottom[0]->shape(0)*channels_);
   // if Y = (X-mean(X))/(sqrt(var(X)+eps)), then
   //
   // dE(Y)/dX =
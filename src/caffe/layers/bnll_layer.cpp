@@ -1,3 +1,4 @@
+#include <boost/bind.hpp>
 #include <algorithm>
 #include <vector>
 
@@ -7,17 +8,35 @@ namespace caffe {
 
 const float kBNLL_THRESHOLD = 50.;
 
+// The forward and backward passes over [begin, end).
+template <typename Dtype>
+static void bnll_forward(const Dtype* bottom_data, Dtype* top_data,
+    const int begin, const int end) {
+  for (int i = begin; i < end; ++i) {
+    top_data[i] = bottom_data[i] > 0 ?
+        bottom_data[i] + log(1. + exp(-bottom_data[i])) :
+        log(1. + exp(bottom_data[i]));
+  }
+}
+
+template <typename Dtype>
+static void bnll_backward(const Dtype* bottom_data, const Dtype* top_diff,
+    Dtype* bottom_diff, const int begin, const int end) {
+  for (int i = begin; i < end; ++i) {
+    const Dtype expval =
+        exp(std::min(bottom_data[i], Dtype(kBNLL_THRESHOLD)));
+    bottom_diff[i] = top_diff[i] * expval / (expval + 1.);
+  }
+}
+
 template <typename Dtype>
 void BNLLLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
   const int count = bottom[0]->count();
-  for (int i = 0; i < count; ++i) {
-    top_data[i] = bottom_data[i] > 0 ?
-        bottom_data[i] + log(1. + exp(-bottom_data[i])) :
-        log(1. + exp(bottom_data[i]));
-  }
+  caffe_parallel_for(count, CAFFE_CPU_TRANSCENDENTAL_GRAIN, boost::bind(
+      &bnll_forward<Dtype>, bottom_data, top_data, _1, _2));
 }
 
 template <typename Dtype>
@@ -29,11 +48,8 @@ void BNLLLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const Dtype* top_diff = top[0]->cpu_diff();
     Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
     const int count = bottom[0]->count();
-    Dtype expval;
-    for (int i = 0; i < count; ++i) {
-      expval = exp(std::min(bottom_data[i], Dtype(kBNLL_THRESHOLD)));
-      bottom_diff[i] = top_diff[i] * expval / (expval + 1.);
-    }
+    caffe_parallel_for(count, CAFFE_CPU_TRANSCENDENTAL_GRAIN, boost::bind(
+        &bnll_backward<Dtype>, bottom_data, top_diff, bottom_diff, _1, _2));
   }
 }
 
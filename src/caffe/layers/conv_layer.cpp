@@ -1,6 +1,8 @@
+#include <boost/bind.hpp>
 #include <vector>
 
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
@@ -25,16 +27,36 @@ template <typename Dtype>
 void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const Dtype* weight = this->blobs_[0]->cpu_data();
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  if (this->winograd_) {
+    this->update_winograd_weights(weight);
+  } else {
+    this->update_packed_weights();
+  }
   for (int i = 0; i < bottom.size(); ++i) {
     const Dtype* bottom_data = bottom[i]->cpu_data();
     Dtype* top_data = top[i]->mutable_cpu_data();
-    for (int n = 0; n < this->num_; ++n) {
-      this->forward_cpu_gemm(bottom_data + n * this->bottom_dim_, weight,
-          top_data + n * this->top_dim_);
-      if (this->bias_term_) {
-        const Dtype* bias = this->blobs_[1]->cpu_data();
-        this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
-      }
+    if (this->num_image_threads() > 1) {
+      this->thread_pool_->ParallelFor(this->num_image_threads(), boost::bind(
+          &ConvolutionLayer<Dtype>::ForwardImages, this, _1, bottom_data,
+          weight, bias, top_data));
+    } else {
+      ForwardImages(0, bottom_data, weight, bias, top_data);
+    }
+  }
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::ForwardImages(int t, const Dtype* bottom_data,
+    const Dtype* weight, const Dtype* bias, Dtype* top_data) {
+  // The DIRECT engine needs no column buffer, which is then never allocated.
+  Dtype* col_buff = this->direct_ ? NULL : this->thread_col_buffer(t);
+  for (int n = this->thread_image_begin(t);
+       n < this->thread_image_begin(t + 1); ++n) {
+    this->forward_cpu_gemm(bottom_data + n * this->bottom_dim_, weight,
+        top_data + n * this->top_dim_, col_buff, false);
+    if (bias) {
+      this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
     }
   }
 }
@@ -43,31 +65,74 @@ template <typename Dtype>
 void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
   const Dtype* weight = this->blobs_[0]->cpu_data();
-  Dtype* weight_diff = this->blobs_[0]->mutable_cpu_diff();
+  Dtype* weight_diff = this->param_propagate_down_[0] ?
+      this->blobs_[0]->mutable_cpu_diff() : NULL;
+  Dtype* bias_diff = this->bias_term_ && this->param_propagate_down_[1] ?
+      this->blobs_[1]->mutable_cpu_diff() : NULL;
+  const int num_threads = this->num_image_threads();
   for (int i = 0; i < top.size(); ++i) {
     const Dtype* top_diff = top[i]->cpu_diff();
     const Dtype* bottom_data = bottom[i]->cpu_data();
-    Dtype* bottom_diff = bottom[i]->mutable_cpu_diff();
-    // Bias gradient, if necessary.
-    if (this->bias_term_ && this->param_propagate_down_[1]) {
-      Dtype* bias_diff = this->blobs_[1]->mutable_cpu_diff();
-      for (int n = 0; n < this->num_; ++n) {
-        this->backward_cpu_bias(bias_diff, top_diff + n * this->top_dim_);
-      }
-    }
-    if (this->param_propagate_down_[0] || propagate_down[i]) {
-      for (int n = 0; n < this->num_; ++n) {
-        // gradient w.r.t. weight. Note that we will accumulate diffs.
-        if (this->param_propagate_down_[0]) {
-          this->weight_cpu_gemm(bottom_data + n * this->bottom_dim_,
-              top_diff + n * this->top_dim_, weight_diff);
+    // Not fetched unless needed, which would allocate and sync the diff.
+    Dtype* bottom_diff = propagate_down[i] ?
+        bottom[i]->mutable_cpu_diff() : NULL;
+    if (num_threads > 1) {
+      this->thread_pool_->ParallelFor(num_threads, boost::bind(
+          &ConvolutionLayer<Dtype>::BackwardImages, this, _1, top_diff,
+          bottom_data, weight, bottom_diff, propagate_down[i], weight_diff,
+          bias_diff));
+      // Sum the parameter gradients of the other threads into thread 0's.
+      for (int t = 1; t < num_threads; ++t) {
+        if (weight_diff) {
+          caffe_axpy(this->blobs_[0]->count(), Dtype(1),
+              this->thread_weight_diffs_[t]->cpu_data(), weight_diff);
         }
-        // gradient w.r.t. bottom data, if necessary.
-        if (propagate_down[i]) {
-          this->backward_cpu_gemm(top_diff + n * this->top_dim_, weight,
-              bottom_diff + n * this->bottom_dim_);
+        if (bias_diff) {
+          caffe_axpy(this->blobs_[1]->count(), Dtype(1),
+              this->thread_bias_diffs_[t]->cpu_data(), bias_diff);
         }
       }
+    } else {
+      BackwardImages(0, top_diff, bottom_data, weight, bottom_diff,
+          propagate_down[i], weight_diff, bias_diff);
+    }
+  }
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::BackwardImages(int t, const Dtype* top_diff,
+    const Dtype* bottom_data, const Dtype* weight, Dtype* bottom_diff,
+    bool propagate_down, Dtype* weight_diff, Dtype* bias_diff) {
+  // Threads other than 0 accumulate into their own, zeroed gradients.
+  if (t > 0 && weight_diff) {
+    weight_diff = this->thread_weight_diffs_[t]->mutable_cpu_data();
+    caffe_set(this->blobs_[0]->count(), Dtype(0), weight_diff);
+  }
+  if (t > 0 && bias_diff) {
+    bias_diff = this->thread_bias_diffs_[t]->mutable_cpu_data();
+    caffe_set(this->blobs_[1]->count(), Dtype(0), bias_diff);
+  }
+  Dtype* col_buff = this->thread_col_buffer(t);
+  const int begin = this->thread_image_begin(t);
+  const int end = this->thread_image_begin(t + 1);
+  // Bias gradient, if necessary.
+  if (bias_diff) {
+    for (int n = begin; n < end; ++n) {
+      this->backward_cpu_bias(bias_diff, top_diff + n * this->top_dim_);
+    }
+  }
+  if (weight_diff || propagate_down) {
+    for (int n = begin; n < end; ++n) {
+      // gradient w.r.t. weight. Note that we will accumulate diffs.
+      if (weight_diff) {
+        this->weight_cpu_gemm(bottom_data + n * this->bottom_dim_,
+            top_diff + n * this->top_dim_, weight_diff, col_buff);
+      }
+      // gradient w.r.t. bottom data, if necessary.
+      if (propagate_down) {
+        this->backward_cpu_gemm(top_diff + n * this->top_dim_, weight,
+            bottom_diff + n * this->bottom_dim_, col_buff);
+      }
     }
   }
 }
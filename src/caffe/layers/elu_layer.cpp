@@ -1,3 +1,4 @@
+#include <boost/bind.hpp>
 #include <algorithm>
 #include <vector>
 
@@ -5,6 +6,26 @@
 
 namespace caffe {
 
+// The forward and backward passes over [begin, end).
+template <typename Dtype>
+static void elu_forward(const Dtype* bottom_data, Dtype alpha,
+    Dtype* top_data, const int begin, const int end) {
+  for (int i = begin; i < end; ++i) {
+    top_data[i] = std::max(bottom_data[i], Dtype(0))
+        + alpha * (exp(std::min(bottom_data[i], Dtype(0))) - Dtype(1));
+  }
+}
+
+template <typename Dtype>
+static void elu_backward(const Dtype* bottom_data, const Dtype* top_data,
+    const Dtype* top_diff, Dtype alpha, Dtype* bottom_diff,
+    const int begin, const int end) {
+  for (int i = begin; i < end; ++i) {
+    bottom_diff[i] = top_diff[i] * ((bottom_data[i] > 0)
+        + (alpha + top_data[i]) * (bottom_data[i] <= 0));
+  }
+}
+
 template <typename Dtype>
 void ELULayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
@@ -12,10 +33,8 @@ void ELULayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   Dtype* top_data = top[0]->mutable_cpu_data();
   const int count = bottom[0]->count();
   Dtype alpha = this->layer_param_.elu_param().alpha();
-  for (int i = 0; i < count; ++i) {
-    top_data[i] = std::max(bottom_data[i], Dtype(0))
-        + alpha * (exp(std::min(bottom_data[i], Dtype(0))) - Dtype(1));
-  }
+  caffe_parallel_for(count, CAFFE_CPU_TRANSCENDENTAL_GRAIN, boost::bind(
+      &elu_forward<Dtype>, bottom_data, alpha, top_data, _1, _2));
 }
 
 template <typename Dtype>
@@ -29,10 +48,9 @@ void ELULayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
     const int count = bottom[0]->count();
     Dtype alpha = this->layer_param_.elu_param().alpha();
-    for (int i = 0; i < count; ++i) {
-      bottom_diff[i] = top_diff[i] * ((bottom_data[i] > 0)
-          + (alpha + top_data[i]) * (bottom_data[i] <= 0));
-    }
+    caffe_parallel_for(count, CAFFE_CPU_ARITHMETIC_GRAIN, boost::bind(
+        &elu_backward<Dtype>, bottom_data, top_data, top_diff, alpha,
+        bottom_diff, _1, _2));
   }
 }
 
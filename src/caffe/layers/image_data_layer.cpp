@@ -1,16 +1,16 @@
 #ifdef USE_OPENCV
 #include <opencv2/core/core.hpp>
 
-#include <fstream>  // NOLINT(readability/streams)
-#include <iostream>  // NOLINT(readability/streams)
+#include <cstdlib>
+#include <cstring>
 #include <string>
-#include <utility>
 #include <vector>
 
 #include "caffe/data_transformer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/layers/image_data_layer.hpp"
 #include "caffe/util/benchmark.hpp"
+#include "caffe/util/format.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/rng.hpp"
@@ -36,17 +36,20 @@ void ImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   // Read the file with filenames and labels
   const string& source = this->layer_param_.image_data_param().source();
   LOG(INFO) << "Opening file " << source;
-  std::ifstream infile(source.c_str());
-  string line;
-  size_t pos;
-  int label;
-  while (std::getline(infile, line)) {
-    pos = line.find_last_of(' ');
-    label = atoi(line.substr(pos + 1).c_str());
-    lines_.push_back(std::make_pair(line.substr(0, pos), label));
+  const int shard_id = this->layer_param_.image_data_param().shard_id();
+  const int num_shards = this->layer_param_.image_data_param().num_shards();
+  CHECK_GT(num_shards, 0);
+  CHECK_LT(shard_id, num_shards) << "shard_id must be less than num_shards";
+  {
+    string list;
+    CHECK(ReadFileToString(source, &list)) << "Could not read " << source;
+    ParseImageList(list, shard_id, num_shards);
   }
 
   CHECK(!lines_.empty()) << "File is empty";
+  if (num_shards > 1) {
+    LOG(INFO) << "Using shard " << shard_id << " of " << num_shards;
+  }
 
   if (this->layer_param_.image_data_param().shuffle()) {
     // randomly shuffle data
@@ -66,10 +69,18 @@ void ImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
     CHECK_GT(lines_.size(), skip) << "Not enough points to skip";
     lines_id_ = skip;
   }
+  const uint64_t cache_bytes =
+      this->layer_param_.image_data_param().cache_bytes();
+  if (cache_bytes > 0) {
+    // Images are cached after resizing, so the settings are part of the key.
+    cache_ = DatumCache::Get(source + ":" + root_folder + ":" +
+        format_int(new_height) + "x" + format_int(new_width) +
+        (is_color ? ":color" : ":gray"), cache_bytes);
+  }
   // Read an image, and use it to initialize the top blob.
-  cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
+  cv::Mat cv_img = ReadImageToCVMat(root_folder + line_name(lines_id_),
                                     new_height, new_width, is_color);
-  CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
+  CHECK(cv_img.data) << "Could not load " << line_name(lines_id_);
   // Use data_transformer to infer the expected blob shape from a cv_image.
   vector<int> top_shape = this->data_transformer_->InferBlobShape(cv_img);
   this->transformed_data_.Reshape(top_shape);
@@ -93,6 +104,36 @@ void ImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+void ImageDataLayer<Dtype>::ParseImageList(const string& list, int shard_id,
+    int num_shards) {
+  const char* begin = list.data();
+  const char* const end = begin + list.size();
+  names_.reserve(list.size());
+  for (int line_id = 0; begin < end; ) {
+    const char* line_end =
+        static_cast<const char*>(memchr(begin, '\n', end - begin));
+    if (line_end == NULL) {
+      line_end = end;
+    }
+    if (line_end > begin && line_id++ % num_shards == shard_id) {
+      // The label follows the last space, names may contain spaces.
+      const char* space = line_end;
+      while (space > begin && space[-1] != ' ') {
+        --space;
+      }
+      const char* name_end = space > begin ? space - 1 : line_end;
+      Line line;
+      line.name_offset = names_.size();
+      line.name_length = name_end - begin;
+      line.label = atoi(space);
+      names_.append(begin, name_end);
+      lines_.push_back(line);
+    }
+    begin = line_end + 1;
+  }
+}
+
 template <typename Dtype>
 void ImageDataLayer<Dtype>::ShuffleImages() {
   caffe::rng_t* prefetch_rng =
@@ -117,39 +158,30 @@ void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   const bool is_color = image_data_param.is_color();
   string root_folder = image_data_param.root_folder();
 
-  // Reshape according to the first image of each batch
-  // on single input batches allows for inputs of varying dimension.
-  cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
-      new_height, new_width, is_color);
-  CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
-  // Use data_transformer to infer the expected blob shape from a cv_img.
-  vector<int> top_shape = this->data_transformer_->InferBlobShape(cv_img);
-  this->transformed_data_.Reshape(top_shape);
-  // Reshape batch according to the batch_size.
-  top_shape[0] = batch_size;
-  batch->data_.Reshape(top_shape);
-
-  Dtype* prefetch_data = batch->data_.mutable_cpu_data();
   Dtype* prefetch_label = batch->label_.mutable_cpu_data();
 
   // datum scales
   const int lines_size = lines_.size();
+  vector<cv::Mat> cv_imgs(cache_ ? 0 : batch_size);
+  vector<shared_ptr<const Datum> > cached_imgs(cache_ ? batch_size : 0);
   for (int item_id = 0; item_id < batch_size; ++item_id) {
     // get a blob
     timer.Start();
     CHECK_GT(lines_size, lines_id_);
-    cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
-        new_height, new_width, is_color);
-    CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
+    if (cache_) {
+      cached_imgs[item_id] = ReadCachedImage(lines_id_);
+    } else {
+      // Resizing is left to the transformer, which only interpolates the
+      // region it crops.
+      cv_imgs[item_id] = ReadImageToCVMatReduced(
+          root_folder + line_name(lines_id_), new_height, new_width,
+          is_color);
+      CHECK(cv_imgs[item_id].data) << "Could not load "
+          << line_name(lines_id_);
+    }
     read_time += timer.MicroSeconds();
-    timer.Start();
-    // Apply transformations (mirror, crop...) to the image
-    int offset = batch->data_.offset(item_id);
-    this->transformed_data_.set_cpu_data(prefetch_data + offset);
-    this->data_transformer_->Transform(cv_img, &(this->transformed_data_));
-    trans_time += timer.MicroSeconds();
 
-    prefetch_label[item_id] = lines_[lines_id_].second;
+    prefetch_label[item_id] = lines_[lines_id_].label;
     // go to the next iter
     lines_id_++;
     if (lines_id_ >= lines_size) {
@@ -161,12 +193,66 @@ void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
       }
     }
   }
+  // Reshape according to the first image of each batch
+  // on single input batches allows for inputs of varying dimension.
+  const bool resize = new_height > 0 && new_width > 0;
+  vector<int> top_shape;
+  if (cache_) {
+    top_shape = this->data_transformer_->InferBlobShape(*cached_imgs[0]);
+  } else if (resize) {
+    top_shape = this->data_transformer_->InferBlobShape(
+        cv_imgs[0].channels(), new_height, new_width);
+  } else {
+    top_shape = this->data_transformer_->InferBlobShape(cv_imgs[0]);
+  }
+  this->transformed_data_.Reshape(top_shape);
+  // Reshape batch according to the batch_size.
+  top_shape[0] = batch_size;
+  batch->data_.Reshape(top_shape);
+
+  timer.Start();
+  // Apply transformations (mirror, crop...) to the whole batch
+  if (cache_) {
+    // Cached images are only read by the transformer.
+    vector<Datum*> datum_vector(batch_size);
+    for (int item_id = 0; item_id < batch_size; ++item_id) {
+      datum_vector[item_id] = const_cast<Datum*>(cached_imgs[item_id].get());
+    }
+    this->data_transformer_->TransformBatch(datum_vector, &(batch->data_));
+  } else if (resize) {
+    this->data_transformer_->TransformBatch(cv_imgs, new_height, new_width,
+                                            &(batch->data_));
+  } else {
+    this->data_transformer_->TransformBatch(cv_imgs, &(batch->data_));
+  }
+  trans_time += timer.MicroSeconds();
   batch_timer.Stop();
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
 }
 
+template <typename Dtype>
+shared_ptr<const Datum> ImageDataLayer<Dtype>::ReadCachedImage(int line_id) {
+  const string filename = line_name(line_id);
+  shared_ptr<const Datum> cached = cache_->Lookup(filename);
+  if (cached) {
+    return cached;
+  }
+  const ImageDataParameter& image_data_param =
+      this->layer_param_.image_data_param();
+  cv::Mat cv_img = ReadImageToCVMat(
+      image_data_param.root_folder() + filename,
+      image_data_param.new_height(), image_data_param.new_width(),
+      image_data_param.is_color());
+  CHECK(cv_img.data) << "Could not load " << filename;
+  Datum* datum = new Datum();
+  CVMatToDatum(cv_img, datum);
+  cached.reset(datum);
+  cache_->Insert(filename, *datum);
+  return cached;
+}
+
 INSTANTIATE_CLASS(ImageDataLayer);
 REGISTER_LAYER_CLASS(ImageData);
 
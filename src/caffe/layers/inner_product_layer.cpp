@@ -86,9 +86,15 @@ void InnerProductLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
   const Dtype* weight = this->blobs_[0]->cpu_data();
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, transpose_ ? CblasNoTrans : CblasTrans,
-      M_, N_, K_, (Dtype)1.,
-      bottom_data, weight, (Dtype)0., top_data);
+  // Weights are only repacked once changed, or for another GEMM backend.
+  if (packed_weights_version_ != this->blobs_[0]->data_version() ||
+      packed_weights_.backend() != GemmBackend::Get()) {
+    packed_weights_.Pack(transpose_ ? CblasNoTrans : CblasTrans, K_, N_,
+        weight);
+    packed_weights_version_ = this->blobs_[0]->data_version();
+  }
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, M_, (Dtype)1., bottom_data,
+      packed_weights_, (Dtype)0., top_data);
   if (bias_term_) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, N_, 1, (Dtype)1.,
         bias_multiplier_.cpu_data(),
@@ -1,3 +1,4 @@
+#include <boost/bind.hpp>
 #include <vector>
 
 #include "caffe/layers/lrn_layer.hpp"
@@ -105,24 +106,16 @@ void LRNLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
 }
 
 template <typename Dtype>
-void LRNLayer<Dtype>::CrossChannelForward_cpu(
-    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  Dtype* top_data = top[0]->mutable_cpu_data();
-  Dtype* scale_data = scale_.mutable_cpu_data();
-  // start with the constant value
-  for (int i = 0; i < scale_.count(); ++i) {
-    scale_data[i] = k_;
-  }
+void LRNLayer<Dtype>::CrossChannelForwardImages(const Dtype* bottom_data,
+    Dtype* scale_data, int begin, int end) {
+  Dtype alpha_over_size = alpha_ / size_;
   Blob<Dtype> padded_square(1, channels_ + size_ - 1, height_, width_);
   Dtype* padded_square_data = padded_square.mutable_cpu_data();
   caffe_set(padded_square.count(), Dtype(0), padded_square_data);
-  Dtype alpha_over_size = alpha_ / size_;
-  // go through the images
-  for (int n = 0; n < num_; ++n) {
+  for (int n = begin; n < end; ++n) {
     // compute the padded square
     caffe_sqr(channels_ * height_ * width_,
-        bottom_data + bottom[0]->offset(n),
+        bottom_data + scale_.offset(n),
         padded_square_data + padded_square.offset(0, pre_pad_));
     // Create the first channel scale
     for (int c = 0; c < size_; ++c) {
@@ -145,6 +138,20 @@ void LRNLayer<Dtype>::CrossChannelForward_cpu(
           scale_data + scale_.offset(n, c));
     }
   }
+}
+
+template <typename Dtype>
+void LRNLayer<Dtype>::CrossChannelForward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  Dtype* scale_data = scale_.mutable_cpu_data();
+  // start with the constant value
+  caffe_set(scale_.count(), k_, scale_data);
+  // go through the images, split between the CPU threads
+  caffe_parallel_for(num_, 1, boost::bind(
+      &LRNLayer<Dtype>::CrossChannelForwardImages, this, bottom_data,
+      scale_data, _1, _2));
 
   // In the end, compute output
   caffe_powx<Dtype>(scale_.count(), scale_data, -beta_, top_data);
@@ -177,14 +184,11 @@ void LRNLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
 }
 
 template <typename Dtype>
-void LRNLayer<Dtype>::CrossChannelBackward_cpu(
-    const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
-    const vector<Blob<Dtype>*>& bottom) {
-  const Dtype* top_diff = top[0]->cpu_diff();
-  const Dtype* top_data = top[0]->cpu_data();
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  const Dtype* scale_data = scale_.cpu_data();
-  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+void LRNLayer<Dtype>::CrossChannelBackwardImages(const Dtype* top_diff,
+    const Dtype* top_data, const Dtype* bottom_data, const Dtype* scale_data,
+    Dtype* bottom_diff, int begin, int end) {
+  Dtype cache_ratio_value = 2. * alpha_ * beta_ / size_;
+  int inverse_pre_pad = size_ - (size_ + 1) / 2;
   Blob<Dtype> padded_ratio(1, channels_ + size_ - 1, height_, width_);
   Blob<Dtype> accum_ratio(1, 1, height_, width_);
   Dtype* padded_ratio_data = padded_ratio.mutable_cpu_data();
@@ -192,14 +196,7 @@ void LRNLayer<Dtype>::CrossChannelBackward_cpu(
   // We hack a little bit by using the diff() to store an additional result
   Dtype* accum_ratio_times_bottom = accum_ratio.mutable_cpu_diff();
   caffe_set(padded_ratio.count(), Dtype(0), padded_ratio_data);
-  Dtype cache_ratio_value = 2. * alpha_ * beta_ / size_;
-
-  caffe_powx<Dtype>(scale_.count(), scale_data, -beta_, bottom_diff);
-  caffe_mul<Dtype>(scale_.count(), top_diff, bottom_diff, bottom_diff);
-
-  // go through individual data
-  int inverse_pre_pad = size_ - (size_ + 1) / 2;
-  for (int n = 0; n < num_; ++n) {
+  for (int n = begin; n < end; ++n) {
     int block_offset = scale_.offset(n);
     // first, compute diff_i * y_i / s_i
     caffe_mul<Dtype>(channels_ * height_ * width_,
@@ -221,16 +218,35 @@ void LRNLayer<Dtype>::CrossChannelBackward_cpu(
           accum_ratio_data);
       // compute bottom diff
       caffe_mul<Dtype>(height_ * width_,
-          bottom_data + top[0]->offset(n, c),
+          bottom_data + scale_.offset(n, c),
           accum_ratio_data, accum_ratio_times_bottom);
       caffe_axpy<Dtype>(height_ * width_, -cache_ratio_value,
-          accum_ratio_times_bottom, bottom_diff + top[0]->offset(n, c));
+          accum_ratio_times_bottom, bottom_diff + scale_.offset(n, c));
       caffe_axpy<Dtype>(height_ * width_, -1.,
           padded_ratio_data + padded_ratio.offset(0, c), accum_ratio_data);
     }
   }
 }
 
+template <typename Dtype>
+void LRNLayer<Dtype>::CrossChannelBackward_cpu(
+    const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+    const vector<Blob<Dtype>*>& bottom) {
+  const Dtype* top_diff = top[0]->cpu_diff();
+  const Dtype* top_data = top[0]->cpu_data();
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  const Dtype* scale_data = scale_.cpu_data();
+  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+
+  caffe_powx<Dtype>(scale_.count(), scale_data, -beta_, bottom_diff);
+  caffe_mul<Dtype>(scale_.count(), top_diff, bottom_diff, bottom_diff);
+
+  // go through individual data, split between the CPU threads
+  caffe_parallel_for(num_, 1, boost::bind(
+      &LRNLayer<Dtype>::CrossChannelBackwardImages, this, top_diff, top_data,
+      bottom_data, scale_data, bottom_diff, _1, _2));
+}
+
 template <typename Dtype>
 void LRNLayer<Dtype>::WithinChannelBackward(
     const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
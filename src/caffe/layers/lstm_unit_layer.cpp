@@ -4,19 +4,11 @@
 
 #include "caffe/layer.hpp"
 #include "caffe/layers/lstm_layer.hpp"
+#include "caffe/util/fast_math.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
-template <typename Dtype>
-inline Dtype sigmoid(Dtype x) {
-  return 1. / (1. + exp(-x));
-}
-
-template <typename Dtype>
-inline Dtype tanh(Dtype x) {
-  return 2. * sigmoid(2. * x) - 1.;
-}
-
 template <typename Dtype>
 void LSTMUnitLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
@@ -48,21 +40,25 @@ void LSTMUnitLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   const Dtype* cont = bottom[2]->cpu_data();
   Dtype* C = top[0]->mutable_cpu_data();
   Dtype* H = top[1]->mutable_cpu_data();
+  // The gate activations are kept for Backward_cpu, as on the GPU.
+  Dtype* X_acts = X_acts_.mutable_cpu_data();
   for (int n = 0; n < num; ++n) {
+    caffe_sigmoid(3 * hidden_dim_, X, X_acts);
+    caffe_tanh(hidden_dim_, X + 3 * hidden_dim_, X_acts + 3 * hidden_dim_);
     for (int d = 0; d < hidden_dim_; ++d) {
-      const Dtype i = sigmoid(X[d]);
+      const Dtype i = X_acts[d];
       const Dtype f = (*cont == 0) ? 0 :
-          (*cont * sigmoid(X[1 * hidden_dim_ + d]));
-      const Dtype o = sigmoid(X[2 * hidden_dim_ + d]);
-      const Dtype g = tanh(X[3 * hidden_dim_ + d]);
+          (*cont * X_acts[1 * hidden_dim_ + d]);
+      const Dtype g = X_acts[3 * hidden_dim_ + d];
       const Dtype c_prev = C_prev[d];
       const Dtype c = f * c_prev + i * g;
       C[d] = c;
-      const Dtype tanh_c = tanh(c);
-      H[d] = o * tanh_c;
     }
+    caffe_tanh(hidden_dim_, C, H);
+    caffe_mul(hidden_dim_, X_acts + 2 * hidden_dim_, H, H);
     C_prev += hidden_dim_;
     X += x_dim;
+    X_acts += x_dim;
     C += hidden_dim_;
     H += hidden_dim_;
     ++cont;
@@ -78,24 +74,23 @@ void LSTMUnitLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   const int num = bottom[0]->shape(1);
   const int x_dim = hidden_dim_ * 4;
   const Dtype* C_prev = bottom[0]->cpu_data();
-  const Dtype* X = bottom[1]->cpu_data();
+  const Dtype* X_acts = X_acts_.cpu_data();
   const Dtype* cont = bottom[2]->cpu_data();
   const Dtype* C = top[0]->cpu_data();
-  const Dtype* H = top[1]->cpu_data();
   const Dtype* C_diff = top[0]->cpu_diff();
   const Dtype* H_diff = top[1]->cpu_diff();
   Dtype* C_prev_diff = bottom[0]->mutable_cpu_diff();
   Dtype* X_diff = bottom[1]->mutable_cpu_diff();
   for (int n = 0; n < num; ++n) {
     for (int d = 0; d < hidden_dim_; ++d) {
-      const Dtype i = sigmoid(X[d]);
+      const Dtype i = X_acts[d];
       const Dtype f = (*cont == 0) ? 0 :
-          (*cont * sigmoid(X[1 * hidden_dim_ + d]));
-      const Dtype o = sigmoid(X[2 * hidden_dim_ + d]);
-      const Dtype g = tanh(X[3 * hidden_dim_ + d]);
+          (*cont * X_acts[1 * hidden_dim_ + d]);
+      const Dtype o = X_acts[2 * hidden_dim_ + d];
+      const Dtype g = X_acts[3 * hidden_dim_ + d];
       const Dtype c_prev = C_prev[d];
       const Dtype c = C[d];
-      const Dtype tanh_c = tanh(c);
+      const Dtype tanh_c = fast_tanh(c);
       Dtype* c_prev_diff = C_prev_diff + d;
       Dtype* i_diff = X_diff + d;
       Dtype* f_diff = X_diff + 1 * hidden_dim_ + d;
@@ -110,9 +105,8 @@ void LSTMUnitLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       *g_diff = c_term_diff * i * (1 - g * g);
     }
     C_prev += hidden_dim_;
-    X += x_dim;
+    X_acts += x_dim;
     C += hidden_dim_;
-    H += hidden_dim_;
     C_diff += hidden_dim_;
     H_diff += hidden_dim_;
     X_diff += x_dim;
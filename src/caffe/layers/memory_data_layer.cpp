@@ -2,12 +2,26 @@
 #include <opencv2/core/core.hpp>
 #endif  // USE_OPENCV
 
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 #include <vector>
 
 #include "caffe/layers/memory_data_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
+template <typename Dtype>
+MemoryDataLayer<Dtype>::~MemoryDataLayer() {
+  this->StopInternalThread();
+  ReleaseCurrent();
+  Buffer* buffer;
+  while (queue_ && queue_->try_pop(&buffer)) {
+    buffer->release();
+    delete buffer;
+  }
+}
+
 template <typename Dtype>
 void MemoryDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
      const vector<Blob<Dtype>*>& top) {
@@ -26,6 +40,22 @@ void MemoryDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   added_label_.Reshape(label_shape);
   data_ = NULL;
   labels_ = NULL;
+  n_ = 0;
+  pos_ = 0;
+  const int queue_size = this->layer_param_.memory_data_param().queue_size();
+  queue_.reset(new LockFreeQueue<Buffer*>(queue_size));
+  staging_.resize(queue_size);
+  staging_free_.reset(new LockFreeQueue<int>(queue_size));
+  staging_full_.reset(new LockFreeQueue<int>(queue_size));
+  for (int i = 0; i < queue_size; ++i) {
+    staging_[i].reset(new Staging());
+    staging_free_->push(i);
+  }
+  // The staging thread transforms with its own transformer, as its batch
+  // state would be shared with AddDatumVector and AddMatVector otherwise.
+  staging_transformer_.reset(
+      new DataTransformer<Dtype>(this->transform_param_, this->phase_));
+  staging_transformer_->InitRand();
   added_data_.cpu_data();
   added_label_.cpu_data();
 }
@@ -89,12 +119,171 @@ void MemoryDataLayer<Dtype>::Reset(Dtype* data, Dtype* labels, int n) {
   if (this->layer_param_.has_transform_param()) {
     LOG(WARNING) << this->type() << " does not transform array data on Reset()";
   }
+  ReleaseCurrent();
+  DrainQueue();
   data_ = data;
   labels_ = labels;
   n_ = n;
   pos_ = 0;
 }
 
+template <typename Dtype>
+void MemoryDataLayer<Dtype>::DrainQueue() {
+  if (!queue_) {
+    return;
+  }
+  // Staged batches still on the staging thread are waited for, so that
+  // none of them reaches Forward after the reset.
+  for (;;) {
+    Buffer* buffer = NULL;
+    if (pending_ > 0) {
+      buffer = queue_->pop("Waiting for the staged batches to drain");
+    } else if (!queue_->try_pop(&buffer)) {
+      break;
+    }
+    if (buffer->staged) {
+      --pending_;
+    }
+    buffer->release();
+    delete buffer;
+  }
+}
+
+template <typename Dtype>
+void MemoryDataLayer<Dtype>::Enqueue(Dtype* data, Dtype* labels, int n,
+    const ReleaseCallback& release) {
+  CHECK(data);
+  CHECK(labels);
+  CHECK(queue_) << "MemoryDataLayer needs to be set up before Enqueue";
+  CHECK_GT(n, 0);
+  CHECK_EQ(n % batch_size_, 0) << "n must be a multiple of batch size";
+  Buffer* buffer = new Buffer();
+  buffer->data = data;
+  buffer->labels = labels;
+  buffer->n = n;
+  buffer->release = release;
+  buffer->staged = false;
+  queue_->push(buffer);
+}
+
+template <typename Dtype>
+void MemoryDataLayer<Dtype>::StageArrays(const Dtype* data,
+    const Dtype* labels, int n, bool copy_now) {
+  CHECK(data);
+  CHECK(labels);
+  Stage(n, boost::bind(&MemoryDataLayer<Dtype>::CopyArrays, this, data,
+      labels, _1), copy_now);
+}
+
+template <typename Dtype>
+void MemoryDataLayer<Dtype>::StageDatumVector(
+    const vector<Datum>& datum_vector) {
+  Stage(datum_vector.size(), boost::bind(
+      &MemoryDataLayer<Dtype>::TransformDatums, this, datum_vector, _1));
+}
+
+#ifdef USE_OPENCV
+template <typename Dtype>
+void MemoryDataLayer<Dtype>::StageMatVector(
+    const vector<cv::Mat>& mat_vector, const vector<int>& labels) {
+  CHECK_EQ(mat_vector.size(), labels.size());
+  // Copies of the Mats share their pixels.
+  Stage(mat_vector.size(), boost::bind(
+      &MemoryDataLayer<Dtype>::TransformMats, this, mat_vector, labels, _1));
+}
+#endif  // USE_OPENCV
+
+template <typename Dtype>
+void MemoryDataLayer<Dtype>::Stage(int n,
+    const boost::function<void(Staging*)>& fill, bool fill_now) {
+  CHECK(staging_free_) << "MemoryDataLayer needs to be set up before Stage";
+  CHECK_GT(n, 0) << "There is no data to stage.";
+  CHECK_EQ(n % batch_size_, 0) <<
+      "The staged data must be a multiple of the batch size.";
+  if (!this->is_started()) {
+    this->StartInternalThread();
+  }
+  const int id = staging_free_->pop("Waiting for a free staging buffer");
+  Staging* staging = staging_[id].get();
+  staging->data.Reshape(n, channels_, height_, width_);
+  staging->labels.Reshape(n, 1, 1, 1);
+  if (fill_now) {
+    fill(staging);
+  } else {
+    staging->fill = fill;
+  }
+  ++pending_;
+  staging_full_->push(id);
+}
+
+template <typename Dtype>
+void MemoryDataLayer<Dtype>::InternalThreadEntry() {
+  try {
+    while (!must_stop()) {
+      const int id = staging_full_->pop();
+      Staging* staging = staging_[id].get();
+      if (staging->fill) {
+        staging->fill(staging);
+        staging->fill.clear();
+      }
+      Buffer* buffer = new Buffer();
+      buffer->data = staging->data.mutable_cpu_data();
+      buffer->labels = staging->labels.mutable_cpu_data();
+      buffer->n = staging->data.num();
+      buffer->release = boost::bind(&MemoryDataLayer<Dtype>::ReleaseStaging,
+          this, id);
+      buffer->staged = true;
+      queue_->push(buffer);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
+template <typename Dtype>
+void MemoryDataLayer<Dtype>::ReleaseStaging(int id) {
+  staging_free_->push(id);
+}
+
+template <typename Dtype>
+void MemoryDataLayer<Dtype>::CopyArrays(const Dtype* data,
+    const Dtype* labels, Staging* staging) {
+  caffe_copy(staging->data.count(), data, staging->data.mutable_cpu_data());
+  caffe_copy(staging->labels.count(), labels,
+      staging->labels.mutable_cpu_data());
+}
+
+template <typename Dtype>
+void MemoryDataLayer<Dtype>::TransformDatums(
+    const vector<Datum>& datum_vector, Staging* staging) {
+  staging_transformer_->Transform(datum_vector, &staging->data);
+  Dtype* labels = staging->labels.mutable_cpu_data();
+  for (int item_id = 0; item_id < datum_vector.size(); ++item_id) {
+    labels[item_id] = datum_vector[item_id].label();
+  }
+}
+
+#ifdef USE_OPENCV
+template <typename Dtype>
+void MemoryDataLayer<Dtype>::TransformMats(const vector<cv::Mat>& mat_vector,
+    const vector<int>& labels, Staging* staging) {
+  staging_transformer_->Transform(mat_vector, &staging->data);
+  Dtype* top_label = staging->labels.mutable_cpu_data();
+  for (int item_id = 0; item_id < labels.size(); ++item_id) {
+    top_label[item_id] = labels[item_id];
+  }
+}
+#endif  // USE_OPENCV
+
+template <typename Dtype>
+void MemoryDataLayer<Dtype>::ReleaseCurrent() {
+  if (current_) {
+    current_->release();
+    delete current_;
+    current_ = NULL;
+  }
+}
+
 template <typename Dtype>
 void MemoryDataLayer<Dtype>::set_batch_size(int new_size) {
   CHECK(!has_new_data_) <<
@@ -107,6 +296,26 @@ void MemoryDataLayer<Dtype>::set_batch_size(int new_size) {
 template <typename Dtype>
 void MemoryDataLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  // At the end of a pass, move on to the next queued buffer. The previous
+  // one is only released now that the tops stop pointing to it.
+  if (pos_ == 0) {
+    Buffer* next = NULL;
+    if (current_ || pending_ > 0) {
+      next = queue_->pop("Waiting for MemoryDataLayer::Enqueue");
+    } else {
+      queue_->try_pop(&next);
+    }
+    if (next) {
+      if (next->staged) {
+        --pending_;
+      }
+      ReleaseCurrent();
+      current_ = next;
+      data_ = next->data;
+      labels_ = next->labels;
+      n_ = next->n;
+    }
+  }
   CHECK(data_) << "MemoryDataLayer needs to be initialized by calling Reset";
   top[0]->Reshape(batch_size_, channels_, height_, width_);
   top[1]->Reshape(batch_size_, 1, 1, 1);
@@ -1,3 +1,4 @@
+#include <boost/bind.hpp>
 #include <algorithm>
 #include <cfloat>
 #include <vector>
@@ -122,6 +123,130 @@ void PoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+// The (n, c) planes are pooled independently, so the passes are split
+// between the CPU threads over ranges of planes.
+template <typename Dtype>
+void PoolingLayer<Dtype>::ForwardMaxPlanes(const Dtype* bottom_data,
+    Dtype* top_data, Dtype* top_mask, int* mask, int begin, int end) {
+  const int bottom_plane_size = height_ * width_;
+  const int top_plane_size = pooled_height_ * pooled_width_;
+  const bool use_top_mask = top_mask != NULL;
+  for (int plane = begin; plane < end; ++plane) {
+    const Dtype* plane_bottom = bottom_data + plane * bottom_plane_size;
+    Dtype* plane_top = top_data + plane * top_plane_size;
+    Dtype* plane_top_mask = use_top_mask ?
+        top_mask + plane * top_plane_size : NULL;
+    int* plane_mask = use_top_mask ? NULL : mask + plane * top_plane_size;
+    for (int ph = 0; ph < pooled_height_; ++ph) {
+      for (int pw = 0; pw < pooled_width_; ++pw) {
+        int hstart = ph * stride_h_ - pad_h_;
+        int wstart = pw * stride_w_ - pad_w_;
+        int hend = min(hstart + kernel_h_, height_);
+        int wend = min(wstart + kernel_w_, width_);
+        hstart = max(hstart, 0);
+        wstart = max(wstart, 0);
+        const int pool_index = ph * pooled_width_ + pw;
+        for (int h = hstart; h < hend; ++h) {
+          for (int w = wstart; w < wend; ++w) {
+            const int index = h * width_ + w;
+            if (plane_bottom[index] > plane_top[pool_index]) {
+              plane_top[pool_index] = plane_bottom[index];
+              if (use_top_mask) {
+                plane_top_mask[pool_index] = static_cast<Dtype>(index);
+              } else {
+                plane_mask[pool_index] = index;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void PoolingLayer<Dtype>::ForwardAvePlanes(const Dtype* bottom_data,
+    Dtype* top_data, int begin, int end) {
+  const int bottom_plane_size = height_ * width_;
+  const int top_plane_size = pooled_height_ * pooled_width_;
+  for (int plane = begin; plane < end; ++plane) {
+    const Dtype* plane_bottom = bottom_data + plane * bottom_plane_size;
+    Dtype* plane_top = top_data + plane * top_plane_size;
+    for (int ph = 0; ph < pooled_height_; ++ph) {
+      for (int pw = 0; pw < pooled_width_; ++pw) {
+        int hstart = ph * stride_h_ - pad_h_;
+        int wstart = pw * stride_w_ - pad_w_;
+        int hend = min(hstart + kernel_h_, height_ + pad_h_);
+        int wend = min(wstart + kernel_w_, width_ + pad_w_);
+        int pool_size = (hend - hstart) * (wend - wstart);
+        hstart = max(hstart, 0);
+        wstart = max(wstart, 0);
+        hend = min(hend, height_);
+        wend = min(wend, width_);
+        for (int h = hstart; h < hend; ++h) {
+          for (int w = wstart; w < wend; ++w) {
+            plane_top[ph * pooled_width_ + pw] +=
+                plane_bottom[h * width_ + w];
+          }
+        }
+        plane_top[ph * pooled_width_ + pw] /= pool_size;
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void PoolingLayer<Dtype>::BackwardMaxPlanes(const Dtype* top_diff,
+    const Dtype* top_mask, const int* mask, Dtype* bottom_diff, int begin,
+    int end) {
+  const int bottom_plane_size = height_ * width_;
+  const int top_plane_size = pooled_height_ * pooled_width_;
+  const bool use_top_mask = top_mask != NULL;
+  for (int plane = begin; plane < end; ++plane) {
+    Dtype* plane_bottom_diff = bottom_diff + plane * bottom_plane_size;
+    const Dtype* plane_top_diff = top_diff + plane * top_plane_size;
+    const int offset = plane * top_plane_size;
+    for (int ph = 0; ph < pooled_height_; ++ph) {
+      for (int pw = 0; pw < pooled_width_; ++pw) {
+        const int index = ph * pooled_width_ + pw;
+        const int bottom_index = use_top_mask ?
+            top_mask[offset + index] : mask[offset + index];
+        plane_bottom_diff[bottom_index] += plane_top_diff[index];
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void PoolingLayer<Dtype>::BackwardAvePlanes(const Dtype* top_diff,
+    Dtype* bottom_diff, int begin, int end) {
+  const int bottom_plane_size = height_ * width_;
+  const int top_plane_size = pooled_height_ * pooled_width_;
+  for (int plane = begin; plane < end; ++plane) {
+    Dtype* plane_bottom_diff = bottom_diff + plane * bottom_plane_size;
+    const Dtype* plane_top_diff = top_diff + plane * top_plane_size;
+    for (int ph = 0; ph < pooled_height_; ++ph) {
+      for (int pw = 0; pw < pooled_width_; ++pw) {
+        int hstart = ph * stride_h_ - pad_h_;
+        int wstart = pw * stride_w_ - pad_w_;
+        int hend = min(hstart + kernel_h_, height_ + pad_h_);
+        int wend = min(wstart + kernel_w_, width_ + pad_w_);
+        int pool_size = (hend - hstart) * (wend - wstart);
+        hstart = max(hstart, 0);
+        wstart = max(wstart, 0);
+        hend = min(hend, height_);
+        wend = min(wend, width_);
+        for (int h = hstart; h < hend; ++h) {
+          for (int w = wstart; w < wend; ++w) {
+            plane_bottom_diff[h * width_ + w] +=
+              plane_top_diff[ph * pooled_width_ + pw] / pool_size;
+          }
+        }
+      }
+    }
+  }
+}
+
 // TODO(Yangqing): Is there a faster way to do pooling in the channel-first
 // case?
 template <typename Dtype>
@@ -134,6 +259,9 @@ void PoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   const bool use_top_mask = top.size() > 1;
   int* mask = NULL;  // suppress warnings about uninitalized variables
   Dtype* top_mask = NULL;
+  const int num_planes = bottom[0]->num() * channels_;
+  const int plane_grain = max(1, CAFFE_CPU_ARITHMETIC_GRAIN /
+      (bottom[0]->offset(0, 1) + top[0]->offset(0, 1)));
   // Different pooling methods. We explicitly do the switch outside the for
   // loop to save time, although this results in more code.
   switch (this->layer_param_.pooling_param().pool()) {
@@ -148,75 +276,16 @@ void PoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     }
     caffe_set(top_count, Dtype(-FLT_MAX), top_data);
     // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_);
-            int wend = min(wstart + kernel_w_, width_);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            const int pool_index = ph * pooled_width_ + pw;
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                const int index = h * width_ + w;
-                if (bottom_data[index] > top_data[pool_index]) {
-                  top_data[pool_index] = bottom_data[index];
-                  if (use_top_mask) {
-                    top_mask[pool_index] = static_cast<Dtype>(index);
-                  } else {
-                    mask[pool_index] = index;
-                  }
-                }
-              }
-            }
-          }
-        }
-        // compute offset
-        bottom_data += bottom[0]->offset(0, 1);
-        top_data += top[0]->offset(0, 1);
-        if (use_top_mask) {
-          top_mask += top[0]->offset(0, 1);
-        } else {
-          mask += top[0]->offset(0, 1);
-        }
-      }
-    }
+    caffe_parallel_for(num_planes, plane_grain, boost::bind(
+        &PoolingLayer<Dtype>::ForwardMaxPlanes, this, bottom_data, top_data,
+        top_mask, mask, _1, _2));
     break;
   case PoolingParameter_PoolMethod_AVE:
-    for (int i = 0; i < top_count; ++i) {
-      top_data[i] = 0;
-    }
+    caffe_set(top_count, Dtype(0), top_data);
     // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_ + pad_h_);
-            int wend = min(wstart + kernel_w_, width_ + pad_w_);
-            int pool_size = (hend - hstart) * (wend - wstart);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            hend = min(hend, height_);
-            wend = min(wend, width_);
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                top_data[ph * pooled_width_ + pw] +=
-                    bottom_data[h * width_ + w];
-              }
-            }
-            top_data[ph * pooled_width_ + pw] /= pool_size;
-          }
-        }
-        // compute offset
-        bottom_data += bottom[0]->offset(0, 1);
-        top_data += top[0]->offset(0, 1);
-      }
-    }
+    caffe_parallel_for(num_planes, plane_grain, boost::bind(
+        &PoolingLayer<Dtype>::ForwardAvePlanes, this, bottom_data, top_data,
+        _1, _2));
     break;
   case PoolingParameter_PoolMethod_STOCHASTIC:
     NOT_IMPLEMENTED;
@@ -241,6 +310,9 @@ void PoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   const bool use_top_mask = top.size() > 1;
   const int* mask = NULL;  // suppress warnings about uninitialized variables
   const Dtype* top_mask = NULL;
+  const int num_planes = top[0]->num() * channels_;
+  const int plane_grain = max(1, CAFFE_CPU_ARITHMETIC_GRAIN /
+      (bottom[0]->offset(0, 1) + top[0]->offset(0, 1)));
   switch (this->layer_param_.pooling_param().pool()) {
   case PoolingParameter_PoolMethod_MAX:
     // The main loop
@@ -249,54 +321,15 @@ void PoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     } else {
       mask = max_idx_.cpu_data();
     }
-    for (int n = 0; n < top[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            const int index = ph * pooled_width_ + pw;
-            const int bottom_index =
-                use_top_mask ? top_mask[index] : mask[index];
-            bottom_diff[bottom_index] += top_diff[index];
-          }
-        }
-        bottom_diff += bottom[0]->offset(0, 1);
-        top_diff += top[0]->offset(0, 1);
-        if (use_top_mask) {
-          top_mask += top[0]->offset(0, 1);
-        } else {
-          mask += top[0]->offset(0, 1);
-        }
-      }
-    }
+    caffe_parallel_for(num_planes, plane_grain, boost::bind(
+        &PoolingLayer<Dtype>::BackwardMaxPlanes, this, top_diff, top_mask,
+        mask, bottom_diff, _1, _2));
     break;
   case PoolingParameter_PoolMethod_AVE:
     // The main loop
-    for (int n = 0; n < top[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_ + pad_h_);
-            int wend = min(wstart + kernel_w_, width_ + pad_w_);
-            int pool_size = (hend - hstart) * (wend - wstart);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            hend = min(hend, height_);
-            wend = min(wend, width_);
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                bottom_diff[h * width_ + w] +=
-                  top_diff[ph * pooled_width_ + pw] / pool_size;
-              }
-            }
-          }
-        }
-        // offset
-        bottom_diff += bottom[0]->offset(0, 1);
-        top_diff += top[0]->offset(0, 1);
-      }
-    }
+    caffe_parallel_for(num_planes, plane_grain, boost::bind(
+        &PoolingLayer<Dtype>::BackwardAvePlanes, this, top_diff, bottom_diff,
+        _1, _2));
     break;
   case PoolingParameter_PoolMethod_STOCHASTIC:
     NOT_IMPLEMENTED;
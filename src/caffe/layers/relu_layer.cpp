@@ -1,3 +1,4 @@
+#include <boost/bind.hpp>
 #include <algorithm>
 #include <vector>
 
@@ -5,6 +6,26 @@
 
 namespace caffe {
 
+// The forward and backward passes over [begin, end).
+template <typename Dtype>
+static void relu_forward(const Dtype* bottom_data, Dtype negative_slope,
+    Dtype* top_data, const int begin, const int end) {
+  for (int i = begin; i < end; ++i) {
+    top_data[i] = std::max(bottom_data[i], Dtype(0))
+        + negative_slope * std::min(bottom_data[i], Dtype(0));
+  }
+}
+
+template <typename Dtype>
+static void relu_backward(const Dtype* bottom_data, const Dtype* top_diff,
+    Dtype negative_slope, Dtype* bottom_diff, const int begin,
+    const int end) {
+  for (int i = begin; i < end; ++i) {
+    bottom_diff[i] = top_diff[i] * ((bottom_data[i] > 0)
+        + negative_slope * (bottom_data[i] <= 0));
+  }
+}
+
 template <typename Dtype>
 void ReLULayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
@@ -12,10 +33,8 @@ void ReLULayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   Dtype* top_data = top[0]->mutable_cpu_data();
   const int count = bottom[0]->count();
   Dtype negative_slope = this->layer_param_.relu_param().negative_slope();
-  for (int i = 0; i < count; ++i) {
-    top_data[i] = std::max(bottom_data[i], Dtype(0))
-        + negative_slope * std::min(bottom_data[i], Dtype(0));
-  }
+  caffe_parallel_for(count, CAFFE_CPU_ARITHMETIC_GRAIN, boost::bind(
+      &relu_forward<Dtype>, bottom_data, negative_slope, top_data, _1, _2));
 }
 
 template <typename Dtype>
@@ -28,10 +47,9 @@ void ReLULayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
     const int count = bottom[0]->count();
     Dtype negative_slope = this->layer_param_.relu_param().negative_slope();
-    for (int i = 0; i < count; ++i) {
-      bottom_diff[i] = top_diff[i] * ((bottom_data[i] > 0)
-          + negative_slope * (bottom_data[i] <= 0));
-    }
+    caffe_parallel_for(count, CAFFE_CPU_ARITHMETIC_GRAIN, boost::bind(
+        &relu_backward<Dtype>, bottom_data, top_diff, negative_slope,
+        bottom_diff, _1, _2));
   }
 }
 
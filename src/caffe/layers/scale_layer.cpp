@@ -127,18 +127,12 @@ void ScaleLayer<Dtype>::Forward_cpu(
   }
   const Dtype* scale_data =
       ((bottom.size() > 1) ? bottom[1] : this->blobs_[0].get())->cpu_data();
-  Dtype* top_data = top[0]->mutable_cpu_data();
-  for (int n = 0; n < outer_dim_; ++n) {
-    for (int d = 0; d < scale_dim_; ++d) {
-      const Dtype factor = scale_data[d];
-      caffe_cpu_scale(inner_dim_, factor, bottom_data, top_data);
-      bottom_data += inner_dim_;
-      top_data += inner_dim_;
-    }
-  }
-  if (bias_layer_) {
-    bias_layer_->Forward(bias_bottom_vec_, top);
-  }
+  // The bias, which has the shape of the scale, is added in the same pass
+  // rather than by bias_layer_.
+  const Dtype* bias_data = bias_layer_ ?
+      this->blobs_[bias_param_id_]->cpu_data() : NULL;
+  caffe_cpu_scale_shift(outer_dim_, scale_dim_, inner_dim_, scale_data,
+      bias_data, bottom_data, top[0]->mutable_cpu_data());
 }
 
 template <typename Dtype>
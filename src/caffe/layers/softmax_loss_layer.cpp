@@ -53,6 +53,9 @@ void SoftmaxWithLossLayer<Dtype>::Reshape(
     // softmax output
     top[1]->ReshapeLike(*bottom[0]);
   }
+  vector<int> log_sum_shape = bottom[0]->shape();
+  log_sum_shape[softmax_axis_] = 1;
+  log_sum_.Reshape(log_sum_shape);
 }
 
 template <typename Dtype>
@@ -88,9 +91,13 @@ Dtype SoftmaxWithLossLayer<Dtype>::get_normalizer(
 template <typename Dtype>
 void SoftmaxWithLossLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  // The forward pass computes the softmax prob values.
-  softmax_layer_->Forward(softmax_bottom_vec_, softmax_top_vec_);
-  const Dtype* prob_data = prob_.cpu_data();
+  // The forward pass computes the softmax prob values, and the log-softmax
+  // of the labels as x - log_sum, which does not lose the small
+  // probabilities to rounding.
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  caffe_cpu_softmax(outer_num_, bottom[0]->shape(softmax_axis_), inner_num_,
+      bottom_data, prob_.mutable_cpu_data(), log_sum_.mutable_cpu_data());
+  const Dtype* log_sum = log_sum_.cpu_data();
   const Dtype* label = bottom[1]->cpu_data();
   int dim = prob_.count() / outer_num_;
   int count = 0;
@@ -103,8 +110,10 @@ void SoftmaxWithLossLayer<Dtype>::Forward_cpu(
       }
       DCHECK_GE(label_value, 0);
       DCHECK_LT(label_value, prob_.shape(softmax_axis_));
-      loss -= log(std::max(prob_data[i * dim + label_value * inner_num_ + j],
-                           Dtype(FLT_MIN)));
+      // Clipped at log(FLT_MIN), as the loss of the GPU path.
+      const Dtype log_prob = bottom_data[i * dim + label_value * inner_num_ + j]
+          - log_sum[i * inner_num_ + j];
+      loss -= std::max(log_prob, Dtype(log(FLT_MIN)));
       ++count;
     }
   }
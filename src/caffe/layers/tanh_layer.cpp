@@ -1,9 +1,11 @@
 // TanH neuron activation function layer.
 // Adapted from ReLU layer code written by Yangqing Jia
 
+#include <boost/bind.hpp>
 #include <vector>
 
 #include "caffe/layers/tanh_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
@@ -13,8 +15,16 @@ void TanHLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
   const int count = bottom[0]->count();
-  for (int i = 0; i < count; ++i) {
-    top_data[i] = tanh(bottom_data[i]);
+  caffe_tanh(count, bottom_data, top_data);
+}
+
+// The backward pass over [begin, end).
+template <typename Dtype>
+static void tanh_backward(const Dtype* top_data, const Dtype* top_diff,
+    Dtype* bottom_diff, const int begin, const int end) {
+  for (int i = begin; i < end; ++i) {
+    const Dtype tanhx = top_data[i];
+    bottom_diff[i] = top_diff[i] * (1 - tanhx * tanhx);
   }
 }
 
@@ -27,11 +37,8 @@ void TanHLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const Dtype* top_diff = top[0]->cpu_diff();
     Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
     const int count = bottom[0]->count();
-    Dtype tanhx;
-    for (int i = 0; i < count; ++i) {
-      tanhx = top_data[i];
-      bottom_diff[i] = top_diff[i] * (1 - tanhx * tanhx);
-    }
+    caffe_parallel_for(count, CAFFE_CPU_ARITHMETIC_GRAIN, boost::bind(
+        &tanh_backward<Dtype>, top_data, top_diff, bottom_diff, _1, _2));
   }
 }
 
@@ -1,3 +1,4 @@
+#include <boost/bind.hpp>
 #include <vector>
 
 #include "caffe/layers/threshold_layer.hpp"
@@ -11,15 +12,23 @@ void ThresholdLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   threshold_ = this->layer_param_.threshold_param().threshold();
 }
 
+// The forward pass over [begin, end).
+template <typename Dtype>
+static void threshold_forward(const Dtype* bottom_data, Dtype threshold,
+    Dtype* top_data, const int begin, const int end) {
+  for (int i = begin; i < end; ++i) {
+    top_data[i] = (bottom_data[i] > threshold) ? Dtype(1) : Dtype(0);
+  }
+}
+
 template <typename Dtype>
 void ThresholdLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
   const int count = bottom[0]->count();
-  for (int i = 0; i < count; ++i) {
-    top_data[i] = (bottom_data[i] > threshold_) ? Dtype(1) : Dtype(0);
-  }
+  caffe_parallel_for(count, CAFFE_CPU_ARITHMETIC_GRAIN, boost::bind(
+      &threshold_forward<Dtype>, bottom_data, threshold_, top_data, _1, _2));
 }
 
 #ifdef CPU_ONLY
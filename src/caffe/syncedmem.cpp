@@ -1,3 +1,5 @@
+#include <boost/atomic.hpp>
+
 #include "caffe/common.hpp"
 #include "caffe/syncedmem.hpp"
 #include "caffe/util/math_functions.hpp"
@@ -22,6 +24,11 @@ SyncedMemory::~SyncedMemory() {
 #endif  // CPU_ONLY
 }
 
+uint64_t SyncedMemory::NextVersion() {
+  static boost::atomic<uint64_t> last_version(0);
+  return ++last_version;
+}
+
 inline void SyncedMemory::to_cpu() {
   switch (head_) {
   case UNINITIALIZED:
@@ -89,6 +96,7 @@ void SyncedMemory::set_cpu_data(void* data) {
   cpu_ptr_ = data;
   head_ = HEAD_AT_CPU;
   own_cpu_data_ = false;
+  version_ = NextVersion();
 }
 
 const void* SyncedMemory::gpu_data() {
@@ -116,6 +124,7 @@ void SyncedMemory::set_gpu_data(void* data) {
   gpu_ptr_ = data;
   head_ = HEAD_AT_GPU;
   own_gpu_data_ = false;
+  version_ = NextVersion();
 #else
   NO_GPU;
 #endif
@@ -124,6 +133,7 @@ void SyncedMemory::set_gpu_data(void* data) {
 void* SyncedMemory::mutable_cpu_data() {
   to_cpu();
   head_ = HEAD_AT_CPU;
+  version_ = NextVersion();
   return cpu_ptr_;
 }
 
@@ -131,6 +141,7 @@ void* SyncedMemory::mutable_gpu_data() {
 #ifndef CPU_ONLY
   to_gpu();
   head_ = HEAD_AT_GPU;
+  version_ = NextVersion();
   return gpu_ptr_;
 #else
   NO_GPU;
@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <cmath>
 #include <cstring>
 #include <vector>
 
@@ -120,6 +121,40 @@ namespace caffe {
     }
   }
 
+  TYPED_TEST(BatchNormLayerTest, TestForwardBackwardGlobalStats) {
+    typedef typename TypeParam::Dtype Dtype;
+    LayerParameter layer_param;
+    layer_param.mutable_batch_norm_param()->set_use_global_stats(true);
+    layer_param.mutable_batch_norm_param()->set_eps(0.01);
+
+    BatchNormLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    const int channels = this->blob_bottom_->channels();
+    // The stored statistics are sums weighted by blobs()[2].
+    for (int pass = 0; pass < 2; ++pass) {
+      const Dtype factor = pass + 2;
+      for (int j = 0; j < channels; ++j) {
+        layer.blobs()[0]->mutable_cpu_data()[j] = factor * (j + pass - 0.5);
+        layer.blobs()[1]->mutable_cpu_data()[j] = factor * (j + pass + 0.5);
+      }
+      layer.blobs()[2]->mutable_cpu_data()[0] = factor;
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      caffe_set(this->blob_top_->count(), Dtype(1),
+          this->blob_top_->mutable_cpu_diff());
+      vector<bool> propagate_down(1, true);
+      layer.Backward(this->blob_top_vec_, propagate_down,
+          this->blob_bottom_vec_);
+      for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+        const int j = (i / this->blob_bottom_->count(2)) % channels;
+        const Dtype stddev = sqrt(j + pass + 0.5 + 0.01);
+        const Dtype expected =
+            (this->blob_bottom_->cpu_data()[i] - (j + pass - 0.5)) / stddev;
+        EXPECT_NEAR(expected, this->blob_top_->cpu_data()[i], 1e-5);
+        EXPECT_NEAR(1 / stddev, this->blob_bottom_->cpu_diff()[i], 1e-5);
+      }
+    }
+  }
+
   TYPED_TEST(BatchNormLayerTest, TestGradient) {
     typedef typename TypeParam::Dtype Dtype;
     LayerParameter layer_param;
@@ -1,6 +1,11 @@
+#include <boost/bind.hpp>
+#include <vector>
+
 #include "gtest/gtest.h"
 
+#include "caffe/blob.hpp"
 #include "caffe/common.hpp"
+#include "caffe/filler.hpp"
 #include "caffe/syncedmem.hpp"
 #include "caffe/util/math_functions.hpp"
 
@@ -27,6 +32,35 @@ TEST_F(CommonTest, TestBrewMode) {
   EXPECT_EQ(Caffe::mode(), Caffe::GPU);
 }
 
+static void ExpRange(int begin, int end, const Blob<float>* in,
+    Blob<float>* out) {
+  // Nested calls run on the calling thread.
+  caffe_exp(end - begin, in->cpu_data() + begin,
+      out->mutable_cpu_data() + begin);
+}
+
+TEST_F(CommonTest, TestParallelFor) {
+  Blob<float> in(1, 1, 1, 100003), expected(in.shape()), actual(in.shape());
+  FillerParameter filler_param;
+  GaussianFiller<float> filler(filler_param);
+  filler.Fill(&in);
+  caffe_exp(in.count(), in.cpu_data(), expected.mutable_cpu_data());
+  Caffe::set_cpu_threads(4);
+  EXPECT_EQ(4, Caffe::cpu_threads());
+  // The threads compute the same values as a single one.
+  caffe_exp(in.count(), in.cpu_data(), actual.mutable_cpu_data());
+  for (int i = 0; i < in.count(); ++i) {
+    ASSERT_EQ(expected.cpu_data()[i], actual.cpu_data()[i]);
+  }
+  caffe_set(actual.count(), 0.f, actual.mutable_cpu_data());
+  caffe_parallel_for(in.count(), 1000,
+      boost::bind(&ExpRange, _1, _2, &in, &actual));
+  for (int i = 0; i < in.count(); ++i) {
+    ASSERT_EQ(expected.cpu_data()[i], actual.cpu_data()[i]);
+  }
+  Caffe::set_cpu_threads(1);
+}
+
 TEST_F(CommonTest, TestRandSeedCPU) {
   SyncedMemory data_a(10 * sizeof(int));
   SyncedMemory data_b(10 * sizeof(int));
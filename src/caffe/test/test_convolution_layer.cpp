@@ -6,6 +6,7 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/util/gemm.hpp"
 
 #ifdef USE_CUDNN
 #include "caffe/layers/cudnn_conv_layer.hpp"
@@ -706,6 +707,308 @@ TYPED_TEST(ConvolutionLayerTest, TestNDAgainst2D) {
   }
 }
 
+TYPED_TEST(ConvolutionLayerTest, TestNHWCAgainstNCHW) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) {
+    return;  // NHWC bottoms are CPU only.
+  }
+  const int num = this->blob_bottom_->num();
+  const int channels = this->blob_bottom_->channels();
+  const int height = this->blob_bottom_->height();
+  const int width = this->blob_bottom_->width();
+  // Transpose the NCHW bottom into an NHWC one.
+  vector<int> nhwc_shape(4);
+  nhwc_shape[0] = num;
+  nhwc_shape[1] = height;
+  nhwc_shape[2] = width;
+  nhwc_shape[3] = channels;
+  Blob<Dtype> bottom_nhwc(nhwc_shape);
+  for (int n = 0; n < num; ++n) {
+    for (int c = 0; c < channels; ++c) {
+      for (int h = 0; h < height; ++h) {
+        for (int w = 0; w < width; ++w) {
+          bottom_nhwc.mutable_cpu_data()[bottom_nhwc.offset(n, h, w, c)] =
+              this->blob_bottom_->data_at(n, c, h, w);
+        }
+      }
+    }
+  }
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(4);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ConvolutionLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  convolution_param->set_bottom_layout(ConvolutionParameter_Layout_NHWC);
+  ConvolutionLayer<Dtype> layer_nhwc(layer_param);
+  vector<Blob<Dtype>*> bottom_nhwc_vec(1, &bottom_nhwc);
+  vector<Blob<Dtype>*> top_nhwc_vec(1, this->blob_top_2_);
+  layer_nhwc.SetUp(bottom_nhwc_vec, top_nhwc_vec);
+  ASSERT_EQ(this->blob_top_->shape(), this->blob_top_2_->shape());
+  ASSERT_EQ(2, layer_nhwc.blobs().size());
+  for (int i = 0; i < layer.blobs().size(); ++i) {
+    layer_nhwc.blobs()[i]->CopyFrom(*layer.blobs()[i]);
+  }
+  // Forward: both tops are NCHW.
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer_nhwc.Forward(bottom_nhwc_vec, top_nhwc_vec);
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(this->blob_top_->cpu_data()[i],
+                this->blob_top_2_->cpu_data()[i], 1e-4);
+  }
+  // Backward: the bottom diffs are transposes of each other.
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_top_2_);
+  caffe_copy(this->blob_top_2_->count(), this->blob_top_2_->cpu_data(),
+             this->blob_top_->mutable_cpu_diff());
+  caffe_copy(this->blob_top_2_->count(), this->blob_top_2_->cpu_data(),
+             this->blob_top_2_->mutable_cpu_diff());
+  vector<bool> propagate_down(1, true);
+  layer.Backward(this->blob_top_vec_, propagate_down, this->blob_bottom_vec_);
+  layer_nhwc.Backward(top_nhwc_vec, propagate_down, bottom_nhwc_vec);
+  for (int n = 0; n < num; ++n) {
+    for (int c = 0; c < channels; ++c) {
+      for (int h = 0; h < height; ++h) {
+        for (int w = 0; w < width; ++w) {
+          EXPECT_NEAR(this->blob_bottom_->diff_at(n, c, h, w),
+                      bottom_nhwc.diff_at(n, h, w, c), 1e-4);
+        }
+      }
+    }
+  }
+  for (int i = 0; i < layer.blobs().size(); ++i) {
+    const Blob<Dtype>& param = *layer.blobs()[i];
+    const Blob<Dtype>& param_nhwc = *layer_nhwc.blobs()[i];
+    for (int j = 0; j < param.count(); ++j) {
+      EXPECT_NEAR(param.cpu_diff()[j], param_nhwc.cpu_diff()[j], 1e-4);
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestMultiThreadedAgainstSingle) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) {
+    return;  // The threads only split the CPU implementation.
+  }
+  // Five images do not split evenly between three threads.
+  vector<int> bottom_shape = this->blob_bottom_->shape();
+  bottom_shape[0] = 5;
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  this->blob_bottom_vec_.push_back(this->blob_bottom_2_);
+  this->blob_top_vec_.push_back(this->blob_top_2_);
+  for (int i = 0; i < this->blob_bottom_vec_.size(); ++i) {
+    this->blob_bottom_vec_[i]->Reshape(bottom_shape);
+    filler.Fill(this->blob_bottom_vec_[i]);
+  }
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(4);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ConvolutionLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  convolution_param->set_num_threads(3);
+  ConvolutionLayer<Dtype> threaded_layer(layer_param);
+  Blob<Dtype> threaded_top, threaded_top_2;
+  vector<Blob<Dtype>*> threaded_top_vec;
+  threaded_top_vec.push_back(&threaded_top);
+  threaded_top_vec.push_back(&threaded_top_2);
+  threaded_layer.SetUp(this->blob_bottom_vec_, threaded_top_vec);
+  for (int i = 0; i < layer.blobs().size(); ++i) {
+    threaded_layer.blobs()[i]->CopyFrom(*layer.blobs()[i]);
+  }
+  // Forward.
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  threaded_layer.Forward(this->blob_bottom_vec_, threaded_top_vec);
+  for (int i = 0; i < this->blob_top_vec_.size(); ++i) {
+    for (int j = 0; j < this->blob_top_vec_[i]->count(); ++j) {
+      EXPECT_NEAR(this->blob_top_vec_[i]->cpu_data()[j],
+                  threaded_top_vec[i]->cpu_data()[j], 1e-4);
+    }
+  }
+  // Backward, with the parameter gradients of both bottoms accumulated.
+  vector<shared_ptr<Blob<Dtype> > > bottom_diffs;
+  for (int i = 0; i < this->blob_top_vec_.size(); ++i) {
+    filler.Fill(threaded_top_vec[i]);
+    caffe_copy(threaded_top_vec[i]->count(), threaded_top_vec[i]->cpu_data(),
+               this->blob_top_vec_[i]->mutable_cpu_diff());
+    caffe_copy(threaded_top_vec[i]->count(), threaded_top_vec[i]->cpu_data(),
+               threaded_top_vec[i]->mutable_cpu_diff());
+  }
+  vector<bool> propagate_down(this->blob_bottom_vec_.size(), true);
+  layer.Backward(this->blob_top_vec_, propagate_down, this->blob_bottom_vec_);
+  for (int i = 0; i < this->blob_bottom_vec_.size(); ++i) {
+    bottom_diffs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    bottom_diffs[i]->CopyFrom(*this->blob_bottom_vec_[i], true, true);
+  }
+  threaded_layer.Backward(threaded_top_vec, propagate_down,
+                          this->blob_bottom_vec_);
+  for (int i = 0; i < this->blob_bottom_vec_.size(); ++i) {
+    for (int j = 0; j < bottom_diffs[i]->count(); ++j) {
+      EXPECT_NEAR(bottom_diffs[i]->cpu_diff()[j],
+                  this->blob_bottom_vec_[i]->cpu_diff()[j], 1e-4);
+    }
+  }
+  for (int i = 0; i < layer.blobs().size(); ++i) {
+    const Blob<Dtype>& param = *layer.blobs()[i];
+    const Blob<Dtype>& threaded_param = *threaded_layer.blobs()[i];
+    for (int j = 0; j < param.count(); ++j) {
+      EXPECT_NEAR(param.cpu_diff()[j], threaded_param.cpu_diff()[j], 1e-4);
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestDirectAgainstIm2col) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) {
+    return;  // The DIRECT engine only differs on CPU.
+  }
+  vector<int> bottom_shape(4);
+  bottom_shape[0] = 2;
+  bottom_shape[1] = 4;
+  bottom_shape[2] = 11;
+  bottom_shape[3] = 23;  // Wide enough for whole tiles and edges.
+  this->blob_bottom_->Reshape(bottom_shape);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  // kernel size, stride, pad and group; 3x3 with dilation is not supported
+  // and falls back to im2col.
+  const int kConfigs[][5] = {{3, 1, 1, 1, 1}, {3, 2, 0, 2, 1},
+      {5, 1, 2, 1, 1}, {5, 2, 1, 2, 1}, {7, 1, 3, 1, 1}, {7, 2, 2, 1, 1},
+      {3, 1, 1, 1, 2}};
+  const int num_configs = sizeof(kConfigs) / sizeof(kConfigs[0]);
+  for (int i = 0; i < num_configs; ++i) {
+    LayerParameter layer_param;
+    ConvolutionParameter* convolution_param =
+        layer_param.mutable_convolution_param();
+    convolution_param->add_kernel_size(kConfigs[i][0]);
+    convolution_param->add_stride(kConfigs[i][1]);
+    convolution_param->add_pad(kConfigs[i][2]);
+    convolution_param->set_group(kConfigs[i][3]);
+    convolution_param->add_dilation(kConfigs[i][4]);
+    // Not a multiple of the output channels computed together.
+    convolution_param->set_num_output(6);
+    convolution_param->mutable_weight_filler()->set_type("gaussian");
+    convolution_param->mutable_bias_filler()->set_type("gaussian");
+    ConvolutionLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    convolution_param->set_engine(ConvolutionParameter_Engine_DIRECT);
+    layer_param.set_phase(TEST);  // The engine only applies to inference.
+    ConvolutionLayer<Dtype> direct_layer(layer_param);
+    vector<Blob<Dtype>*> direct_top_vec(1, this->blob_top_2_);
+    direct_layer.SetUp(this->blob_bottom_vec_, direct_top_vec);
+    for (int j = 0; j < layer.blobs().size(); ++j) {
+      direct_layer.blobs()[j]->CopyFrom(*layer.blobs()[j]);
+    }
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    direct_layer.Forward(this->blob_bottom_vec_, direct_top_vec);
+    ASSERT_EQ(this->blob_top_->shape(), this->blob_top_2_->shape());
+    for (int j = 0; j < this->blob_top_->count(); ++j) {
+      EXPECT_NEAR(this->blob_top_->cpu_data()[j],
+                  this->blob_top_2_->cpu_data()[j], 1e-4) << "config " << i;
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestWinogradAgainstIm2col) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) {
+    return;  // The WINOGRAD engine only differs on CPU.
+  }
+  vector<int> bottom_shape(4);
+  bottom_shape[0] = 2;
+  bottom_shape[1] = 4;
+  bottom_shape[2] = 11;  // Not a multiple of the tiles.
+  bottom_shape[3] = 9;
+  this->blob_bottom_->Reshape(bottom_shape);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  // tile, pad and group
+  const int kConfigs[][3] = {{2, 1, 1}, {2, 0, 2}, {4, 1, 1}, {4, 0, 2},
+      {4, 2, 1}};
+  const int num_configs = sizeof(kConfigs) / sizeof(kConfigs[0]);
+  for (int i = 0; i < num_configs; ++i) {
+    LayerParameter layer_param;
+    ConvolutionParameter* convolution_param =
+        layer_param.mutable_convolution_param();
+    convolution_param->add_kernel_size(3);
+    convolution_param->add_pad(kConfigs[i][1]);
+    convolution_param->set_group(kConfigs[i][2]);
+    convolution_param->set_num_output(6);
+    convolution_param->mutable_weight_filler()->set_type("gaussian");
+    convolution_param->mutable_bias_filler()->set_type("gaussian");
+    ConvolutionLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    convolution_param->set_engine(ConvolutionParameter_Engine_WINOGRAD);
+    convolution_param->set_winograd_tile(kConfigs[i][0]);
+    ConvolutionLayer<Dtype> winograd_layer(layer_param);
+    vector<Blob<Dtype>*> winograd_top_vec(1, this->blob_top_2_);
+    winograd_layer.SetUp(this->blob_bottom_vec_, winograd_top_vec);
+    // Run twice, changing the weights in between: the transformed weights
+    // must follow.
+    for (int run = 0; run < 2; ++run) {
+      if (run > 0) {
+        filler.Fill(layer.blobs()[0].get());
+      }
+      for (int j = 0; j < layer.blobs().size(); ++j) {
+        winograd_layer.blobs()[j]->CopyFrom(*layer.blobs()[j]);
+      }
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      winograd_layer.Forward(this->blob_bottom_vec_, winograd_top_vec);
+      ASSERT_EQ(this->blob_top_->shape(), this->blob_top_2_->shape());
+      for (int j = 0; j < this->blob_top_->count(); ++j) {
+        EXPECT_NEAR(this->blob_top_->cpu_data()[j],
+            this->blob_top_2_->cpu_data()[j], 1e-4)
+            << "config " << i << " run " << run;
+      }
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestPackedWeights) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) {
+    return;
+  }
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->set_group(3);
+  convolution_param->set_num_output(6);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ConvolutionLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // The weights packed by the first pass must follow the new ones.
+  GemmBackend::Set("caffe");
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(layer.blobs()[0].get());
+  vector<Blob<Dtype>*> packed_top_vec(1, this->blob_top_2_);
+  layer.Forward(this->blob_bottom_vec_, packed_top_vec);
+  GemmBackend::Set("blas");
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(this->blob_top_->cpu_data()[i],
+        this->blob_top_2_->cpu_data()[i], 1e-4);
+  }
+}
+
 TYPED_TEST(ConvolutionLayerTest, TestGradient) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -724,6 +1027,25 @@ TYPED_TEST(ConvolutionLayerTest, TestGradient) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(ConvolutionLayerTest, TestGradientMultiThreaded) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  this->blob_bottom_vec_.push_back(this->blob_bottom_2_);
+  this->blob_top_vec_.push_back(this->blob_top_2_);
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->set_num_output(2);
+  convolution_param->set_num_threads(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ConvolutionLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
 TYPED_TEST(ConvolutionLayerTest, TestDilatedGradient) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -67,7 +67,7 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     db->Close();
   }
 
-  void TestRead() {
+  void TestRead(uint64_t cache_bytes = 0) {
     const Dtype scale = 3;
     LayerParameter param;
     param.set_phase(TRAIN);
@@ -75,6 +75,7 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     data_param->set_batch_size(5);
     data_param->set_source(filename_->c_str());
     data_param->set_backend(backend_);
+    data_param->set_cache_bytes(cache_bytes);
 
     TransformationParameter* transform_param =
         param.mutable_transform_param();
@@ -105,6 +106,74 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     }
   }
 
+  // Every batch covers the whole db, so it holds each record once, in an
+  // order that changes across epochs.
+  void TestReadShuffled(int read_threads) {
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(5);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    data_param->set_shuffle(true);
+    data_param->set_read_threads(read_threads);
+
+    DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    int num_in_order = 0;
+    const int num_iter = 20;
+    for (int iter = 0; iter < num_iter; ++iter) {
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+      vector<int> seen(5, 0);
+      bool in_order = true;
+      for (int i = 0; i < 5; ++i) {
+        const int label = blob_top_label_->cpu_data()[i];
+        ASSERT_GE(label, 0);
+        ASSERT_LT(label, 5);
+        ++seen[label];
+        in_order &= label == i;
+        for (int j = 0; j < 24; ++j) {
+          EXPECT_EQ(label, blob_top_data_->cpu_data()[i * 24 + j])
+              << "debug: iter " << iter << " i " << i << " j " << j;
+        }
+      }
+      EXPECT_EQ(vector<int>(5, 1), seen);
+      num_in_order += in_order;
+    }
+    EXPECT_LT(num_in_order, num_iter);
+  }
+
+  // Shard 1 of 2 holds records 1 and 3.
+  void TestReadShard(bool shuffle) {
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(4);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    data_param->set_shuffle(shuffle);
+    data_param->set_shard_id(1);
+    data_param->set_num_shards(2);
+
+    DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    for (int iter = 0; iter < 10; ++iter) {
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+      for (int i = 0; i < 4; i += 2) {
+        const int first = blob_top_label_->cpu_data()[i];
+        const int second = blob_top_label_->cpu_data()[i + 1];
+        if (shuffle) {
+          // Each epoch of the shard is a permutation of 1 and 3.
+          EXPECT_EQ(4, first + second);
+          EXPECT_NE(first, second);
+        } else {
+          EXPECT_EQ(1, first);
+          EXPECT_EQ(3, second);
+        }
+      }
+    }
+  }
+
   void TestReshape(DataParameter_DB backend) {
     const int num_inputs = 5;
     // Save data of varying shapes.
@@ -356,6 +425,28 @@ TYPED_TEST(DataLayerTest, TestReadLevelDB) {
   this->TestRead();
 }
 
+// Later epochs are served from the cache; 100 bytes only fit two samples.
+TYPED_TEST(DataLayerTest, TestReadCachedLevelDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  this->TestRead(1 << 20);
+  this->TestRead(100);
+}
+
+TYPED_TEST(DataLayerTest, TestReadShuffledLevelDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  this->TestReadShuffled(1);
+  this->TestReadShuffled(3);
+}
+
+TYPED_TEST(DataLayerTest, TestReadShardLevelDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  this->TestReadShard(false);
+  this->TestReadShard(true);
+}
+
 TYPED_TEST(DataLayerTest, TestReshapeLevelDB) {
   this->TestReshape(DataParameter_DB_LEVELDB);
 }
@@ -396,6 +487,28 @@ TYPED_TEST(DataLayerTest, TestReadLMDB) {
   this->TestRead();
 }
 
+// Later epochs are served from the cache; 100 bytes only fit two samples.
+TYPED_TEST(DataLayerTest, TestReadCachedLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->TestRead(1 << 20);
+  this->TestRead(100);
+}
+
+TYPED_TEST(DataLayerTest, TestReadShuffledLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->TestReadShuffled(1);
+  this->TestReadShuffled(3);
+}
+
+TYPED_TEST(DataLayerTest, TestReadShardLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->TestReadShard(false);
+  this->TestReadShard(true);
+}
+
 TYPED_TEST(DataLayerTest, TestReshapeLMDB) {
   this->TestReshape(DataParameter_DB_LMDB);
 }
@@ -1,4 +1,7 @@
 #ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
 #include <string>
 #include <vector>
 
@@ -10,6 +13,7 @@
 #include "caffe/filler.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/io.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -340,5 +344,127 @@ TYPED_TEST(DataTransformTest, TestMeanFile) {
   }
 }
 
+TYPED_TEST(DataTransformTest, TestTransformBatchMatchesSequential) {
+  TransformationParameter transform_param;
+  const bool unique_pixels = true;  // pixels are consecutive ints [0,size]
+  const int channels = 3;
+  const int height = 6;
+  const int width = 7;
+  const int crop_size = 4;
+  const int batch_size = 5;
+
+  transform_param.set_crop_size(crop_size);
+  transform_param.set_mirror(true);
+  transform_param.add_mean_value(2);
+  vector<Datum> datum_vector(batch_size);
+  vector<Datum*> datum_ptrs(batch_size);
+  for (int i = 0; i < batch_size; ++i) {
+    FillDatum(i, channels, height, width, unique_pixels, &datum_vector[i]);
+    datum_ptrs[i] = &datum_vector[i];
+  }
+
+  // Transform the items one by one with a single thread.
+  DataTransformer<TypeParam> sequential(transform_param, TRAIN);
+  Caffe::set_random_seed(this->seed_);
+  sequential.InitRand();
+  Blob<TypeParam> expected(batch_size, channels, crop_size, crop_size);
+  Blob<TypeParam> item(1, channels, crop_size, crop_size);
+  for (int i = 0; i < batch_size; ++i) {
+    sequential.Transform(datum_vector[i], &item);
+    caffe_copy(item.count(), item.cpu_data(),
+        expected.mutable_cpu_data() + expected.offset(i));
+  }
+
+  // The batched version must draw the same crops and mirrors.
+  transform_param.set_num_threads(3);
+  DataTransformer<TypeParam> batched(transform_param, TRAIN);
+  Caffe::set_random_seed(this->seed_);
+  batched.InitRand();
+  Blob<TypeParam> blob(batch_size, channels, crop_size, crop_size);
+  batched.TransformBatch(datum_ptrs, &blob);
+  for (int j = 0; j < blob.count(); ++j) {
+    EXPECT_EQ(blob.cpu_data()[j], expected.cpu_data()[j]);
+  }
+}
+
+TYPED_TEST(DataTransformTest, TestTransformBatchResized) {
+  TransformationParameter transform_param;
+  const int channels = 3;
+  const int resize_height = 10;
+  const int resize_width = 12;
+  const int crop_size = 8;
+  const int batch_size = 4;
+
+  transform_param.set_crop_size(crop_size);
+  transform_param.set_mirror(true);
+  transform_param.add_mean_value(2);
+  // Downscaled, upscaled and unscaled sources.
+  const int sizes[batch_size][2] = {{23, 31}, {7, 9}, {10, 12}, {40, 17}};
+  vector<cv::Mat> originals(batch_size), resized(batch_size);
+  for (int i = 0; i < batch_size; ++i) {
+    originals[i].create(sizes[i][0], sizes[i][1], CV_8UC3);
+    for (int h = 0; h < originals[i].rows; ++h) {
+      uchar* ptr = originals[i].ptr<uchar>(h);
+      for (int j = 0; j < originals[i].cols * channels; ++j) {
+        ptr[j] = static_cast<uchar>((h * 37 + j * 11 + i * 5) % 256);
+      }
+    }
+    cv::resize(originals[i], resized[i], cv::Size(resize_width,
+                                                  resize_height));
+  }
+
+  DataTransformer<TypeParam> two_steps(transform_param, TRAIN);
+  Caffe::set_random_seed(this->seed_);
+  two_steps.InitRand();
+  Blob<TypeParam> expected(batch_size, channels, crop_size, crop_size);
+  two_steps.TransformBatch(resized, &expected);
+
+  // Same crops and mirrors; values only differ by the rounding of the
+  // resized copies.
+  transform_param.set_num_threads(2);
+  DataTransformer<TypeParam> fused(transform_param, TRAIN);
+  Caffe::set_random_seed(this->seed_);
+  fused.InitRand();
+  Blob<TypeParam> blob(batch_size, channels, crop_size, crop_size);
+  fused.TransformBatch(originals, resize_height, resize_width, &blob);
+  for (int j = 0; j < blob.count(); ++j) {
+    EXPECT_NEAR(blob.cpu_data()[j], expected.cpu_data()[j], 1);
+  }
+}
+
+TYPED_TEST(DataTransformTest, TestNHWCLayout) {
+  TransformationParameter transform_param;
+  const bool unique_pixels = true;  // pixels are consecutive ints [0,size]
+  const int label = 0;
+  const int channels = 3;
+  const int height = 4;
+  const int width = 5;
+
+  transform_param.set_layout(TransformationParameter_Layout_NHWC);
+  transform_param.add_mean_value(0);
+  transform_param.add_mean_value(1);
+  transform_param.add_mean_value(2);
+  Datum datum;
+  FillDatum(label, channels, height, width, unique_pixels, &datum);
+  DataTransformer<TypeParam> transformer(transform_param, TEST);
+  transformer.InitRand();
+  vector<int> shape = transformer.InferBlobShape(datum);
+  ASSERT_EQ(4, shape.size());
+  EXPECT_EQ(1, shape[0]);
+  EXPECT_EQ(height, shape[1]);
+  EXPECT_EQ(width, shape[2]);
+  EXPECT_EQ(channels, shape[3]);
+  Blob<TypeParam> blob(shape);
+  transformer.Transform(datum, &blob);
+  for (int c = 0; c < channels; ++c) {
+    for (int h = 0; h < height; ++h) {
+      for (int w = 0; w < width; ++w) {
+        EXPECT_EQ(blob.data_at(0, h, w, c),
+                  (c * height + h) * width + w - c);
+      }
+    }
+  }
+}
+
 }  // namespace caffe
 #endif  // USE_OPENCV
@@ -0,0 +1,71 @@
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/datum_cache.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class DatumCacheTest : public ::testing::Test {
+ protected:
+  static Datum MakeDatum(int label, int size) {
+    Datum datum;
+    datum.set_label(label);
+    datum.set_channels(1);
+    datum.set_height(1);
+    datum.set_width(size);
+    datum.set_data(string(size, static_cast<char>(label)));
+    return datum;
+  }
+
+  static bool Contains(const DatumCache& cache, const string& name) {
+    return cache.Lookup(name).get() != NULL;
+  }
+};
+
+TEST_F(DatumCacheTest, TestInsertLookup) {
+  shared_ptr<DatumCache> cache = DatumCache::Get("test_insert", 1 << 20);
+  EXPECT_FALSE(Contains(*cache, "a"));
+  EXPECT_TRUE(cache->Insert("a", MakeDatum(1, 16)));
+  EXPECT_FALSE(cache->Insert("a", MakeDatum(2, 16)));
+  shared_ptr<const Datum> cached = cache->Lookup("a");
+  ASSERT_TRUE(cached.get() != NULL);
+  EXPECT_EQ(1, cached->label());
+  EXPECT_EQ(string(16, 1), cached->data());
+  EXPECT_EQ(1, cache->size());
+}
+
+TEST_F(DatumCacheTest, TestCapacity) {
+  const Datum datum = MakeDatum(0, 100);
+  const uint64_t sample_bytes = 1 + datum.ByteSizeLong();
+  shared_ptr<DatumCache> cache =
+      DatumCache::Get("test_capacity", 3 * sample_bytes);
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_EQ(i < 3, cache->Insert(string(1, 'a' + i), datum));
+  }
+  EXPECT_EQ(3, cache->size());
+  EXPECT_EQ(3 * sample_bytes, cache->size_bytes());
+  EXPECT_TRUE(Contains(*cache, "c"));
+  EXPECT_FALSE(Contains(*cache, "d"));
+}
+
+TEST_F(DatumCacheTest, TestSharedByKey) {
+  shared_ptr<DatumCache> train = DatumCache::Get("test_shared", 1 << 20);
+  shared_ptr<DatumCache> test = DatumCache::Get("test_shared", 1 << 20);
+  shared_ptr<DatumCache> other = DatumCache::Get("test_other", 1 << 20);
+  EXPECT_EQ(train.get(), test.get());
+  EXPECT_NE(train.get(), other.get());
+  EXPECT_TRUE(train->Insert("a", MakeDatum(3, 4)));
+  EXPECT_TRUE(Contains(*test, "a"));
+  EXPECT_FALSE(Contains(*other, "a"));
+  // Once released, the cache is dropped.
+  train.reset();
+  test.reset();
+  EXPECT_FALSE(Contains(*DatumCache::Get("test_shared", 1 << 20), "a"));
+}
+
+}  // namespace caffe
@@ -0,0 +1,212 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/fast_math.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class FastMathTest : public ::testing::Test {
+ protected:
+  // Returns the error of actual in units of the last place of expected,
+  // rounded to float; below FLT_MIN the unit is the smallest denormal.
+  static double UlpError(const float actual, const double expected) {
+    const float rounded = std::fabs(static_cast<float>(expected));
+    float ulp = std::nextafter(rounded, std::numeric_limits<float>::max())
+        - rounded;
+    if (rounded == std::numeric_limits<float>::max()) {
+      ulp = rounded - std::nextafter(rounded, 0.f);
+    }
+    return std::fabs(actual - expected) / ulp;
+  }
+
+  // Checks op against reference at num points from begin to end, spaced
+  // evenly or, if geometric, by a constant ratio.
+  template <typename Op>
+  static void CheckUlps(const Op& op, double (*reference)(double),
+      const float begin, const float end, const bool geometric,
+      const double max_ulps) {
+    const int num = 1000000;
+    for (int i = 0; i <= num; ++i) {
+      const double t = static_cast<double>(i) / num;
+      const float x = geometric ?
+          std::exp(std::log(begin) + (std::log(end) - std::log(begin)) * t) :
+          begin + (end - begin) * t;
+      const double expected = reference(x);
+      ASSERT_LE(UlpError(op(x), expected), max_ulps)
+          << "at " << x << ": " << op(x) << " instead of " << expected;
+    }
+  }
+
+  static double Exp(double x) { return std::exp(x); }
+  static double Log(double x) { return std::log(x); }
+  static double Tanh(double x) { return std::tanh(x); }
+  static double Sigmoid(double x) { return 1. / (1. + std::exp(-x)); }
+};
+
+TEST_F(FastMathTest, TestExp) {
+  // Down to the denormals and up to FLT_MAX.
+  CheckUlps(FastExp(), &Exp, -103.9f, 88.72f, false, 2);
+  CheckUlps(FastExp(), &Exp, -1.f, 1.f, false, 2);
+}
+
+TEST_F(FastMathTest, TestLog) {
+  CheckUlps(FastLog(), &Log, 1e-45f, 3e38f, true, 2);
+  CheckUlps(FastLog(), &Log, 0.5f, 2.f, false, 2);
+}
+
+TEST_F(FastMathTest, TestTanh) {
+  CheckUlps(FastTanh(), &Tanh, -12.f, 12.f, false, 2);
+  CheckUlps(FastTanh(), &Tanh, 1e-30f, 1.f, true, 2);
+}
+
+TEST_F(FastMathTest, TestSigmoid) {
+  CheckUlps(FastSigmoid(), &Sigmoid, -100.f, 30.f, false, 3);
+}
+
+TEST_F(FastMathTest, TestSpecialValues) {
+  const float inf = std::numeric_limits<float>::infinity();
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  EXPECT_EQ(inf, fast_exp(inf));
+  EXPECT_EQ(inf, fast_exp(89.f));
+  EXPECT_EQ(0, fast_exp(-inf));
+  EXPECT_EQ(0, fast_exp(-105.f));
+  EXPECT_TRUE(std::isnan(fast_exp(nan)));
+  EXPECT_EQ(-inf, fast_log(0.f));
+  EXPECT_EQ(inf, fast_log(inf));
+  EXPECT_TRUE(std::isnan(fast_log(-1.f)));
+  EXPECT_TRUE(std::isnan(fast_log(-inf)));
+  EXPECT_TRUE(std::isnan(fast_log(nan)));
+  EXPECT_EQ(1, fast_tanh(inf));
+  EXPECT_EQ(-1, fast_tanh(-inf));
+  EXPECT_TRUE(std::isnan(fast_tanh(nan)));
+  EXPECT_EQ(1, fast_sigmoid(inf));
+  EXPECT_EQ(0, fast_sigmoid(-inf));
+  EXPECT_EQ(0.5, fast_sigmoid(0.f));
+  EXPECT_TRUE(std::isnan(fast_sigmoid(nan)));
+}
+
+TEST_F(FastMathTest, TestPowx) {
+  const float exponents[] = {-3, -1, -0.75, 0.5, 0.75, 3, 10};
+  const int num = 100001;
+  vector<float> a(num), y(num);
+  for (int i = 0; i < num; ++i) {
+    a[i] = std::exp(std::log(1e-3) + std::log(1e6) * i / (num - 1));
+  }
+  for (int e = 0; e < sizeof(exponents) / sizeof(exponents[0]); ++e) {
+    const float b = exponents[e];
+    fast_powx(num, &a[0], b, &y[0]);
+    for (int i = 0; i < num; ++i) {
+      const double expected = std::pow(static_cast<double>(a[i]), b);
+      ASSERT_LE(UlpError(y[i], expected),
+          2 * (1 + std::fabs(std::log(expected))))
+          << "pow(" << a[i] << ", " << b << ")";
+    }
+  }
+}
+
+TEST_F(FastMathTest, TestPowxSpecialValues) {
+  // Negative bases and special values, as std::pow.
+  const float inf = std::numeric_limits<float>::infinity();
+  const float bases[] = {-2, -0.5, -0., 0, 1, -1, inf, -inf,
+      std::numeric_limits<float>::quiet_NaN()};
+  const int num = sizeof(bases) / sizeof(bases[0]);
+  const float exponents[] = {-3, -1, -0.75, 0.5, 3, 10};
+  for (int e = 0; e < sizeof(exponents) / sizeof(exponents[0]); ++e) {
+    float y[num];
+    fast_powx(num, bases, exponents[e], y);
+    for (int i = 0; i < num; ++i) {
+      const float expected = std::pow(bases[i], exponents[e]);
+      if (std::isnan(expected)) {
+        EXPECT_TRUE(std::isnan(y[i]));
+        continue;
+      }
+      if (std::isinf(expected)) {
+        EXPECT_EQ(expected, y[i]);
+      } else {
+        EXPECT_NEAR(expected, y[i], 1e-6 * std::fabs(expected))
+            << "pow(" << bases[i] << ", " << exponents[e] << ")";
+      }
+      EXPECT_EQ(std::signbit(expected), std::signbit(y[i]));
+    }
+  }
+}
+
+template <typename Dtype>
+class FastMathArrayTest : public ::testing::Test {
+ protected:
+  FastMathArrayTest() : blob_(1, 1, 1, 1003), result_(blob_.shape()) {
+    // An odd count leaves a partial block.
+    Caffe::set_random_seed(1701);
+    FillerParameter filler_param;
+    filler_param.set_std(4);
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(&blob_);
+  }
+
+  // Checks fn against reference on the blob, out of place then in place.
+  void Check(void (*fn)(const int, const Dtype*, Dtype*),
+      double (*reference)(double), const bool positive) {
+    Dtype* x = blob_.mutable_cpu_data();
+    if (positive) {
+      caffe_abs(blob_.count(), x, x);
+    }
+    const int n = blob_.count();
+    fn(n, blob_.cpu_data(), result_.mutable_cpu_data());
+    Blob<Dtype> in_place;
+    in_place.CopyFrom(blob_, false, true);
+    fn(n, in_place.cpu_data(), in_place.mutable_cpu_data());
+    for (int i = 0; i < n; ++i) {
+      const double expected = reference(blob_.cpu_data()[i]);
+      EXPECT_NEAR(expected, result_.cpu_data()[i],
+          1e-6 * std::max(1., std::fabs(expected)));
+      EXPECT_EQ(result_.cpu_data()[i], in_place.cpu_data()[i]);
+    }
+  }
+
+  static double Exp(double x) { return std::exp(x); }
+  static double Log(double x) { return std::log(x); }
+  static double Tanh(double x) { return std::tanh(x); }
+  static double Sigmoid(double x) { return 1. / (1. + std::exp(-x)); }
+  static double Powx(double x) { return std::pow(x, 0.75); }
+
+  static void PowxFn(const int n, const Dtype* a, Dtype* y) {
+    caffe_powx(n, a, Dtype(0.75), y);
+  }
+
+  Blob<Dtype> blob_;
+  Blob<Dtype> result_;
+};
+
+TYPED_TEST_CASE(FastMathArrayTest, TestDtypes);
+
+TYPED_TEST(FastMathArrayTest, TestExp) {
+  this->Check(&caffe_exp<TypeParam>, &TestFixture::Exp, false);
+}
+
+TYPED_TEST(FastMathArrayTest, TestLog) {
+  this->Check(&caffe_log<TypeParam>, &TestFixture::Log, true);
+}
+
+TYPED_TEST(FastMathArrayTest, TestTanh) {
+  this->Check(&caffe_tanh<TypeParam>, &TestFixture::Tanh, false);
+}
+
+TYPED_TEST(FastMathArrayTest, TestSigmoid) {
+  this->Check(&caffe_sigmoid<TypeParam>, &TestFixture::Sigmoid, false);
+}
+
+TYPED_TEST(FastMathArrayTest, TestPowx) {
+  this->Check(&TestFixture::PowxFn, &TestFixture::Powx, true);
+}
+
+}  // namespace caffe
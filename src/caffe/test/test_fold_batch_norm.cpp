@@ -0,0 +1,103 @@
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/fold_batch_norm.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class FoldBatchNormTest : public ::testing::Test {
+ protected:
+  FoldBatchNormTest() {
+    const string proto =
+        "name: 'FoldBatchNormTestNet' "
+        "state { phase: TEST } "
+        "layer { name: 'data' type: 'Input' top: 'data' "
+        "  input_param { shape { dim: 2 dim: 3 dim: 6 dim: 5 } } } "
+        "layer { name: 'conv' type: 'Convolution' bottom: 'data' top: 'conv' "
+        "  convolution_param { num_output: 4 kernel_size: 3 bias_term: false "
+        "    weight_filler { type: 'gaussian' std: 0.5 } } } "
+        "layer { name: 'bn' type: 'BatchNorm' bottom: 'conv' top: 'conv' } "
+        "layer { name: 'scale' type: 'Scale' bottom: 'conv' top: 'conv' "
+        "  scale_param { bias_term: true } } "
+        "layer { name: 'relu' type: 'ReLU' bottom: 'conv' top: 'conv' } "
+        "layer { name: 'ip' type: 'InnerProduct' bottom: 'conv' top: 'ip' "
+        "  inner_product_param { num_output: 5 transpose: true "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "    bias_filler { type: 'gaussian' std: 0.5 } } } "
+        "layer { name: 'bn2' type: 'BatchNorm' bottom: 'ip' top: 'ip_bn' } "
+        // ip2 is read twice and stays as it is.
+        "layer { name: 'ip2' type: 'InnerProduct' bottom: 'ip_bn' top: 'ip2' "
+        "  inner_product_param { num_output: 5 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } } } "
+        "layer { name: 'bn3' type: 'BatchNorm' bottom: 'ip2' top: 'ip2_bn' } "
+        "layer { name: 'sum' type: 'Eltwise' bottom: 'ip2' bottom: 'ip2_bn' "
+        "  top: 'sum' } ";
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param_));
+  }
+
+  NetParameter param_;
+};
+
+TEST_F(FoldBatchNormTest, TestFoldedNetMatches) {
+  Caffe::set_random_seed(1701);
+  Net<float> net(param_);
+  FillerParameter filler_param;
+  filler_param.set_min(0.5);
+  filler_param.set_max(2);
+  UniformFiller<float> positive_filler(filler_param);
+  GaussianFiller<float> gaussian_filler(filler_param);
+  const char* batch_norms[] = {"bn", "bn2", "bn3"};
+  for (int i = 0; i < 3; ++i) {
+    const vector<shared_ptr<Blob<float> > >& stats =
+        net.layer_by_name(batch_norms[i])->blobs();
+    // Sums weighted by a factor of 2.
+    gaussian_filler.Fill(stats[0].get());
+    positive_filler.Fill(stats[1].get());
+    stats[2]->mutable_cpu_data()[0] = 2;
+  }
+  const vector<shared_ptr<Blob<float> > >& scale =
+      net.layer_by_name("scale")->blobs();
+  positive_filler.Fill(scale[0].get());
+  gaussian_filler.Fill(scale[1].get());
+  gaussian_filler.Fill(net.input_blobs()[0]);
+  net.Forward();
+  Blob<float> expected;
+  expected.CopyFrom(*net.blob_by_name("sum"), false, true);
+  NetParameter weights;
+  net.ToProto(&weights);
+
+  NetParameter folded_param, folded_weights;
+  EXPECT_EQ(2, FoldBatchNorm(param_, weights, &folded_param,
+      &folded_weights));
+  ASSERT_EQ(param_.layer_size() - 3, folded_param.layer_size());
+  for (int i = 0; i < folded_param.layer_size(); ++i) {
+    EXPECT_NE("Scale", folded_param.layer(i).type());
+  }
+  Net<float> folded_net(folded_param);
+  folded_net.CopyTrainedLayersFrom(folded_weights);
+  EXPECT_FALSE(folded_net.has_layer("bn"));
+  EXPECT_FALSE(folded_net.has_layer("bn2"));
+  EXPECT_TRUE(folded_net.has_layer("bn3"));
+  folded_net.input_blobs()[0]->CopyFrom(*net.input_blobs()[0]);
+  folded_net.Forward();
+  const Blob<float>& actual = *folded_net.blob_by_name("sum");
+  ASSERT_EQ(expected.count(), actual.count());
+  for (int i = 0; i < expected.count(); ++i) {
+    EXPECT_NEAR(expected.cpu_data()[i], actual.cpu_data()[i],
+        1e-4 * std::max(1.f, std::fabs(expected.cpu_data()[i])));
+  }
+}
+
+}  // namespace caffe
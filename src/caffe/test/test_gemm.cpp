@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/gemm.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class GemmBackendTest : public ::testing::Test {
+ protected:
+  GemmBackendTest() {
+    Caffe::set_random_seed(1701);
+  }
+  virtual ~GemmBackendTest() {
+    GemmBackend::Set("blas");
+    GemmBackend::set_num_threads(1);
+  }
+
+  static void Fill(Blob<Dtype>* blob) {
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(blob);
+  }
+
+  // Compares the "caffe" backend with "blas" on op(A) * op(B), with A
+  // M x K and B K x N once transposed back.
+  void Check(const int M, const int N, const int K) {
+    Blob<Dtype> A(1, 1, M, K), B(1, 1, K, N), C(1, 1, M, N);
+    Fill(&A);
+    Fill(&B);
+    Fill(&C);
+    Blob<Dtype> expected(C.shape()), actual(C.shape());
+    const CBLAS_TRANSPOSE trans[] = {CblasNoTrans, CblasTrans};
+    const Dtype betas[] = {0, 0.5};
+    for (int ta = 0; ta < 2; ++ta) {
+      for (int tb = 0; tb < 2; ++tb) {
+        for (int b = 0; b < 2; ++b) {
+          // The shapes of A and B do not change with the transposes; only
+          // the values differ.
+          expected.CopyFrom(C);
+          actual.CopyFrom(C);
+          GemmBackend::Set("blas");
+          caffe_cpu_gemm<Dtype>(trans[ta], trans[tb], M, N, K, 1.5,
+              A.cpu_data(), B.cpu_data(), betas[b],
+              expected.mutable_cpu_data());
+          GemmBackend::Set("caffe");
+          caffe_cpu_gemm<Dtype>(trans[ta], trans[tb], M, N, K, 1.5,
+              A.cpu_data(), B.cpu_data(), betas[b],
+              actual.mutable_cpu_data());
+          for (int i = 0; i < expected.count(); ++i) {
+            ASSERT_NEAR(expected.cpu_data()[i], actual.cpu_data()[i], 1e-3)
+                << M << "x" << N << "x" << K << " trans " << ta << tb
+                << " beta " << betas[b] << " at " << i;
+          }
+        }
+      }
+    }
+  }
+
+  // The same with op(A) packed, then op(B) packed.
+  void CheckPacked(const int M, const int N, const int K) {
+    Blob<Dtype> A(1, 1, M, K), B(1, 1, K, N);
+    Fill(&A);
+    Fill(&B);
+    Blob<Dtype> expected(1, 1, M, N), actual(1, 1, M, N);
+    GemmBackend::Set("blas");
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, M, N, K, 1.,
+        A.cpu_data(), B.cpu_data(), 0., expected.mutable_cpu_data());
+    GemmBackend::Set("caffe");
+    GemmPackedA<Dtype> packed_a;
+    packed_a.Pack(CblasNoTrans, M, K, A.cpu_data());
+    EXPECT_FALSE(packed_a.packed().empty());
+    caffe_cpu_gemm<Dtype>(packed_a, CblasTrans, N, 1., B.cpu_data(), 0.,
+        actual.mutable_cpu_data());
+    for (int i = 0; i < expected.count(); ++i) {
+      ASSERT_NEAR(expected.cpu_data()[i], actual.cpu_data()[i], 1e-3)
+          << "packed A at " << i;
+    }
+    GemmPackedB<Dtype> packed_b;
+    packed_b.Pack(CblasTrans, K, N, B.cpu_data());
+    EXPECT_FALSE(packed_b.packed().empty());
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, M, 1., A.cpu_data(), packed_b, 0.,
+        actual.mutable_cpu_data());
+    for (int i = 0; i < expected.count(); ++i) {
+      ASSERT_NEAR(expected.cpu_data()[i], actual.cpu_data()[i], 1e-3)
+          << "packed B at " << i;
+    }
+  }
+};
+
+TYPED_TEST_CASE(GemmBackendTest, TestDtypes);
+
+TYPED_TEST(GemmBackendTest, TestRegistry) {
+  vector<string> names = GemmBackend::Names();
+  EXPECT_TRUE(std::find(names.begin(), names.end(), "blas") != names.end());
+  EXPECT_TRUE(std::find(names.begin(), names.end(), "caffe") != names.end());
+  EXPECT_EQ("blas", GemmBackend::name());
+  GemmBackend::Set("caffe");
+  EXPECT_EQ("caffe", GemmBackend::name());
+}
+
+TYPED_TEST(GemmBackendTest, TestSmall) {
+  this->Check(1, 1, 1);
+  this->Check(2, 4, 3);
+  this->Check(7, 9, 5);
+  this->Check(17, 33, 20);
+}
+
+TYPED_TEST(GemmBackendTest, TestBlocks) {
+  // Several row, depth and column blocks, all with ragged edges.
+  this->Check(131, 2051, 259);
+}
+
+TYPED_TEST(GemmBackendTest, TestThreaded) {
+  GemmBackend::set_num_threads(3);
+  this->Check(67, 301, 70);
+}
+
+TYPED_TEST(GemmBackendTest, TestPacked) {
+  this->CheckPacked(13, 21, 300);
+  GemmBackend::set_num_threads(3);
+  this->CheckPacked(67, 301, 70);
+}
+
+TYPED_TEST(GemmBackendTest, TestPackedOtherBackend) {
+  // Packing for another backend keeps the source, which is then used.
+  const int M = 5, N = 6, K = 7;
+  Blob<TypeParam> A(1, 1, M, K), B(1, 1, K, N);
+  this->Fill(&A);
+  this->Fill(&B);
+  Blob<TypeParam> expected(1, 1, M, N), actual(1, 1, M, N);
+  caffe_cpu_gemm<TypeParam>(CblasNoTrans, CblasNoTrans, M, N, K, 1.,
+      A.cpu_data(), B.cpu_data(), 0., expected.mutable_cpu_data());
+  GemmPackedA<TypeParam> packed_a;
+  packed_a.Pack(CblasNoTrans, M, K, A.cpu_data());
+  EXPECT_TRUE(packed_a.packed().empty());
+  caffe_cpu_gemm<TypeParam>(packed_a, CblasNoTrans, N, 1., B.cpu_data(), 0.,
+      actual.mutable_cpu_data());
+  for (int i = 0; i < expected.count(); ++i) {
+    EXPECT_EQ(expected.cpu_data()[i], actual.cpu_data()[i]);
+  }
+}
+
+}  // namespace caffe
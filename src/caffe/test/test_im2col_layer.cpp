@@ -6,6 +6,8 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/im2col_layer.hpp"
+#include "caffe/util/im2col.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 #include "caffe/test/test_gradient_check_util.hpp"
@@ -175,4 +177,58 @@ TYPED_TEST(Im2colLayerTest, TestRectGradient) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(Im2colLayerTest, TestAgainstND) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) {
+    return;  // Compares the CPU functions only.
+  }
+  // The 2D functions copy whole runs of columns, the N-D ones go one
+  // element at a time: they must agree, with and without threads.
+  ThreadPool pool(3);
+  const int channels = this->blob_bottom_->channels();
+  const int height = this->blob_bottom_->height();
+  const int width = this->blob_bottom_->width();
+  // kernel, pad, stride and dilation, as (h, w) pairs
+  const int kConfigs[][8] = {{3, 3, 1, 1, 1, 1, 1, 1}, {3, 3, 0, 0, 2, 2, 1, 1},
+      {5, 3, 2, 1, 1, 2, 1, 1}, {3, 2, 2, 3, 1, 3, 2, 1},
+      {1, 1, 0, 0, 1, 1, 1, 1}, {2, 2, 4, 4, 3, 3, 1, 1}};
+  const int num_configs = sizeof(kConfigs) / sizeof(kConfigs[0]);
+  for (int i = 0; i < num_configs; ++i) {
+    const int* c = kConfigs[i];
+    const int output_h = (height + 2 * c[2] - (c[6] * (c[0] - 1) + 1)) / c[4]
+        + 1;
+    const int output_w = (width + 2 * c[3] - (c[7] * (c[1] - 1) + 1)) / c[5]
+        + 1;
+    const int im_shape[] = {channels, height, width};
+    const int col_shape[] = {channels * c[0] * c[1], output_h, output_w};
+    Blob<Dtype> expected(1, col_shape[0], output_h, output_w);
+    Blob<Dtype> actual(expected.shape());
+    im2col_nd_cpu(this->blob_bottom_->cpu_data(), 2, im_shape, col_shape,
+        c, c + 2, c + 4, c + 6, expected.mutable_cpu_data());
+    for (int threaded = 0; threaded < 2; ++threaded) {
+      im2col_cpu(this->blob_bottom_->cpu_data(), channels, height, width,
+          c[0], c[1], c[2], c[3], c[4], c[5], c[6], c[7],
+          actual.mutable_cpu_data(), threaded ? &pool : NULL);
+      for (int j = 0; j < expected.count(); ++j) {
+        ASSERT_EQ(expected.cpu_data()[j], actual.cpu_data()[j])
+            << "im2col config " << i << " threaded " << threaded;
+      }
+    }
+    // Back to images, from the columns as gradients.
+    Blob<Dtype> expected_im(this->blob_bottom_->shape());
+    Blob<Dtype> actual_im(this->blob_bottom_->shape());
+    col2im_nd_cpu(expected.cpu_data(), 2, im_shape, col_shape, c, c + 2,
+        c + 4, c + 6, expected_im.mutable_cpu_data());
+    for (int threaded = 0; threaded < 2; ++threaded) {
+      col2im_cpu(expected.cpu_data(), channels, height, width, c[0], c[1],
+          c[2], c[3], c[4], c[5], c[6], c[7], actual_im.mutable_cpu_data(),
+          threaded ? &pool : NULL);
+      for (int j = 0; j < this->blob_bottom_->count(1); ++j) {
+        EXPECT_NEAR(expected_im.cpu_data()[j], actual_im.cpu_data()[j], 1e-5)
+            << "col2im config " << i << " threaded " << threaded;
+      }
+    }
+  }
+}
+
 }  // namespace caffe
@@ -97,6 +97,38 @@ TYPED_TEST(ImageDataLayerTest, TestRead) {
   }
 }
 
+TYPED_TEST(ImageDataLayerTest, TestReadCached) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  ImageDataParameter* image_data_param = param.mutable_image_data_param();
+  image_data_param->set_batch_size(5);
+  image_data_param->set_source(this->filename_.c_str());
+  image_data_param->set_shuffle(false);
+  ImageDataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  image_data_param->set_cache_bytes(1 << 24);
+  ImageDataLayer<Dtype> cached_layer(param);
+  vector<Blob<Dtype>*> cached_top_vec;
+  Blob<Dtype> cached_data;
+  Blob<Dtype> cached_label;
+  cached_top_vec.push_back(&cached_data);
+  cached_top_vec.push_back(&cached_label);
+  cached_layer.SetUp(this->blob_bottom_vec_, cached_top_vec);
+  ASSERT_EQ(this->blob_top_data_->shape(), cached_data.shape());
+  // The first pass fills the cache, the second one reads from it.
+  for (int iter = 0; iter < 2; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    cached_layer.Forward(this->blob_bottom_vec_, cached_top_vec);
+    for (int i = 0; i < 5; ++i) {
+      EXPECT_EQ(i, cached_label.cpu_data()[i]);
+    }
+    for (int i = 0; i < cached_data.count(); ++i) {
+      EXPECT_EQ(this->blob_top_data_->cpu_data()[i],
+                cached_data.cpu_data()[i]);
+    }
+  }
+}
+
 TYPED_TEST(ImageDataLayerTest, TestResize) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter param;
@@ -186,6 +218,47 @@ TYPED_TEST(ImageDataLayerTest, TestShuffle) {
   }
 }
 
+TYPED_TEST(ImageDataLayerTest, TestShard) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  ImageDataParameter* image_data_param = param.mutable_image_data_param();
+  image_data_param->set_batch_size(4);
+  image_data_param->set_source(this->filename_.c_str());
+  image_data_param->set_shard_id(1);
+  image_data_param->set_num_shards(2);
+  ImageDataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Shard 1 of 2 holds lines 1 and 3.
+  for (int iter = 0; iter < 2; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int i = 0; i < 4; ++i) {
+      EXPECT_EQ(i % 2 * 2 + 1, this->blob_top_label_->cpu_data()[i]);
+    }
+  }
+}
+
+// Blank lines are skipped, and the last line needs no newline.
+TYPED_TEST(ImageDataLayerTest, TestListFormat) {
+  typedef typename TypeParam::Dtype Dtype;
+  string filename;
+  MakeTempFilename(&filename);
+  std::ofstream outfile(filename.c_str(), std::ofstream::out);
+  outfile << EXAMPLES_SOURCE_DIR "images/cat.jpg 3\n\n"
+          << EXAMPLES_SOURCE_DIR "images/cat gray.jpg 7";
+  outfile.close();
+  LayerParameter param;
+  ImageDataParameter* image_data_param = param.mutable_image_data_param();
+  image_data_param->set_batch_size(2);
+  image_data_param->set_source(filename.c_str());
+  image_data_param->set_new_height(16);
+  image_data_param->set_new_width(16);
+  ImageDataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(3, this->blob_top_label_->cpu_data()[0]);
+  EXPECT_EQ(7, this->blob_top_label_->cpu_data()[1]);
+}
+
 TYPED_TEST(ImageDataLayerTest, TestSpace) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter param;
@@ -6,6 +6,8 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/inner_product_layer.hpp"
+#include "caffe/util/gemm.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 #include "caffe/test/test_gradient_check_util.hpp"
@@ -135,6 +137,71 @@ TYPED_TEST(InnerProductLayerTest, TestForward) {
   }
 }
 
+TYPED_TEST(InnerProductLayerTest, TestForwardPackedWeights) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) {
+    return;
+  }
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  LayerParameter layer_param;
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(10);
+  inner_product_param->set_bias_term(false);
+  inner_product_param->mutable_weight_filler()->set_type("gaussian");
+  InnerProductLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> expected;
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  expected.CopyFrom(*this->blob_top_, false, true);
+  // The weights packed by the first pass of each backend must follow the
+  // changes made to them since.
+  const char* backends[] = {"caffe", "blas"};
+  for (int b = 0; b < 2; ++b) {
+    GemmBackend::Set(backends[b]);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.blobs()[0]->scale_data(2);
+    expected.scale_data(2);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int i = 0; i < expected.count(); ++i) {
+      EXPECT_NEAR(expected.cpu_data()[i], this->blob_top_->cpu_data()[i],
+          1e-4) << backends[b];
+    }
+  }
+}
+
+TYPED_TEST(InnerProductLayerTest, TestForwardHeldWeightPointer) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) {
+    return;
+  }
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  LayerParameter layer_param;
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(10);
+  inner_product_param->set_bias_term(false);
+  inner_product_param->mutable_weight_filler()->set_type("gaussian");
+  InnerProductLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype>* weights = layer.blobs()[0].get();
+  Dtype* held = weights->mutable_cpu_data();
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> expected;
+  expected.CopyFrom(*this->blob_top_, false, true);
+  // Written through the pointer fetched before the weights were packed,
+  // the change is only seen once a mutable pointer is asked for again.
+  caffe_scal(weights->count(), Dtype(2), held);
+  const uint64_t version = weights->data_version();
+  EXPECT_EQ(held, weights->mutable_cpu_data());
+  EXPECT_NE(version, weights->data_version());
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int i = 0; i < expected.count(); ++i) {
+    EXPECT_NEAR(2 * expected.cpu_data()[i], this->blob_top_->cpu_data()[i],
+        1e-4);
+  }
+}
+
 /**
  * @brief Init. an IP layer without transpose + random weights,
  * run Forward, save the result.
@@ -211,6 +211,26 @@ TEST_F(IOTest, TestReadImageToCVMatResizedSquare) {
   EXPECT_EQ(cv_img.cols, 256);
 }
 
+// Small targets decode the 360x480 image at 1/8 or 1/4 of its size, which
+// must stay close to resizing the full decode.
+TEST_F(IOTest, TestReadImageToCVMatResizedReduced) {
+  string filename = EXAMPLES_SOURCE_DIR "images/cat.jpg";
+  cv::Mat full_img = cv::imread(filename, CV_LOAD_IMAGE_COLOR);
+  for (int size = 40; size <= 80; size += 40) {
+    cv::Mat cv_img = ReadImageToCVMat(filename, size, size);
+    EXPECT_EQ(cv_img.channels(), 3);
+    EXPECT_EQ(cv_img.rows, size);
+    EXPECT_EQ(cv_img.cols, size);
+    cv::Mat ref_img;
+    cv::resize(full_img, ref_img, cv::Size(size, size), 0, 0, cv::INTER_AREA);
+    const cv::Scalar mean = cv::mean(cv_img);
+    const cv::Scalar ref_mean = cv::mean(ref_img);
+    for (int c = 0; c < 3; ++c) {
+      EXPECT_NEAR(mean[c], ref_mean[c], 4);
+    }
+  }
+}
+
 TEST_F(IOTest, TestReadImageToCVMatGray) {
   string filename = EXAMPLES_SOURCE_DIR "images/cat.jpg";
   const bool is_color = false;
@@ -0,0 +1,114 @@
+#include <boost/thread.hpp>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/lock_free_queue.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class LockFreeQueueTest : public ::testing::Test {
+ public:
+  LockFreeQueueTest() : datums_(kItems) {}
+
+  static const int kItems = 100000;
+
+  // Pushes the datums in [begin, end) in order.
+  void Produce(LockFreeQueue<Datum*>* queue, int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      queue->push(&datums_[i]);
+    }
+  }
+
+  // Pops count datums and flags each one as seen.
+  void Consume(LockFreeQueue<Datum*>* queue, int count, vector<int>* seen) {
+    for (int i = 0; i < count; ++i) {
+      ++(*seen)[queue->pop() - &datums_[0]];
+    }
+  }
+
+ protected:
+  vector<Datum> datums_;
+};
+
+TEST_F(LockFreeQueueTest, TestCapacity) {
+  EXPECT_EQ(1, LockFreeQueue<Datum*>(1).capacity());
+  EXPECT_EQ(8, LockFreeQueue<Datum*>(8).capacity());
+  EXPECT_EQ(16, LockFreeQueue<Datum*>(9).capacity());
+}
+
+TEST_F(LockFreeQueueTest, TestFIFO) {
+  LockFreeQueue<Datum*> queue(4);
+  Datum* datum;
+  EXPECT_FALSE(queue.try_pop(&datum));
+  EXPECT_FALSE(queue.try_peek(&datum));
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_TRUE(queue.try_push(&datums_[i]));
+  }
+  EXPECT_FALSE(queue.try_push(&datums_[4]));
+  EXPECT_EQ(4, queue.size());
+  EXPECT_EQ(&datums_[0], queue.peek());
+  // Wrap around the ring a few times.
+  for (int i = 0; i < 10; ++i) {
+    ASSERT_TRUE(queue.try_pop(&datum));
+    EXPECT_EQ(&datums_[i], datum);
+    EXPECT_TRUE(queue.try_push(&datums_[i + 4]));
+  }
+  for (int i = 10; i < 14; ++i) {
+    EXPECT_EQ(&datums_[i], queue.pop());
+  }
+  EXPECT_EQ(0, queue.size());
+}
+
+TEST_F(LockFreeQueueTest, TestInterruptedPop) {
+  // A consumer parked on the empty queue is interrupted, as on shutdown;
+  // the queue keeps working for the threads left.
+  LockFreeQueue<Datum*> queue(4);
+  vector<int> seen(kItems, 0);
+  boost::thread consumer(&LockFreeQueueTest::Consume, this, &queue, 1, &seen);
+  boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+  consumer.interrupt();
+  consumer.join();
+  EXPECT_EQ(0, seen[0]);
+  queue.push(&datums_[0]);
+  EXPECT_EQ(&datums_[0], queue.pop());
+  EXPECT_EQ(0, queue.size());
+}
+
+TEST_F(LockFreeQueueTest, TestSingleProducerConsumer) {
+  LockFreeQueue<Datum*> queue(16);
+  boost::thread producer(&LockFreeQueueTest::Produce, this, &queue, 0, kItems);
+  for (int i = 0; i < kItems; ++i) {
+    ASSERT_EQ(&datums_[i], queue.pop());
+  }
+  producer.join();
+  EXPECT_EQ(0, queue.size());
+}
+
+TEST_F(LockFreeQueueTest, TestMultiProducerConsumer) {
+  const int kThreads = 4;
+  const int kPerThread = kItems / kThreads;
+  LockFreeQueue<Datum*> queue(8);
+  vector<vector<int> > seen(kThreads, vector<int>(kItems, 0));
+  boost::thread_group threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.create_thread(boost::bind(&LockFreeQueueTest::Produce, this,
+        &queue, t * kPerThread, (t + 1) * kPerThread));
+    threads.create_thread(boost::bind(&LockFreeQueueTest::Consume, this,
+        &queue, kPerThread, &seen[t]));
+  }
+  threads.join_all();
+  for (int i = 0; i < kThreads * kPerThread; ++i) {
+    int count = 0;
+    for (int t = 0; t < kThreads; ++t) {
+      count += seen[t][i];
+    }
+    ASSERT_EQ(1, count) << "datum " << i;
+  }
+}
+
+}  // namespace caffe
@@ -2,11 +2,13 @@
 #include <opencv2/core/core.hpp>
 #endif  // USE_OPENCV
 
+#include <boost/bind.hpp>
 #include <string>
 #include <vector>
 
 #include "caffe/filler.hpp"
 #include "caffe/layers/memory_data_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -115,6 +117,162 @@ TYPED_TEST(MemoryDataLayerTest, TestForward) {
   }
 }
 
+static void RecordRelease(int id, vector<int>* released) {
+  released->push_back(id);
+}
+
+// serve two queued buffers in place and check when they are released
+TYPED_TEST(MemoryDataLayerTest, TestEnqueue) {
+  typedef typename TypeParam::Dtype Dtype;
+
+  LayerParameter layer_param;
+  MemoryDataParameter* md_param = layer_param.mutable_memory_data_param();
+  md_param->set_batch_size(this->batch_size_);
+  md_param->set_channels(this->channels_);
+  md_param->set_height(this->height_);
+  md_param->set_width(this->width_);
+  shared_ptr<MemoryDataLayer<Dtype> > layer(
+      new MemoryDataLayer<Dtype>(layer_param));
+  layer->DataLayerSetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  const int half = this->batches_ / 2 * this->batch_size_;
+  vector<int> released;
+  for (int i = 0; i < 2; ++i) {
+    layer->Enqueue(
+        this->data_->mutable_cpu_data() + this->data_->offset(i * half),
+        this->labels_->mutable_cpu_data() + i * half, half,
+        boost::bind(&RecordRelease, i, &released));
+  }
+  for (int i = 0; i < this->batches_; ++i) {
+    layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    // The tops point to the queued memory.
+    EXPECT_EQ(this->data_->cpu_data() + this->data_->offset(1) *
+        this->batch_size_ * i, this->data_blob_->cpu_data());
+    EXPECT_EQ(this->labels_->cpu_data() + this->batch_size_ * i,
+        this->label_blob_->cpu_data());
+    EXPECT_EQ(i < this->batches_ / 2 ? 0 : 1, released.size());
+  }
+  layer.reset();
+  ASSERT_EQ(2, released.size());
+  EXPECT_EQ(0, released[0]);
+  EXPECT_EQ(1, released[1]);
+}
+
+// stage each batch while the previous one is served
+TYPED_TEST(MemoryDataLayerTest, TestStageArrays) {
+  typedef typename TypeParam::Dtype Dtype;
+
+  LayerParameter layer_param;
+  MemoryDataParameter* md_param = layer_param.mutable_memory_data_param();
+  md_param->set_batch_size(this->batch_size_);
+  md_param->set_channels(this->channels_);
+  md_param->set_height(this->height_);
+  md_param->set_width(this->width_);
+  md_param->set_queue_size(3);
+  shared_ptr<MemoryDataLayer<Dtype> > layer(
+      new MemoryDataLayer<Dtype>(layer_param));
+  layer->DataLayerSetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  const int batch_count = this->data_->offset(1) * this->batch_size_;
+  for (int i = 0; i < this->batches_; ++i) {
+    if (i == 0) {
+      layer->StageArrays(this->data_->cpu_data(), this->labels_->cpu_data(),
+          this->batch_size_);
+    }
+    if (i + 1 < this->batches_) {
+      layer->StageArrays(this->data_->cpu_data() + batch_count * (i + 1),
+          this->labels_->cpu_data() + this->batch_size_ * (i + 1),
+          this->batch_size_);
+    }
+    layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int j = 0; j < this->data_blob_->count(); ++j) {
+      EXPECT_EQ(this->data_blob_->cpu_data()[j],
+          this->data_->cpu_data()[batch_count * i + j]);
+    }
+    for (int j = 0; j < this->label_blob_->count(); ++j) {
+      EXPECT_EQ(this->label_blob_->cpu_data()[j],
+          this->labels_->cpu_data()[this->batch_size_ * i + j]);
+    }
+  }
+}
+
+// stage from buffers that are overwritten as soon as StageArrays returns
+TYPED_TEST(MemoryDataLayerTest, TestStageArraysCopyNow) {
+  typedef typename TypeParam::Dtype Dtype;
+
+  LayerParameter layer_param;
+  MemoryDataParameter* md_param = layer_param.mutable_memory_data_param();
+  md_param->set_batch_size(this->batch_size_);
+  md_param->set_channels(this->channels_);
+  md_param->set_height(this->height_);
+  md_param->set_width(this->width_);
+  md_param->set_queue_size(3);
+  shared_ptr<MemoryDataLayer<Dtype> > layer(
+      new MemoryDataLayer<Dtype>(layer_param));
+  layer->DataLayerSetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  const int batch_count = this->data_->offset(1) * this->batch_size_;
+  // Both batches are staged from the same buffers, overwritten in between.
+  Blob<Dtype> data(this->batch_size_, this->channels_, this->height_,
+      this->width_);
+  Blob<Dtype> labels(this->batch_size_, 1, 1, 1);
+  for (int i = 0; i < 2; ++i) {
+    caffe_copy(batch_count, this->data_->cpu_data() + batch_count * i,
+        data.mutable_cpu_data());
+    caffe_copy(this->batch_size_,
+        this->labels_->cpu_data() + this->batch_size_ * i,
+        labels.mutable_cpu_data());
+    layer->StageArrays(data.cpu_data(), labels.cpu_data(), this->batch_size_,
+        true);
+  }
+  caffe_set(batch_count, Dtype(0), data.mutable_cpu_data());
+  for (int i = 0; i < 2; ++i) {
+    layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int j = 0; j < this->data_blob_->count(); ++j) {
+      EXPECT_EQ(this->data_blob_->cpu_data()[j],
+          this->data_->cpu_data()[batch_count * i + j]);
+    }
+    for (int j = 0; j < this->label_blob_->count(); ++j) {
+      EXPECT_EQ(this->label_blob_->cpu_data()[j],
+          this->labels_->cpu_data()[this->batch_size_ * i + j]);
+    }
+  }
+}
+
+TYPED_TEST(MemoryDataLayerTest, TestResetDropsStaged) {
+  typedef typename TypeParam::Dtype Dtype;
+
+  LayerParameter layer_param;
+  MemoryDataParameter* md_param = layer_param.mutable_memory_data_param();
+  md_param->set_batch_size(this->batch_size_);
+  md_param->set_channels(this->channels_);
+  md_param->set_height(this->height_);
+  md_param->set_width(this->width_);
+  md_param->set_queue_size(3);
+  shared_ptr<MemoryDataLayer<Dtype> > layer(
+      new MemoryDataLayer<Dtype>(layer_param));
+  layer->DataLayerSetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  const int batch_count = this->data_->offset(1) * this->batch_size_;
+  for (int i = 0; i < 2; ++i) {
+    layer->StageArrays(this->data_->cpu_data() + batch_count * i,
+        this->labels_->cpu_data() + this->batch_size_ * i,
+        this->batch_size_);
+  }
+  // The staged batches, possibly still in flight, are never served.
+  layer->Reset(this->data_->mutable_cpu_data() + batch_count * 2,
+      this->labels_->mutable_cpu_data() + this->batch_size_ * 2,
+      this->batch_size_ * 2);
+  for (int i = 0; i < 4; ++i) {
+    layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    EXPECT_EQ(this->data_->cpu_data() + batch_count * (2 + i % 2),
+        this->data_blob_->cpu_data());
+    EXPECT_EQ(this->labels_->cpu_data() + this->batch_size_ * (2 + i % 2),
+        this->label_blob_->cpu_data());
+  }
+  // All the staging buffers are free again.
+  for (int i = 0; i < 3; ++i) {
+    layer->StageArrays(this->data_->cpu_data(), this->labels_->cpu_data(),
+        this->batch_size_);
+  }
+}
+
 #ifdef USE_OPENCV
 TYPED_TEST(MemoryDataLayerTest, AddDatumVectorDefaultTransform) {
   typedef typename TypeParam::Dtype Dtype;
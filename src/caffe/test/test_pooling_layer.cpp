@@ -6,6 +6,7 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/pooling_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #ifdef USE_CUDNN
 #include "caffe/layers/cudnn_pooling_layer.hpp"
@@ -45,6 +46,74 @@ class PoolingLayerTest : public MultiDeviceTest<TypeParam> {
   Blob<Dtype>* const blob_top_mask_;
   vector<Blob<Dtype>*> blob_bottom_vec_;
   vector<Blob<Dtype>*> blob_top_vec_;
+  // Runs pooling forward and backward on num_threads CPU threads, over
+  // enough planes for the planes to be split among the threads, and copies
+  // the top, the mask (for MAX pooling with a top mask) and the bottom diff.
+  void ForwardBackwardThreads(PoolingParameter_PoolMethod pool,
+      bool top_mask, int num_threads, vector<Dtype>* top,
+      vector<Dtype>* mask, vector<Dtype>* bottom_diff) {
+    Caffe::set_random_seed(1701);
+    blob_bottom_->Reshape(4, 64, 16, 16);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(blob_bottom_);
+    blob_top_vec_.resize(1);
+    if (top_mask) {
+      blob_top_vec_.push_back(blob_top_mask_);
+    }
+    LayerParameter layer_param;
+    PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+    pooling_param->set_kernel_size(3);
+    pooling_param->set_stride(2);
+    pooling_param->set_pad(1);
+    pooling_param->set_pool(pool);
+    Caffe::set_cpu_threads(num_threads);
+    PoolingLayer<Dtype> layer(layer_param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    // 256 planes of 16x16 pooled to 9x9, well over one grain of planes.
+    EXPECT_GT(blob_bottom_->num() * blob_bottom_->channels(),
+        CAFFE_CPU_ARITHMETIC_GRAIN /
+        (blob_bottom_->count(2) + blob_top_->count(2)));
+    layer.Forward(blob_bottom_vec_, blob_top_vec_);
+    top->assign(blob_top_->cpu_data(),
+        blob_top_->cpu_data() + blob_top_->count());
+    if (top_mask) {
+      mask->assign(blob_top_mask_->cpu_data(),
+          blob_top_mask_->cpu_data() + blob_top_mask_->count());
+    }
+    Blob<Dtype> top_diff(blob_top_->shape());
+    filler.Fill(&top_diff);
+    caffe_copy(top_diff.count(), top_diff.cpu_data(),
+        blob_top_->mutable_cpu_diff());
+    vector<bool> propagate_down(1, true);
+    layer.Backward(blob_top_vec_, propagate_down, blob_bottom_vec_);
+    Caffe::set_cpu_threads(1);
+    bottom_diff->assign(blob_bottom_->cpu_diff(),
+        blob_bottom_->cpu_diff() + blob_bottom_->count());
+  }
+  // Checks that pooling on 4 threads gives the same top, mask and bottom
+  // diff as on 1.
+  void TestThreadsMatchSequential(PoolingParameter_PoolMethod pool,
+      bool top_mask) {
+    vector<Dtype> expected_top, expected_mask, expected_bottom_diff;
+    ForwardBackwardThreads(pool, top_mask, 1, &expected_top, &expected_mask,
+        &expected_bottom_diff);
+    vector<Dtype> top, mask, bottom_diff;
+    ForwardBackwardThreads(pool, top_mask, 4, &top, &mask, &bottom_diff);
+    ASSERT_EQ(expected_top.size(), top.size());
+    for (int i = 0; i < top.size(); ++i) {
+      ASSERT_EQ(expected_top[i], top[i]) << "top at " << i;
+    }
+    ASSERT_EQ(expected_mask.size(), mask.size());
+    for (int i = 0; i < mask.size(); ++i) {
+      ASSERT_EQ(expected_mask[i], mask[i]) << "mask at " << i;
+    }
+    ASSERT_EQ(expected_bottom_diff.size(), bottom_diff.size());
+    for (int i = 0; i < bottom_diff.size(); ++i) {
+      ASSERT_EQ(expected_bottom_diff[i], bottom_diff[i])
+          << "bottom diff at " << i;
+    }
+  }
   // Test for 2x 2 square pooling layer
   void TestForwardSquare() {
     LayerParameter layer_param;
@@ -609,6 +678,17 @@ TYPED_TEST(PoolingLayerTest, TestGradientAvePadded) {
   }
 }
 
+TYPED_TEST(PoolingLayerTest, TestThreadsMatchSequentialMax) {
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  this->TestThreadsMatchSequential(PoolingParameter_PoolMethod_MAX, false);
+  this->TestThreadsMatchSequential(PoolingParameter_PoolMethod_MAX, true);
+}
+
+TYPED_TEST(PoolingLayerTest, TestThreadsMatchSequentialAve) {
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  this->TestThreadsMatchSequential(PoolingParameter_PoolMethod_AVE, false);
+}
+
 #ifdef USE_CUDNN
 template <typename Dtype>
 class CuDNNPoolingLayerTest : public GPUDeviceTest<Dtype> {
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cmath>
 #include <vector>
 
@@ -74,6 +75,39 @@ TYPED_TEST(SoftmaxLayerTest, TestForward) {
   }
 }
 
+TYPED_TEST(SoftmaxLayerTest, TestForwardRowsInPlace) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Softmax over the last axis, in rows longer than a block of the CPU
+  // kernel and not a multiple of it, in place.
+  vector<int> shape(2);
+  shape[0] = 3;
+  shape[1] = 37;
+  this->blob_bottom_->Reshape(shape);
+  FillerParameter filler_param;
+  filler_param.set_std(10);
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  Blob<Dtype> bottom_copy;
+  bottom_copy.CopyFrom(*this->blob_bottom_, false, true);
+  LayerParameter layer_param;
+  SoftmaxLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_bottom_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_bottom_vec_);
+  for (int i = 0; i < shape[0]; ++i) {
+    const Dtype* x = bottom_copy.cpu_data() + i * shape[1];
+    const Dtype max_x = *std::max_element(x, x + shape[1]);
+    Dtype sum = 0;
+    for (int j = 0; j < shape[1]; ++j) {
+      sum += exp(x[j] - max_x);
+    }
+    for (int j = 0; j < shape[1]; ++j) {
+      const Dtype expected = exp(x[j] - max_x) / sum;
+      EXPECT_NEAR(expected, this->blob_bottom_->cpu_data()[i * shape[1] + j],
+          1e-5 * expected) << "debug: " << i << " " << j;
+    }
+  }
+}
+
 TYPED_TEST(SoftmaxLayerTest, TestGradient) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -84,6 +84,28 @@ TYPED_TEST(SoftmaxWithLossLayerTest, TestForwardIgnoreLabel) {
   EXPECT_NEAR(4 * full_loss, accum_loss, 1e-4);
 }
 
+TYPED_TEST(SoftmaxWithLossLayerTest, TestForwardSmallProbability) {
+  typedef typename TypeParam::Dtype Dtype;
+  // The label has a probability of about exp(-80) / 4, close to FLT_MIN.
+  this->blob_bottom_data_->Reshape(2, 5, 1, 1);
+  this->blob_bottom_label_->Reshape(2, 1, 1, 1);
+  caffe_set(this->blob_bottom_data_->count(), Dtype(0),
+      this->blob_bottom_data_->mutable_cpu_data());
+  this->blob_bottom_data_->mutable_cpu_data()[4] = -80;
+  this->blob_bottom_data_->mutable_cpu_data()[5] = 80;
+  this->blob_bottom_label_->mutable_cpu_data()[0] = 4;
+  this->blob_bottom_label_->mutable_cpu_data()[1] = 0;
+  LayerParameter layer_param;
+  layer_param.mutable_loss_param()->set_normalize(false);
+  SoftmaxWithLossLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Averaged over the batch of two.
+  const Dtype expected =
+      (80 + log(4 + exp(-80.)) + log(1 + 4 * exp(-80.))) / 2;
+  EXPECT_NEAR(expected, this->blob_top_loss_->cpu_data()[0], 1e-5 * expected);
+}
+
 TYPED_TEST(SoftmaxWithLossLayerTest, TestGradientIgnoreLabel) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
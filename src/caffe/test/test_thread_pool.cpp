@@ -0,0 +1,70 @@
+#include <boost/bind.hpp>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ThreadPoolTest : public ::testing::Test {};
+
+static void SetSquare(int i, vector<int>* out) {
+  (*out)[i] = i * i;
+}
+
+TEST_F(ThreadPoolTest, TestParallelForCoversRange) {
+  const int n = 1000;
+  for (int num_threads = 1; num_threads <= 4; ++num_threads) {
+    ThreadPool pool(num_threads);
+    EXPECT_EQ(num_threads, pool.num_threads());
+    // Run several jobs on the same pool to exercise worker reuse.
+    for (int iter = 0; iter < 3; ++iter) {
+      vector<int> out(n, -1);
+      pool.ParallelFor(n, boost::bind(&SetSquare, _1, &out));
+      for (int i = 0; i < n; ++i) {
+        EXPECT_EQ(i * i, out[i]);
+      }
+    }
+  }
+}
+
+// Counts the visits of [begin, end) in *out, checking the size.
+static void CountRange(int begin, int end, int grain, vector<int>* out) {
+  EXPECT_LT(begin, end);
+  EXPECT_LE(end - begin, grain);
+  for (int i = begin; i < end; ++i) {
+    ++(*out)[i];
+  }
+}
+
+TEST_F(ThreadPoolTest, TestParallelForRangeCoversRange) {
+  const int sizes[] = {1, 7, 1000, 4099};
+  const int grains[] = {1, 3, 64, 5000};
+  for (int num_threads = 2; num_threads <= 4; ++num_threads) {
+    ThreadPool pool(num_threads);
+    for (int s = 0; s < 4; ++s) {
+      for (int g = 0; g < 4; ++g) {
+        vector<int> out(sizes[s], 0);
+        pool.ParallelForRange(sizes[s], grains[g],
+            boost::bind(&CountRange, _1, _2, grains[g], &out));
+        for (int i = 0; i < sizes[s]; ++i) {
+          ASSERT_EQ(1, out[i]) << "size " << sizes[s] << " grain "
+              << grains[g] << " at " << i;
+        }
+      }
+    }
+  }
+}
+
+TEST_F(ThreadPoolTest, TestParallelForEmpty) {
+  ThreadPool pool(2);
+  vector<int> out;
+  pool.ParallelFor(0, boost::bind(&SetSquare, _1, &out));
+  EXPECT_EQ(0, out.size());
+}
+
+}  // namespace caffe
@@ -0,0 +1,128 @@
+#ifdef USE_OPENCV
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layers/window_data_layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class WindowDataLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  WindowDataLayerTest()
+      : seed_(1701),
+        blob_top_data_(new Blob<Dtype>()),
+        blob_top_label_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    blob_top_vec_.push_back(blob_top_data_);
+    blob_top_vec_.push_back(blob_top_label_);
+    // Create a window file of two images, with windows of both images in
+    // the foreground and in the background, some of them reaching the
+    // border of the image.
+    MakeTempFilename(&filename_);
+    std::ofstream outfile(filename_.c_str(), std::ofstream::out);
+    LOG(INFO) << "Using temporary file " << filename_;
+    outfile << "# 0" << std::endl
+        << EXAMPLES_SOURCE_DIR "images/cat.jpg" << std::endl
+        << "3" << std::endl << "360" << std::endl << "480" << std::endl
+        << "3" << std::endl
+        << "1 0.8 10 20 200 300" << std::endl
+        << "2 0.9 100 50 479 359" << std::endl
+        << "0 0.1 0 0 100 100" << std::endl;
+    outfile << "# 1" << std::endl
+        << EXAMPLES_SOURCE_DIR "images/fish-bike.jpg" << std::endl
+        << "3" << std::endl << "323" << std::endl << "481" << std::endl
+        << "3" << std::endl
+        << "1 0.7 50 30 300 250" << std::endl
+        << "0 0.2 200 100 480 322" << std::endl
+        << "3 0.6 0 0 120 90" << std::endl;
+    outfile.close();
+  }
+
+  virtual ~WindowDataLayerTest() {
+    delete blob_top_data_;
+    delete blob_top_label_;
+  }
+
+  // Runs num_batches batches of a layer warping the windows on num_threads
+  // threads, and appends the data and the labels to data and labels.
+  void ReadBatches(int num_threads, bool cache_images, int num_batches,
+      vector<Dtype>* data, vector<Dtype>* labels) {
+    LayerParameter param;
+    WindowDataParameter* window_data_param =
+        param.mutable_window_data_param();
+    window_data_param->set_source(filename_);
+    window_data_param->set_batch_size(8);
+    window_data_param->set_fg_fraction(0.5);
+    window_data_param->set_context_pad(2);
+    window_data_param->set_cache_images(cache_images);
+    TransformationParameter* transform_param =
+        param.mutable_transform_param();
+    transform_param->set_crop_size(15);
+    transform_param->set_mirror(true);
+    transform_param->add_mean_value(100);
+    transform_param->set_num_threads(num_threads);
+    Caffe::set_random_seed(seed_);
+    WindowDataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    EXPECT_EQ(8, blob_top_data_->num());
+    EXPECT_EQ(3, blob_top_data_->channels());
+    EXPECT_EQ(15, blob_top_data_->height());
+    EXPECT_EQ(15, blob_top_data_->width());
+    for (int iter = 0; iter < num_batches; ++iter) {
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+      data->insert(data->end(), blob_top_data_->cpu_data(),
+          blob_top_data_->cpu_data() + blob_top_data_->count());
+      labels->insert(labels->end(), blob_top_label_->cpu_data(),
+          blob_top_label_->cpu_data() + blob_top_label_->count());
+    }
+  }
+
+  int seed_;
+  string filename_;
+  Blob<Dtype>* const blob_top_data_;
+  Blob<Dtype>* const blob_top_label_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(WindowDataLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(WindowDataLayerTest, TestThreadsMatchSequential) {
+  typedef typename TypeParam::Dtype Dtype;
+  for (int cache_images = 0; cache_images < 2; ++cache_images) {
+    vector<Dtype> expected_data, expected_labels;
+    this->ReadBatches(1, cache_images, 3, &expected_data, &expected_labels);
+    vector<Dtype> data, labels;
+    this->ReadBatches(4, cache_images, 3, &data, &labels);
+    ASSERT_EQ(expected_labels.size(), labels.size());
+    int num_fg = 0;
+    for (int i = 0; i < labels.size(); ++i) {
+      EXPECT_EQ(expected_labels[i], labels[i]);
+      num_fg += labels[i] > 0;
+    }
+    // Half of each batch comes from the foreground windows.
+    EXPECT_EQ(static_cast<int>(labels.size()) / 2, num_fg);
+    ASSERT_EQ(expected_data.size(), data.size());
+    int num_nonzero = 0;
+    for (int i = 0; i < data.size(); ++i) {
+      ASSERT_EQ(expected_data[i], data[i]) << "cache_images "
+          << cache_images << " at " << i;
+      num_nonzero += data[i] != 0;
+    }
+    EXPECT_GT(num_nonzero, static_cast<int>(data.size()) / 2);
+  }
+}
+
+}  // namespace caffe
+#endif  // USE_OPENCV
@@ -0,0 +1,88 @@
+#include <boost/thread.hpp>
+#include <map>
+#include <string>
+
+#include "caffe/util/datum_cache.hpp"
+
+namespace caffe {
+
+using boost::weak_ptr;
+
+map<const string, weak_ptr<DatumCache> > DatumCache::caches_;
+static boost::mutex caches_mutex_;
+
+class DatumCache::sync {
+ public:
+  mutable boost::mutex mutex_;
+};
+
+shared_ptr<DatumCache> DatumCache::Get(const string& key, uint64_t capacity) {
+  boost::mutex::scoped_lock lock(caches_mutex_);
+  weak_ptr<DatumCache>& weak = caches_[key];
+  shared_ptr<DatumCache> cache = weak.lock();
+  if (!cache) {
+    cache.reset(new DatumCache(key, capacity));
+    weak = cache;
+    LOG(INFO) << "Caching up to " << capacity << " bytes of samples from "
+        << key;
+  } else if (cache->capacity() != capacity) {
+    LOG(WARNING) << "Sharing the sample cache of " << key << " with a "
+        << "budget of " << cache->capacity() << " bytes instead of "
+        << capacity;
+  }
+  return cache;
+}
+
+DatumCache::DatumCache(const string& key, uint64_t capacity)
+    : key_(key), capacity_(capacity), size_bytes_(0), full_logged_(false),
+      sync_(new sync()) {
+}
+
+DatumCache::~DatumCache() {
+  boost::mutex::scoped_lock lock(caches_mutex_);
+  map<const string, weak_ptr<DatumCache> >::iterator it = caches_.find(key_);
+  if (it != caches_.end() && it->second.expired()) {
+    caches_.erase(it);
+  }
+}
+
+shared_ptr<const Datum> DatumCache::Lookup(const string& name) const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  map<string, shared_ptr<const Datum> >::const_iterator it =
+      datums_.find(name);
+  if (it == datums_.end()) {
+    return shared_ptr<const Datum>();
+  }
+  return it->second;
+}
+
+bool DatumCache::Insert(const string& name, const Datum& datum) {
+  const uint64_t bytes = name.size() + datum.ByteSizeLong();
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  if (datums_.count(name)) {
+    return false;
+  }
+  if (size_bytes_ + bytes > capacity_) {
+    if (!full_logged_) {
+      LOG(INFO) << "Sample cache of " << key_ << " is full after "
+          << datums_.size() << " samples (" << size_bytes_ << " bytes)";
+      full_logged_ = true;
+    }
+    return false;
+  }
+  datums_[name] = shared_ptr<const Datum>(new Datum(datum));
+  size_bytes_ += bytes;
+  return true;
+}
+
+uint64_t DatumCache::size_bytes() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return size_bytes_;
+}
+
+int DatumCache::size() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return datums_.size();
+}
+
+}  // namespace caffe
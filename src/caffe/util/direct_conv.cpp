@@ -0,0 +1,172 @@
+#include <algorithm>
+
+#include "caffe/common.hpp"
+#include "caffe/util/direct_conv.hpp"
+
+namespace caffe {
+
+// Each kernel call computes a tile of kOutputBlock output channels by
+// kOutputTile adjacent outputs of a row, kept in registers over all input
+// channels and taps, so that every input value loaded is used
+// kOutputBlock times and every weight kOutputTile times.
+static const int kOutputBlock = 4;
+static const int kOutputTile = 8;
+
+bool direct_conv_supported(const int kernel_h, const int kernel_w,
+    const int stride_h, const int stride_w) {
+  return kernel_h == kernel_w && stride_h == stride_w &&
+      (kernel_h == 3 || kernel_h == 5 || kernel_h == 7) &&
+      (stride_h == 1 || stride_h == 2);
+}
+
+// Computes a B x kOutputTile tile of row oh, starting at column ow, whose
+// input columns are all inside the image. With K and S known at compile
+// time the loops have constant trip counts, so the compiler unrolls them
+// and keeps the accumulators in (vector) registers.
+template <typename Dtype, int K, int S, int B>
+static inline void direct_conv_tile(const Dtype* data_im, const int channels,
+    const int height, const int width, const Dtype* weights,
+    const int weight_stride, const int pad_h, const int pad_w,
+    const int output_h, const int output_w, const int oh, const int ow,
+    Dtype* data_out) {
+  Dtype sum[B][kOutputTile] = {};
+  const int kh_begin = std::max(0, pad_h - oh * S);
+  const int kh_end = std::min(K, height + pad_h - oh * S);
+  for (int c = 0; c < channels; ++c) {
+    for (int kh = kh_begin; kh < kh_end; ++kh) {
+      const Dtype* in =
+          data_im + (c * height + oh * S - pad_h + kh) * width + ow * S - pad_w;
+      const Dtype* w = weights + (c * K + kh) * K;
+      for (int kw = 0; kw < K; ++kw) {
+        Dtype value[kOutputTile];
+        for (int x = 0; x < kOutputTile; ++x) {
+          value[x] = in[x * S + kw];
+        }
+        for (int b = 0; b < B; ++b) {
+          const Dtype weight = w[b * weight_stride + kw];
+          for (int x = 0; x < kOutputTile; ++x) {
+            sum[b][x] += weight * value[x];
+          }
+        }
+      }
+    }
+  }
+  for (int b = 0; b < B; ++b) {
+    Dtype* out = data_out + (b * output_h + oh) * output_w + ow;
+    for (int x = 0; x < kOutputTile; ++x) {
+      out[x] = sum[b][x];
+    }
+  }
+}
+
+// Computes output (oh, ow) of block output channels, checking the input
+// bounds; used for the columns next to the padding and the last ones.
+template <typename Dtype, int K, int S>
+static void direct_conv_point(const Dtype* data_im, const int channels,
+    const int height, const int width, const Dtype* weights,
+    const int weight_stride, const int block, const int pad_h,
+    const int pad_w, const int output_h, const int output_w, const int oh,
+    const int ow, Dtype* data_out) {
+  const int kh_begin = std::max(0, pad_h - oh * S);
+  const int kh_end = std::min(K, height + pad_h - oh * S);
+  const int kw_begin = std::max(0, pad_w - ow * S);
+  const int kw_end = std::min(K, width + pad_w - ow * S);
+  for (int b = 0; b < block; ++b) {
+    Dtype sum = 0;
+    for (int c = 0; c < channels; ++c) {
+      for (int kh = kh_begin; kh < kh_end; ++kh) {
+        const Dtype* in = data_im +
+            (c * height + oh * S - pad_h + kh) * width + ow * S - pad_w;
+        const Dtype* w = weights + b * weight_stride + (c * K + kh) * K;
+        for (int kw = kw_begin; kw < kw_end; ++kw) {
+          sum += w[kw] * in[kw];
+        }
+      }
+    }
+    data_out[(b * output_h + oh) * output_w + ow] = sum;
+  }
+}
+
+template <typename Dtype, int K, int S>
+static void direct_conv_kernel(const Dtype* data_im, const int channels,
+    const int height, const int width, const Dtype* weights,
+    const int num_output, const int pad_h, const int pad_w,
+    const int output_h, const int output_w, Dtype* data_out) {
+  const int weight_stride = channels * K * K;
+  // Output columns [interior_begin, interior_end) read no padding.
+  const int interior_begin = std::min(output_w, (pad_w + S - 1) / S);
+  const int last = width + pad_w - K;
+  const int interior_end = std::max(interior_begin,
+      last < 0 ? 0 : std::min(output_w, last / S + 1));
+  for (int o = 0; o < num_output; o += kOutputBlock) {
+    const int block = std::min(kOutputBlock, num_output - o);
+    const Dtype* block_weights = weights + o * weight_stride;
+    Dtype* block_out = data_out + o * output_h * output_w;
+    for (int oh = 0; oh < output_h; ++oh) {
+      int ow = 0;
+      for (; ow < interior_begin; ++ow) {
+        direct_conv_point<Dtype, K, S>(data_im, channels, height, width,
+            block_weights, weight_stride, block, pad_h, pad_w, output_h,
+            output_w, oh, ow, block_out);
+      }
+      for (; ow + kOutputTile <= interior_end; ow += kOutputTile) {
+        if (block == kOutputBlock) {
+          direct_conv_tile<Dtype, K, S, kOutputBlock>(data_im, channels,
+              height, width, block_weights, weight_stride, pad_h, pad_w,
+              output_h, output_w, oh, ow, block_out);
+        } else {
+          for (int b = 0; b < block; ++b) {
+            direct_conv_tile<Dtype, K, S, 1>(data_im, channels, height,
+                width, block_weights + b * weight_stride, weight_stride,
+                pad_h, pad_w, output_h, output_w, oh, ow,
+                block_out + b * output_h * output_w);
+          }
+        }
+      }
+      for (; ow < output_w; ++ow) {
+        direct_conv_point<Dtype, K, S>(data_im, channels, height, width,
+            block_weights, weight_stride, block, pad_h, pad_w, output_h,
+            output_w, oh, ow, block_out);
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void direct_conv_cpu(const Dtype* data_im, const int channels,
+    const int height, const int width, const Dtype* weights,
+    const int num_output, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int output_h, const int output_w, Dtype* data_out) {
+  CHECK(direct_conv_supported(kernel_h, kernel_w, stride_h, stride_w))
+      << "No direct convolution for " << kernel_h << "x" << kernel_w
+      << " kernels with stride " << stride_h << "x" << stride_w;
+  void (*kernel)(const Dtype*, int, int, int, const Dtype*, int, int, int,
+      int, int, Dtype*) = NULL;
+  switch (kernel_h * 10 + stride_h) {
+  case 31: kernel = &direct_conv_kernel<Dtype, 3, 1>; break;
+  case 32: kernel = &direct_conv_kernel<Dtype, 3, 2>; break;
+  case 51: kernel = &direct_conv_kernel<Dtype, 5, 1>; break;
+  case 52: kernel = &direct_conv_kernel<Dtype, 5, 2>; break;
+  case 71: kernel = &direct_conv_kernel<Dtype, 7, 1>; break;
+  case 72: kernel = &direct_conv_kernel<Dtype, 7, 2>; break;
+  }
+  kernel(data_im, channels, height, width, weights, num_output, pad_h, pad_w,
+      output_h, output_w, data_out);
+}
+
+// Explicit instantiation
+template void direct_conv_cpu<float>(const float* data_im,
+    const int channels, const int height, const int width,
+    const float* weights, const int num_output, const int kernel_h,
+    const int kernel_w, const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int output_h, const int output_w,
+    float* data_out);
+template void direct_conv_cpu<double>(const double* data_im,
+    const int channels, const int height, const int width,
+    const double* weights, const int num_output, const int kernel_h,
+    const int kernel_w, const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int output_h, const int output_w,
+    double* data_out);
+
+}  // namespace caffe
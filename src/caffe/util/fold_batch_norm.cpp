@@ -0,0 +1,218 @@
+#include <cmath>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/util/fold_batch_norm.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Returns the index of the layer called name in weights, or -1.
+int FindLayer(const NetParameter& weights, const string& name) {
+  for (int i = 0; i < weights.layer_size(); ++i) {
+    if (weights.layer(i).name() == name) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Whether layer is a Convolution or InnerProduct layer whose output
+// channels are on axis 1, i.e. the channels BatchNorm normalizes.
+bool IsFoldTarget(const LayerParameter& layer) {
+  if (layer.bottom_size() != 1 || layer.top_size() != 1) {
+    return false;
+  }
+  if (layer.type() == "Convolution") {
+    return layer.convolution_param().axis() == 1;
+  }
+  if (layer.type() == "InnerProduct") {
+    return layer.inner_product_param().axis() == 1;
+  }
+  return false;
+}
+
+bool IsFoldableBatchNorm(const LayerParameter& layer) {
+  // Nets folded for inference run in the TEST phase, where BatchNorm uses
+  // the stored statistics unless told otherwise.
+  const BatchNormParameter& param = layer.batch_norm_param();
+  return layer.type() == "BatchNorm" && layer.bottom_size() == 1 &&
+      layer.top_size() == 1 &&
+      (!param.has_use_global_stats() || param.use_global_stats());
+}
+
+bool IsFoldableScale(const LayerParameter& layer) {
+  return layer.type() == "Scale" && layer.bottom_size() == 1 &&
+      layer.top_size() == 1 && layer.scale_param().axis() == 1 &&
+      layer.scale_param().num_axes() == 1;
+}
+
+// Multiplies output channel c of the weights of target by scale[c] and sets
+// its bias to bias[c] * scale[c] + shift[c], adding the bias if needed.
+void FoldIntoLayer(const vector<double>& scale, const vector<double>& shift,
+    LayerParameter* target) {
+  const int channels = scale.size();
+  CHECK_GE(target->blobs_size(), 1) << "No weights for " << target->name();
+  Blob<float> weights;
+  weights.FromProto(target->blobs(0));
+  CHECK_EQ(channels * (weights.count() / channels), weights.count())
+      << "Weights of " << target->name() << " do not match " << channels
+      << " channels";
+  float* weight_data = weights.mutable_cpu_data();
+  if (target->type() == "InnerProduct" &&
+      target->inner_product_param().transpose()) {
+    // K x N: the output channels are the columns.
+    for (int i = 0; i < weights.count(); ++i) {
+      weight_data[i] *= scale[i % channels];
+    }
+  } else {
+    const int dim = weights.count() / channels;
+    for (int i = 0; i < weights.count(); ++i) {
+      weight_data[i] *= scale[i / dim];
+    }
+  }
+  // Cleared first, as ToProto leaves double_data and the legacy shape.
+  target->mutable_blobs(0)->Clear();
+  weights.ToProto(target->mutable_blobs(0));
+  Blob<float> bias(vector<int>(1, channels));
+  if (target->blobs_size() > 1) {
+    bias.FromProto(target->blobs(1));
+    CHECK_EQ(channels, bias.count()) << "Bias of " << target->name()
+        << " does not match " << channels << " channels";
+  } else {
+    caffe_set(channels, 0.f, bias.mutable_cpu_data());
+    target->add_blobs();
+  }
+  float* bias_data = bias.mutable_cpu_data();
+  for (int c = 0; c < channels; ++c) {
+    bias_data[c] = bias_data[c] * scale[c] + shift[c];
+  }
+  target->mutable_blobs(1)->Clear();
+  bias.ToProto(target->mutable_blobs(1));
+}
+
+}  // namespace
+
+int FoldBatchNorm(const NetParameter& param, const NetParameter& weights,
+    NetParameter* folded_param, NetParameter* folded_weights) {
+  // readers[i] counts the bottoms reading the blobs written by layer i, so
+  // that in-place chains are told apart from blobs read twice.
+  vector<int> readers(param.layer_size(), 0);
+  std::map<string, int> last_writer;
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer = param.layer(i);
+    for (int j = 0; j < layer.bottom_size(); ++j) {
+      std::map<string, int>::const_iterator it =
+          last_writer.find(layer.bottom(j));
+      if (it != last_writer.end()) {
+        ++readers[it->second];
+      }
+    }
+    for (int j = 0; j < layer.top_size(); ++j) {
+      last_writer[layer.top(j)] = i;
+    }
+  }
+  folded_param->CopyFrom(param);
+  folded_param->clear_layer();
+  NetParameter new_weights(weights);
+  vector<bool> removed(weights.layer_size(), false);
+  int num_folded = 0;
+  for (int i = 0; i < param.layer_size(); ++i) {
+    LayerParameter* layer = folded_param->add_layer();
+    layer->CopyFrom(param.layer(i));
+    if (!IsFoldTarget(*layer) || i + 1 >= param.layer_size() ||
+        readers[i] != 1) {
+      continue;
+    }
+    const LayerParameter& batch_norm = param.layer(i + 1);
+    if (!IsFoldableBatchNorm(batch_norm) ||
+        batch_norm.bottom(0) != layer->top(0)) {
+      continue;
+    }
+    const int target_id = FindLayer(weights, layer->name());
+    const int batch_norm_id = FindLayer(weights, batch_norm.name());
+    if (target_id < 0 || batch_norm_id < 0 ||
+        weights.layer(batch_norm_id).blobs_size() != 3) {
+      LOG(WARNING) << "No weights to fold " << batch_norm.name() << " into "
+          << layer->name();
+      continue;
+    }
+    int scale_id = -1;
+    if (i + 2 < param.layer_size() && readers[i + 1] == 1 &&
+        IsFoldableScale(param.layer(i + 2)) &&
+        param.layer(i + 2).bottom(0) == batch_norm.top(0)) {
+      scale_id = FindLayer(weights, param.layer(i + 2).name());
+      if (scale_id >= 0 && weights.layer(scale_id).blobs_size() == 0) {
+        scale_id = -1;
+      }
+    }
+    // The statistics, as BatchNormLayer uses them with use_global_stats.
+    const LayerParameter& stats = weights.layer(batch_norm_id);
+    Blob<float> mean, variance, factor;
+    mean.FromProto(stats.blobs(0));
+    variance.FromProto(stats.blobs(1));
+    factor.FromProto(stats.blobs(2));
+    const int channels = mean.count();
+    CHECK_EQ(channels, layer->type() == "Convolution" ?
+        layer->convolution_param().num_output() :
+        layer->inner_product_param().num_output())
+        << batch_norm.name() << " does not match the outputs of "
+        << layer->name();
+    const double scale_factor = factor.cpu_data()[0] == 0 ?
+        0 : 1. / factor.cpu_data()[0];
+    const double eps = batch_norm.batch_norm_param().eps();
+    vector<double> scale(channels), shift(channels);
+    for (int c = 0; c < channels; ++c) {
+      scale[c] = 1. / std::sqrt(scale_factor * variance.cpu_data()[c] + eps);
+      shift[c] = -scale_factor * mean.cpu_data()[c] * scale[c];
+    }
+    string top = batch_norm.top(0);
+    removed[batch_norm_id] = true;
+    if (scale_id >= 0) {
+      const LayerParameter& scale_layer = weights.layer(scale_id);
+      Blob<float> gamma;
+      gamma.FromProto(scale_layer.blobs(0));
+      CHECK_EQ(channels, gamma.count());
+      Blob<float> beta(vector<int>(1, channels));
+      if (scale_layer.blobs_size() > 1) {
+        beta.FromProto(scale_layer.blobs(1));
+        CHECK_EQ(channels, beta.count());
+      } else {
+        caffe_set(channels, 0.f, beta.mutable_cpu_data());
+      }
+      for (int c = 0; c < channels; ++c) {
+        scale[c] *= gamma.cpu_data()[c];
+        shift[c] = shift[c] * gamma.cpu_data()[c] + beta.cpu_data()[c];
+      }
+      top = param.layer(i + 2).top(0);
+      removed[scale_id] = true;
+    }
+    FoldIntoLayer(scale, shift, new_weights.mutable_layer(target_id));
+    if (layer->type() == "Convolution") {
+      layer->mutable_convolution_param()->set_bias_term(true);
+    } else {
+      layer->mutable_inner_product_param()->set_bias_term(true);
+    }
+    layer->set_top(0, top);
+    LOG(INFO) << "Folded " << batch_norm.name()
+        << (scale_id >= 0 ? " and " + param.layer(i + 2).name() : "")
+        << " into " << layer->name();
+    ++num_folded;
+    i += scale_id >= 0 ? 2 : 1;
+  }
+  folded_weights->CopyFrom(new_weights);
+  folded_weights->clear_layer();
+  for (int i = 0; i < new_weights.layer_size(); ++i) {
+    if (!removed[i]) {
+      folded_weights->add_layer()->CopyFrom(new_weights.layer(i));
+    }
+  }
+  return num_folded;
+}
+
+}  // namespace caffe
@@ -0,0 +1,472 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "caffe/util/gemm.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+// The micro-kernel keeps a kRows x kCols tile of C in registers: with
+// 16 SSE registers, 8 x 8 floats or 4 x 8 doubles.
+template <typename Dtype> struct GemmTile;
+template <> struct GemmTile<float> {
+  static const int kRows = 8;
+  static const int kCols = 8;
+};
+template <> struct GemmTile<double> {
+  static const int kRows = 4;
+  static const int kCols = 8;
+};
+
+// Cache blocking, as in Goto and van de Geijn, "Anatomy of High-Performance
+// Matrix Multiplication": a kRowBlock x kDepthBlock block of A stays in L2
+// while it is multiplied by a kDepthBlock x kColBlock panel of B, which
+// stays in L3. Both are packed so that the micro-kernel reads them in
+// order.
+static const int kDepthBlock = 256;
+static const int kRowBlock = 128;  // a multiple of GemmTile<>::kRows
+static const int kColBlock = 2048;  // a multiple of GemmTile<>::kCols
+// Products with fewer multiply-adds run on a single thread.
+static const int64_t kMinThreadedWork = 1 << 18;
+
+// op(X) of a product, or its packed copy.
+template <typename Dtype>
+struct GemmOperand {
+  const Dtype* data;
+  bool trans;
+  int ld;
+  // Packed panels of all the depth blocks, in which each depth block
+  // starts padded_size * depth offset elements in, or NULL.
+  const Dtype* packed;
+  int padded_size;
+
+  inline Dtype at(int i, int j) const {
+    return trans ? data[j * ld + i] : data[i * ld + j];
+  }
+};
+
+// Packs rows [i0, i0 + rows) by depth [p0, p0 + depth) of A into panels of
+// kRows rows, zero-padding the last one.
+template <typename Dtype>
+static void gemm_pack_a(const GemmOperand<Dtype>& a, const int i0,
+    const int rows, const int p0, const int depth, Dtype* out) {
+  const int R = GemmTile<Dtype>::kRows;
+  for (int panel = 0; panel < rows; panel += R) {
+    const int panel_rows = std::min(R, rows - panel);
+    for (int k = 0; k < depth; ++k) {
+      for (int r = 0; r < R; ++r) {
+        out[r] = r < panel_rows ? a.at(i0 + panel + r, p0 + k) : Dtype(0);
+      }
+      out += R;
+    }
+  }
+}
+
+// Packs depth [p0, p0 + depth) by columns [j0, j0 + cols) of B into panels
+// of kCols columns, zero-padding the last one.
+template <typename Dtype>
+static void gemm_pack_b(const GemmOperand<Dtype>& b, const int p0,
+    const int depth, const int j0, const int cols, Dtype* out) {
+  const int C = GemmTile<Dtype>::kCols;
+  for (int panel = 0; panel < cols; panel += C) {
+    const int panel_cols = std::min(C, cols - panel);
+    for (int k = 0; k < depth; ++k) {
+      if (!b.trans && panel_cols == C) {
+        const Dtype* row = b.data + (p0 + k) * b.ld + j0 + panel;
+        std::copy(row, row + C, out);
+      } else {
+        for (int c = 0; c < C; ++c) {
+          out[c] = c < panel_cols ? b.at(p0 + k, j0 + panel + c) : Dtype(0);
+        }
+      }
+      out += C;
+    }
+  }
+}
+
+// C = alpha * a * b + beta * C for a kRows x depth panel a and a depth x
+// kCols panel b, storing only the rows x cols corner of the tile. The
+// constant trip counts let the compiler unroll the loops and keep the tile
+// in vector registers.
+template <typename Dtype>
+static inline void gemm_micro_kernel(const int depth, const Dtype* a,
+    const Dtype* b, const Dtype alpha, const Dtype beta, Dtype* c,
+    const int ldc, const int rows, const int cols) {
+  const int R = GemmTile<Dtype>::kRows;
+  const int C = GemmTile<Dtype>::kCols;
+  Dtype ab[R][C] = {};
+  for (int k = 0; k < depth; ++k) {
+    for (int i = 0; i < R; ++i) {
+      const Dtype a_i = a[i];
+      for (int j = 0; j < C; ++j) {
+        ab[i][j] += a_i * b[j];
+      }
+    }
+    a += R;
+    b += C;
+  }
+  for (int i = 0; i < rows; ++i) {
+    Dtype* c_row = c + i * ldc;
+    for (int j = 0; j < cols; ++j) {
+      // C may hold garbage, NaN included, when beta is zero.
+      c_row[j] = (beta == 0 ? Dtype(0) : beta * c_row[j]) + alpha * ab[i][j];
+    }
+  }
+}
+
+// The packing buffers of the calling thread.
+template <typename Dtype>
+static Dtype* gemm_thread_buffer() {
+  static boost::thread_specific_ptr<vector<Dtype> > buffer;
+  if (!buffer.get()) {
+    buffer.reset(new vector<Dtype>(
+        kDepthBlock * (kRowBlock + kColBlock)));
+  }
+  return &(*buffer)[0];
+}
+
+// C = alpha * a * b + beta * C, with a M x K and b K x N.
+template <typename Dtype>
+static void gemm_blocked(const GemmOperand<Dtype>& a,
+    const GemmOperand<Dtype>& b, const int M, const int N, const int K,
+    const Dtype alpha, const Dtype beta, Dtype* C, const int ldc) {
+  if (K == 0) {
+    for (int i = 0; i < M; ++i) {
+      for (int j = 0; j < N; ++j) {
+        C[i * ldc + j] = beta == 0 ? Dtype(0) : beta * C[i * ldc + j];
+      }
+    }
+    return;
+  }
+  const int R = GemmTile<Dtype>::kRows;
+  const int Cols = GemmTile<Dtype>::kCols;
+  Dtype* a_buffer = gemm_thread_buffer<Dtype>();
+  Dtype* b_buffer = a_buffer + kDepthBlock * kRowBlock;
+  for (int jc = 0; jc < N; jc += kColBlock) {
+    const int nc = std::min(kColBlock, N - jc);
+    for (int pc = 0; pc < K; pc += kDepthBlock) {
+      const int kc = std::min(kDepthBlock, K - pc);
+      const Dtype* b_block = b_buffer;
+      if (b.packed) {
+        b_block = b.packed + pc * b.padded_size + jc * kc;
+      } else {
+        gemm_pack_b(b, pc, kc, jc, nc, b_buffer);
+      }
+      // The first depth block scales C by beta, the others add to it.
+      const Dtype block_beta = pc == 0 ? beta : Dtype(1);
+      for (int ic = 0; ic < M; ic += kRowBlock) {
+        const int mc = std::min(kRowBlock, M - ic);
+        const Dtype* a_block = a_buffer;
+        if (a.packed) {
+          a_block = a.packed + pc * a.padded_size + ic * kc;
+        } else {
+          gemm_pack_a(a, ic, mc, pc, kc, a_buffer);
+        }
+        for (int jr = 0; jr < nc; jr += Cols) {
+          for (int ir = 0; ir < mc; ir += R) {
+            gemm_micro_kernel(kc, a_block + ir * kc, b_block + jr * kc,
+                alpha, block_beta, C + (ic + ir) * ldc + jc + jr, ldc,
+                std::min(R, mc - ir), std::min(Cols, nc - jr));
+          }
+        }
+      }
+    }
+  }
+}
+
+// A product split between threads: the columns of C, or its rows when B
+// is packed.
+template <typename Dtype>
+struct GemmJob {
+  GemmOperand<Dtype> a, b;
+  int M, N, K;
+  Dtype alpha, beta;
+  Dtype* C;
+  int num_slices;
+  bool split_rows;
+
+  void Run(int slice) const {
+    const int unit = split_rows ? GemmTile<Dtype>::kRows :
+        GemmTile<Dtype>::kCols;
+    const int size = split_rows ? M : N;
+    const int units = (size + unit - 1) / unit;
+    const int begin = std::min(size, units * slice / num_slices * unit);
+    const int end = std::min(size, units * (slice + 1) / num_slices * unit);
+    if (begin == end) {
+      return;
+    }
+    GemmOperand<Dtype> a_slice = a, b_slice = b;
+    if (split_rows) {
+      a_slice.data += a.trans ? begin : begin * a.ld;
+      gemm_blocked(a_slice, b, end - begin, N, K, alpha, beta,
+          C + begin * N, N);
+    } else {
+      b_slice.data += b.trans ? begin * b.ld : begin;
+      gemm_blocked(a, b_slice, M, end - begin, K, alpha, beta, C + begin, N);
+    }
+  }
+};
+
+class BlasGemm : public GemmBackend {
+ public:
+  virtual void Gemm(const CBLAS_TRANSPOSE TransA,
+      const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+      const float alpha, const float* A, const float* B, const float beta,
+      float* C) {
+    int lda = (TransA == CblasNoTrans) ? K : M;
+    int ldb = (TransB == CblasNoTrans) ? N : K;
+    cblas_sgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B,
+        ldb, beta, C, N);
+  }
+  virtual void Gemm(const CBLAS_TRANSPOSE TransA,
+      const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+      const double alpha, const double* A, const double* B,
+      const double beta, double* C) {
+    int lda = (TransA == CblasNoTrans) ? K : M;
+    int ldb = (TransB == CblasNoTrans) ? N : K;
+    cblas_dgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B,
+        ldb, beta, C, N);
+  }
+};
+
+class CaffeGemm : public GemmBackend {
+ public:
+  CaffeGemm() : num_threads_(1) {}
+
+  virtual void Gemm(const CBLAS_TRANSPOSE TransA,
+      const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+      const float alpha, const float* A, const float* B, const float beta,
+      float* C) {
+    Run(Operand(TransA, M, K, A), Operand(TransB, K, N, B),
+        M, N, K, alpha, beta, C);
+  }
+  virtual void Gemm(const CBLAS_TRANSPOSE TransA,
+      const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+      const double alpha, const double* A, const double* B,
+      const double beta, double* C) {
+    Run(Operand(TransA, M, K, A), Operand(TransB, K, N, B),
+        M, N, K, alpha, beta, C);
+  }
+
+  // op(X) of rows x cols.
+  template <typename Dtype>
+  static GemmOperand<Dtype> Operand(const CBLAS_TRANSPOSE trans,
+      const int rows, const int cols, const Dtype* data) {
+    GemmOperand<Dtype> operand;
+    operand.data = data;
+    operand.trans = trans != CblasNoTrans;
+    operand.ld = operand.trans ? rows : cols;
+    operand.packed = NULL;
+    operand.padded_size = 0;
+    return operand;
+  }
+  // The same, with the packed copy of its panels.
+  template <typename Dtype>
+  static GemmOperand<Dtype> Operand(const CBLAS_TRANSPOSE trans,
+      const int rows, const int cols, const Dtype* data,
+      const Dtype* packed, const int padded_size) {
+    GemmOperand<Dtype> operand = Operand(trans, rows, cols, data);
+    operand.packed = packed;
+    operand.padded_size = padded_size;
+    return operand;
+  }
+
+  template <typename Dtype>
+  void Run(const GemmOperand<Dtype>& a, const GemmOperand<Dtype>& b,
+      const int M, const int N, const int K, const Dtype alpha,
+      const Dtype beta, Dtype* C) {
+    GemmJob<Dtype> job;
+    job.a = a;
+    job.b = b;
+    job.M = M;
+    job.N = N;
+    job.K = K;
+    job.alpha = alpha;
+    job.beta = beta;
+    job.C = C;
+    job.split_rows = b.packed != NULL;
+    const int units = job.split_rows ?
+        (M + GemmTile<Dtype>::kRows - 1) / GemmTile<Dtype>::kRows :
+        (N + GemmTile<Dtype>::kCols - 1) / GemmTile<Dtype>::kCols;
+    job.num_slices = std::min(num_threads_, units);
+    // A product issued while the pool is busy, e.g. by the threads of a
+    // convolution layer, runs on its calling thread.
+    boost::unique_lock<boost::mutex> lock(mutex_, boost::try_to_lock);
+    if (job.num_slices > 1 &&
+        static_cast<int64_t>(M) * N * K >= kMinThreadedWork &&
+        lock.owns_lock() && pool_) {
+      pool_->ParallelFor(job.num_slices,
+          boost::bind(&GemmJob<Dtype>::Run, &job, _1));
+    } else {
+      gemm_blocked(a, b, M, N, K, alpha, beta, C, N);
+    }
+  }
+
+  int thread_count() const { return num_threads_; }
+  void set_thread_count(int num_threads) {
+    boost::mutex::scoped_lock lock(mutex_);
+    num_threads_ = num_threads;
+    pool_.reset(num_threads > 1 ? new ThreadPool(num_threads) : NULL);
+  }
+
+ protected:
+  int num_threads_;
+  shared_ptr<ThreadPool> pool_;
+  boost::mutex mutex_;
+};
+
+struct GemmRegistry {
+  GemmRegistry() : caffe(new CaffeGemm()) {
+    backends["blas"].reset(new BlasGemm());
+    backends["caffe"].reset(caffe);
+    current_name = "blas";
+    current = backends[current_name].get();
+  }
+
+  std::map<string, shared_ptr<GemmBackend> > backends;
+  CaffeGemm* caffe;
+  string current_name;
+  GemmBackend* current;
+};
+
+static GemmRegistry& Registry() {
+  static GemmRegistry registry;
+  return registry;
+}
+
+void GemmBackend::Register(const string& name, GemmBackend* backend) {
+  CHECK_EQ(Registry().backends.count(name), 0)
+      << "GEMM backend " << name << " already registered.";
+  Registry().backends[name].reset(backend);
+}
+
+vector<string> GemmBackend::Names() {
+  vector<string> names;
+  for (std::map<string, shared_ptr<GemmBackend> >::const_iterator it =
+       Registry().backends.begin(); it != Registry().backends.end(); ++it) {
+    names.push_back(it->first);
+  }
+  return names;
+}
+
+GemmBackend* GemmBackend::Get() {
+  return Registry().current;
+}
+
+const string& GemmBackend::name() {
+  return Registry().current_name;
+}
+
+void GemmBackend::Set(const string& name) {
+  CHECK_EQ(Registry().backends.count(name), 1)
+      << "Unknown GEMM backend " << name;
+  Registry().current_name = name;
+  Registry().current = Registry().backends[name].get();
+}
+
+int GemmBackend::num_threads() {
+  return Registry().caffe->thread_count();
+}
+
+void GemmBackend::set_num_threads(int num_threads) {
+  CHECK_GT(num_threads, 0);
+  Registry().caffe->set_thread_count(num_threads);
+}
+
+static inline int gemm_padded(const int size, const int unit) {
+  return (size + unit - 1) / unit * unit;
+}
+
+template <typename Dtype>
+void GemmPackedA<Dtype>::Pack(const CBLAS_TRANSPOSE TransA, const int M,
+    const int K, const Dtype* A) {
+  TransA_ = TransA;
+  M_ = M;
+  K_ = K;
+  A_ = A;
+  backend_ = GemmBackend::Get();
+  packed_.clear();
+  if (backend_ != Registry().caffe) {
+    return;
+  }
+  const int padded_M = gemm_padded(M, GemmTile<Dtype>::kRows);
+  packed_.resize(static_cast<size_t>(padded_M) * K);
+  const GemmOperand<Dtype> a = CaffeGemm::Operand(TransA, M, K, A);
+  for (int pc = 0; pc < K; pc += kDepthBlock) {
+    gemm_pack_a(a, 0, M, pc, std::min(kDepthBlock, K - pc),
+        &packed_[static_cast<size_t>(pc) * padded_M]);
+  }
+}
+
+template <typename Dtype>
+void GemmPackedB<Dtype>::Pack(const CBLAS_TRANSPOSE TransB, const int K,
+    const int N, const Dtype* B) {
+  TransB_ = TransB;
+  K_ = K;
+  N_ = N;
+  B_ = B;
+  backend_ = GemmBackend::Get();
+  packed_.clear();
+  if (backend_ != Registry().caffe) {
+    return;
+  }
+  const int padded_N = gemm_padded(N, GemmTile<Dtype>::kCols);
+  packed_.resize(static_cast<size_t>(padded_N) * K);
+  const GemmOperand<Dtype> b = CaffeGemm::Operand(TransB, K, N, B);
+  for (int pc = 0; pc < K; pc += kDepthBlock) {
+    gemm_pack_b(b, pc, std::min(kDepthBlock, K - pc), 0, N,
+        &packed_[static_cast<size_t>(pc) * padded_N]);
+  }
+}
+
+template <typename Dtype>
+void caffe_cpu_gemm(const GemmPackedA<Dtype>& A,
+    const CBLAS_TRANSPOSE TransB, const int N, const Dtype alpha,
+    const Dtype* B, const Dtype beta, Dtype* C) {
+  if (GemmBackend::Get() != Registry().caffe || A.packed().empty()) {
+    GemmBackend::Get()->Gemm(A.trans(), TransB, A.M(), N, A.K(), alpha,
+        A.source(), B, beta, C);
+    return;
+  }
+  Registry().caffe->Run(CaffeGemm::Operand(A.trans(), A.M(), A.K(),
+      A.source(), &A.packed()[0], gemm_padded(A.M(),
+      GemmTile<Dtype>::kRows)), CaffeGemm::Operand(TransB, A.K(), N, B),
+      A.M(), N, A.K(), alpha, beta, C);
+}
+
+template <typename Dtype>
+void caffe_cpu_gemm(const CBLAS_TRANSPOSE TransA, const int M,
+    const Dtype alpha, const Dtype* A, const GemmPackedB<Dtype>& B,
+    const Dtype beta, Dtype* C) {
+  if (GemmBackend::Get() != Registry().caffe || B.packed().empty()) {
+    GemmBackend::Get()->Gemm(TransA, B.trans(), M, B.N(), B.K(), alpha, A,
+        B.source(), beta, C);
+    return;
+  }
+  Registry().caffe->Run(CaffeGemm::Operand(TransA, M, B.K(), A),
+      CaffeGemm::Operand(B.trans(), B.K(), B.N(), B.source(), &B.packed()[0],
+      gemm_padded(B.N(), GemmTile<Dtype>::kCols)), M, B.N(), B.K(), alpha,
+      beta, C);
+}
+
+INSTANTIATE_CLASS(GemmPackedA);
+INSTANTIATE_CLASS(GemmPackedB);
+
+template void caffe_cpu_gemm<float>(const GemmPackedA<float>& A,
+    const CBLAS_TRANSPOSE TransB, const int N, const float alpha,
+    const float* B, const float beta, float* C);
+template void caffe_cpu_gemm<double>(const GemmPackedA<double>& A,
+    const CBLAS_TRANSPOSE TransB, const int N, const double alpha,
+    const double* B, const double beta, double* C);
+template void caffe_cpu_gemm<float>(const CBLAS_TRANSPOSE TransA,
+    const int M, const float alpha, const float* A,
+    const GemmPackedB<float>& B, const float beta, float* C);
+template void caffe_cpu_gemm<double>(const CBLAS_TRANSPOSE TransA,
+    const int M, const double alpha, const double* A,
+    const GemmPackedB<double>& B, const double beta, double* C);
+
+}  // namespace caffe
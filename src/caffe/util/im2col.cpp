@@ -1,7 +1,10 @@
+#include <boost/bind.hpp>
+#include <algorithm>
 #include <vector>
 
 #include "caffe/util/im2col.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -15,6 +18,71 @@ inline bool is_a_ge_zero_and_a_lt_b(int a, int b) {
   return static_cast<unsigned>(a) < static_cast<unsigned>(b);
 }
 
+// The shape of a 2D im2col or col2im, shared by the channels of an image.
+struct Im2colShape {
+  int height, width, kernel_h, kernel_w, pad_h, pad_w, stride_h, stride_w,
+      dilation_h, dilation_w, output_h, output_w;
+
+  Im2colShape(const int height, const int width, const int kernel_h,
+      const int kernel_w, const int pad_h, const int pad_w,
+      const int stride_h, const int stride_w, const int dilation_h,
+      const int dilation_w)
+      : height(height), width(width), kernel_h(kernel_h), kernel_w(kernel_w),
+        pad_h(pad_h), pad_w(pad_w), stride_h(stride_h), stride_w(stride_w),
+        dilation_h(dilation_h), dilation_w(dilation_w),
+        output_h((height + 2 * pad_h - (dilation_h * (kernel_h - 1) + 1)) /
+            stride_h + 1),
+        output_w((width + 2 * pad_w - (dilation_w * (kernel_w - 1) + 1)) /
+            stride_w + 1) {}
+
+  // The output columns [*begin, *end) whose input column
+  // output_col * stride_w + offset lies in the image; the others are in
+  // the padding.
+  inline void inside_columns(const int offset, int* begin, int* end) const {
+    *begin = std::min(output_w,
+        offset < 0 ? (stride_w - 1 - offset) / stride_w : 0);
+    *end = std::max(*begin, offset < width ?
+        std::min(output_w, (width - offset + stride_w - 1) / stride_w) : 0);
+  }
+};
+
+// Fills the columns of one channel: the padding first, then the inside of
+// each row, a plain copy for stride 1.
+template <typename Dtype>
+static void im2col_channel(const Dtype* data_im, const Im2colShape& shape,
+    Dtype* data_col, const int channel) {
+  const int output_w = shape.output_w;
+  data_im += channel * shape.height * shape.width;
+  data_col += channel * shape.kernel_h * shape.kernel_w * shape.output_h *
+      output_w;
+  for (int kernel_row = 0; kernel_row < shape.kernel_h; kernel_row++) {
+    for (int kernel_col = 0; kernel_col < shape.kernel_w; kernel_col++) {
+      const int offset = -shape.pad_w + kernel_col * shape.dilation_w;
+      int begin, end;
+      shape.inside_columns(offset, &begin, &end);
+      int input_row = -shape.pad_h + kernel_row * shape.dilation_h;
+      for (int output_rows = shape.output_h; output_rows; output_rows--) {
+        if (!is_a_ge_zero_and_a_lt_b(input_row, shape.height)) {
+          std::fill(data_col, data_col + output_w, Dtype(0));
+        } else {
+          const Dtype* data_row = data_im + input_row * shape.width + offset;
+          std::fill(data_col, data_col + begin, Dtype(0));
+          if (shape.stride_w == 1) {
+            std::copy(data_row + begin, data_row + end, data_col + begin);
+          } else {
+            for (int output_col = begin; output_col < end; output_col++) {
+              data_col[output_col] = data_row[output_col * shape.stride_w];
+            }
+          }
+          std::fill(data_col + end, data_col + output_w, Dtype(0));
+        }
+        data_col += output_w;
+        input_row += shape.stride_h;
+      }
+    }
+  }
+}
+
 template <typename Dtype>
 void im2col_cpu(const Dtype* data_im, const int channels,
     const int height, const int width, const int kernel_h, const int kernel_w,
@@ -22,12 +90,64 @@ void im2col_cpu(const Dtype* data_im, const int channels,
     const int stride_h, const int stride_w,
     const int dilation_h, const int dilation_w,
     Dtype* data_col) {
+  im2col_cpu(data_im, channels, height, width, kernel_h, kernel_w, pad_h,
+      pad_w, stride_h, stride_w, dilation_h, dilation_w, data_col, NULL);
+}
+
+template <typename Dtype>
+void im2col_cpu(const Dtype* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w,
+    Dtype* data_col, ThreadPool* pool) {
+  const Im2colShape shape(height, width, kernel_h, kernel_w, pad_h, pad_w,
+      stride_h, stride_w, dilation_h, dilation_w);
+  if (pool && pool->num_threads() > 1 && channels > 1) {
+    pool->ParallelFor(channels, boost::bind(&im2col_channel<Dtype>, data_im,
+        boost::cref(shape), data_col, _1));
+    return;
+  }
+  for (int channel = 0; channel < channels; ++channel) {
+    im2col_channel(data_im, shape, data_col, channel);
+  }
+}
+
+// Explicit instantiation
+template void im2col_cpu<float>(const float* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    float* data_col);
+template void im2col_cpu<double>(const double* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    double* data_col);
+template void im2col_cpu<float>(const float* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    float* data_col, ThreadPool* pool);
+template void im2col_cpu<double>(const double* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    double* data_col, ThreadPool* pool);
+
+template <typename Dtype>
+void im2col_nhwc_cpu(const Dtype* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w,
+    Dtype* data_col) {
   const int output_h = (height + 2 * pad_h -
     (dilation_h * (kernel_h - 1) + 1)) / stride_h + 1;
   const int output_w = (width + 2 * pad_w -
     (dilation_w * (kernel_w - 1) + 1)) / stride_w + 1;
-  const int channel_size = height * width;
-  for (int channel = channels; channel--; data_im += channel_size) {
+  const int row_size = width * channels;
+  for (int channel = 0; channel < channels; ++channel) {
     for (int kernel_row = 0; kernel_row < kernel_h; kernel_row++) {
       for (int kernel_col = 0; kernel_col < kernel_w; kernel_col++) {
         int input_row = -pad_h + kernel_row * dilation_h;
@@ -37,10 +157,11 @@ void im2col_cpu(const Dtype* data_im, const int channels,
               *(data_col++) = 0;
             }
           } else {
+            const Dtype* data_row = data_im + input_row * row_size + channel;
             int input_col = -pad_w + kernel_col * dilation_w;
             for (int output_col = output_w; output_col; output_col--) {
               if (is_a_ge_zero_and_a_lt_b(input_col, width)) {
-                *(data_col++) = data_im[input_row * width + input_col];
+                *(data_col++) = data_row[input_col * channels];
               } else {
                 *(data_col++) = 0;
               }
@@ -55,16 +176,16 @@ void im2col_cpu(const Dtype* data_im, const int channels,
 }
 
 // Explicit instantiation
-template void im2col_cpu<float>(const float* data_im, const int channels,
-    const int height, const int width, const int kernel_h, const int kernel_w,
-    const int pad_h, const int pad_w, const int stride_h,
-    const int stride_w, const int dilation_h, const int dilation_w,
-    float* data_col);
-template void im2col_cpu<double>(const double* data_im, const int channels,
-    const int height, const int width, const int kernel_h, const int kernel_w,
-    const int pad_h, const int pad_w, const int stride_h,
-    const int stride_w, const int dilation_h, const int dilation_w,
-    double* data_col);
+template void im2col_nhwc_cpu<float>(const float* data_im,
+    const int channels, const int height, const int width,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, float* data_col);
+template void im2col_nhwc_cpu<double>(const double* data_im,
+    const int channels, const int height, const int width,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, double* data_col);
 
 template <typename Dtype>
 inline void im2col_nd_core_cpu(const Dtype* data_input, const bool im2col,
@@ -159,6 +280,42 @@ template void im2col_nd_cpu<double>(const double* data_im,
     const int* kernel_shape, const int* pad, const int* stride,
     const int* dilation, double* data_col);
 
+// Sums the columns of one channel back into the image, skipping the
+// padding; a contiguous loop for stride 1.
+template <typename Dtype>
+static void col2im_channel(const Dtype* data_col, const Im2colShape& shape,
+    Dtype* data_im, const int channel) {
+  const int output_w = shape.output_w;
+  data_im += channel * shape.height * shape.width;
+  data_col += channel * shape.kernel_h * shape.kernel_w * shape.output_h *
+      output_w;
+  std::fill(data_im, data_im + shape.height * shape.width, Dtype(0));
+  for (int kernel_row = 0; kernel_row < shape.kernel_h; kernel_row++) {
+    for (int kernel_col = 0; kernel_col < shape.kernel_w; kernel_col++) {
+      const int offset = -shape.pad_w + kernel_col * shape.dilation_w;
+      int begin, end;
+      shape.inside_columns(offset, &begin, &end);
+      int input_row = -shape.pad_h + kernel_row * shape.dilation_h;
+      for (int output_rows = shape.output_h; output_rows; output_rows--) {
+        if (is_a_ge_zero_and_a_lt_b(input_row, shape.height)) {
+          Dtype* data_row = data_im + input_row * shape.width + offset;
+          if (shape.stride_w == 1) {
+            for (int output_col = begin; output_col < end; output_col++) {
+              data_row[output_col] += data_col[output_col];
+            }
+          } else {
+            for (int output_col = begin; output_col < end; output_col++) {
+              data_row[output_col * shape.stride_w] += data_col[output_col];
+            }
+          }
+        }
+        data_col += output_w;
+        input_row += shape.stride_h;
+      }
+    }
+  }
+}
+
 template <typename Dtype>
 void col2im_cpu(const Dtype* data_col, const int channels,
     const int height, const int width, const int kernel_h, const int kernel_w,
@@ -166,13 +323,65 @@ void col2im_cpu(const Dtype* data_col, const int channels,
     const int stride_h, const int stride_w,
     const int dilation_h, const int dilation_w,
     Dtype* data_im) {
+  col2im_cpu(data_col, channels, height, width, kernel_h, kernel_w, pad_h,
+      pad_w, stride_h, stride_w, dilation_h, dilation_w, data_im, NULL);
+}
+
+template <typename Dtype>
+void col2im_cpu(const Dtype* data_col, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w,
+    Dtype* data_im, ThreadPool* pool) {
+  const Im2colShape shape(height, width, kernel_h, kernel_w, pad_h, pad_w,
+      stride_h, stride_w, dilation_h, dilation_w);
+  if (pool && pool->num_threads() > 1 && channels > 1) {
+    pool->ParallelFor(channels, boost::bind(&col2im_channel<Dtype>, data_col,
+        boost::cref(shape), data_im, _1));
+    return;
+  }
+  for (int channel = 0; channel < channels; ++channel) {
+    col2im_channel(data_col, shape, data_im, channel);
+  }
+}
+
+// Explicit instantiation
+template void col2im_cpu<float>(const float* data_col, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    float* data_im);
+template void col2im_cpu<double>(const double* data_col, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    double* data_im);
+template void col2im_cpu<float>(const float* data_col, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    float* data_im, ThreadPool* pool);
+template void col2im_cpu<double>(const double* data_col, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    double* data_im, ThreadPool* pool);
+
+template <typename Dtype>
+void col2im_nhwc_cpu(const Dtype* data_col, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w,
+    Dtype* data_im) {
   caffe_set(height * width * channels, Dtype(0), data_im);
   const int output_h = (height + 2 * pad_h -
     (dilation_h * (kernel_h - 1) + 1)) / stride_h + 1;
   const int output_w = (width + 2 * pad_w -
     (dilation_w * (kernel_w - 1) + 1)) / stride_w + 1;
-  const int channel_size = height * width;
-  for (int channel = channels; channel--; data_im += channel_size) {
+  const int row_size = width * channels;
+  for (int channel = 0; channel < channels; ++channel) {
     for (int kernel_row = 0; kernel_row < kernel_h; kernel_row++) {
       for (int kernel_col = 0; kernel_col < kernel_w; kernel_col++) {
         int input_row = -pad_h + kernel_row * dilation_h;
@@ -180,10 +389,11 @@ void col2im_cpu(const Dtype* data_col, const int channels,
           if (!is_a_ge_zero_and_a_lt_b(input_row, height)) {
             data_col += output_w;
           } else {
+            Dtype* data_row = data_im + input_row * row_size + channel;
             int input_col = -pad_w + kernel_col * dilation_w;
             for (int output_col = output_w; output_col; output_col--) {
               if (is_a_ge_zero_and_a_lt_b(input_col, width)) {
-                data_im[input_row * width + input_col] += *data_col;
+                data_row[input_col * channels] += *data_col;
               }
               data_col++;
               input_col += stride_w;
@@ -197,16 +407,16 @@ void col2im_cpu(const Dtype* data_col, const int channels,
 }
 
 // Explicit instantiation
-template void col2im_cpu<float>(const float* data_col, const int channels,
-    const int height, const int width, const int kernel_h, const int kernel_w,
-    const int pad_h, const int pad_w, const int stride_h,
-    const int stride_w, const int dilation_h, const int dilation_w,
-    float* data_im);
-template void col2im_cpu<double>(const double* data_col, const int channels,
-    const int height, const int width, const int kernel_h, const int kernel_w,
-    const int pad_h, const int pad_w, const int stride_h,
-    const int stride_w, const int dilation_h, const int dilation_w,
-    double* data_im);
+template void col2im_nhwc_cpu<float>(const float* data_col,
+    const int channels, const int height, const int width,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, float* data_im);
+template void col2im_nhwc_cpu<double>(const double* data_col,
+    const int channels, const int height, const int width,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, double* data_im);
 
 template <typename Dtype>
 void col2im_nd_cpu(const Dtype* data_col, const int num_spatial_axes,
@@ -23,6 +23,14 @@
 
 const int kProtoReadBytesLimit = INT_MAX;  // Max size of 2 GB minus 1 byte.
 
+#ifdef USE_OPENCV
+// IMREAD_REDUCED_* let libjpeg decode at 1/2, 1/4 or 1/8 of the full size.
+#if !defined(CV_VERSION_EPOCH) && (CV_VERSION_MAJOR > 3 || \
+    (CV_VERSION_MAJOR == 3 && CV_VERSION_MINOR >= 2))
+#define CAFFE_REDUCED_DECODE
+#endif
+#endif  // USE_OPENCV
+
 namespace caffe {
 
     using google::protobuf::io::FileInputStream;
@@ -128,33 +136,98 @@ namespace caffe {
     }
 
 #ifdef USE_OPENCV
-    cv::Mat ReadImageToCVMat(const string& filename,
+#ifdef CAFFE_REDUCED_DECODE
+    // Reads the size of a JPEG image from its frame header.
+    static bool JPEGSize(const string& buffer, int* height, int* width) {
+        const uchar* data = reinterpret_cast<const uchar*>(buffer.data());
+        const size_t size = buffer.size();
+        if (size < 4 || data[0] != 0xFF || data[1] != 0xD8) {
+            return false;
+        }
+        size_t pos = 2;
+        while (pos + 4 <= size) {
+            if (data[pos] != 0xFF) {
+                return false;
+            }
+            const uchar marker = data[pos + 1];
+            if (marker == 0xFF) {  // fill byte
+                ++pos;
+                continue;
+            }
+            // SOF0 to SOF15, except DHT, JPG and DAC
+            if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 &&
+                    marker != 0xC8 && marker != 0xCC) {
+                if (pos + 9 > size) {
+                    return false;
+                }
+                *height = (data[pos + 5] << 8) | data[pos + 6];
+                *width = (data[pos + 7] << 8) | data[pos + 8];
+                return true;
+            }
+            pos += 2 + ((data[pos + 2] << 8) | data[pos + 3]);
+        }
+        return false;
+    }
+#endif  // CAFFE_REDUCED_DECODE
+
+    // Returns the imdecode flag of an image to be resized to height x width.
+    // JPEG images are decoded at the smallest 1/2, 1/4 or 1/8 scale that
+    // is still at least that large, whichever way round the image is.
+    static int ReadFlag(const string& buffer, const int height,
+            const int width, const bool is_color) {
+#ifdef CAFFE_REDUCED_DECODE
+        int jpeg_height, jpeg_width;
+        if (height > 0 && width > 0 &&
+                JPEGSize(buffer, &jpeg_height, &jpeg_width)) {
+            const int source = std::min(jpeg_height, jpeg_width);
+            const int target = std::max(height, width);
+            if (source >= 8 * target) {
+                return is_color ? cv::IMREAD_REDUCED_COLOR_8 :
+                    cv::IMREAD_REDUCED_GRAYSCALE_8;
+            } else if (source >= 4 * target) {
+                return is_color ? cv::IMREAD_REDUCED_COLOR_4 :
+                    cv::IMREAD_REDUCED_GRAYSCALE_4;
+            } else if (source >= 2 * target) {
+                return is_color ? cv::IMREAD_REDUCED_COLOR_2 :
+                    cv::IMREAD_REDUCED_GRAYSCALE_2;
+            }
+        }
+#endif  // CAFFE_REDUCED_DECODE
+        return is_color ? CV_LOAD_IMAGE_COLOR : CV_LOAD_IMAGE_GRAYSCALE;
+    }
+
+    cv::Mat ReadImageToCVMatReduced(const string& filename,
             const int height, const int width, const bool is_color) {
-        cv::Mat cv_img, cv_img_origin;
+        cv::Mat cv_img;
         int cv_read_flag = (is_color ? CV_LOAD_IMAGE_COLOR :
                 CV_LOAD_IMAGE_GRAYSCALE);
 
+        // Images to be resized are read first, so that they can be decoded
+        // at a reduced size.
         StringPiece src_filename = StringPiece(filename);
-        if(src_filename.starts_with("hdfs://")) {
-            HadoopFileSystem hdfs;
-            unsigned long long size;
-            hdfs.GetFileSize(src_filename.ToString(), &size);
-            std::shared_ptr<RandomAccessFile> raf;
-            hdfs.NewRandomAccessFile(src_filename.ToString(), &raf);
-
-            char* ch = new char[size + 1]();
-            StringPiece sp;
-            raf->Read(0, size, &sp, ch);
-            std::vector<char> vec_data(sp.data(), sp.data() + sp.size());
-            cv_img_origin = cv::imdecode(vec_data, cv_read_flag);
-
-            delete ch;
+        if (src_filename.starts_with("hdfs://") || (height > 0 && width > 0)) {
+            string buffer;
+            if (ReadFileToString(filename, &buffer) && !buffer.empty()) {
+                cv_img = cv::imdecode(
+                    cv::Mat(1, buffer.size(), CV_8UC1, &buffer[0]),
+                    ReadFlag(buffer, height, width, is_color));
+            }
         } else {
-            cv_img_origin = cv::imread(filename, cv_read_flag);
+            cv_img = cv::imread(filename, cv_read_flag);
         }
 
-        if (!cv_img_origin.data) {
+        if (!cv_img.data) {
             LOG(ERROR) << "Could not open or find file " << filename;
+        }
+        return cv_img;
+    }
+
+    cv::Mat ReadImageToCVMat(const string& filename,
+            const int height, const int width, const bool is_color) {
+        cv::Mat cv_img;
+        cv::Mat cv_img_origin = ReadImageToCVMatReduced(filename, height,
+                width, is_color);
+        if (!cv_img_origin.data) {
             return cv_img_origin;
         }
         if (height > 0 && width > 0) {
@@ -220,6 +293,43 @@ namespace caffe {
     }
 #endif  // USE_OPENCV
 
+    bool ReadFileToString(const string& filename, string* contents) {
+        StringPiece src_filename = StringPiece(filename);
+        if (src_filename.starts_with("hdfs://")) {
+            HadoopFileSystem hdfs;
+            uint64 size;
+            Status s = hdfs.GetFileSize(filename, &size);
+            if (!s.ok()) {
+                return false;
+            }
+            std::shared_ptr<RandomAccessFile> raf;
+            s = hdfs.NewRandomAccessFile(filename, &raf);
+            if (!s.ok()) {
+                return false;
+            }
+            contents->resize(size);
+            StringPiece sp;
+            if (!raf->Read(0, size, &sp, &(*contents)[0]).ok() ||
+                    sp.size() != size) {
+                return false;
+            }
+            // The reader may return the bytes in its own buffer.
+            if (sp.data() != contents->data()) {
+                contents->assign(sp.data(), sp.size());
+            }
+            return true;
+        }
+
+        fstream file(filename.c_str(), ios::in|ios::binary|ios::ate);
+        if (!file.is_open()) {
+            return false;
+        }
+        contents->resize(file.tellg());
+        file.seekg(0, ios::beg);
+        file.read(&(*contents)[0], contents->size());
+        return !file.fail();
+    }
+
     bool ReadFileToDatum(const string& filename, const int label,
             Datum* datum) {
         HadoopFileSystem hdfs;
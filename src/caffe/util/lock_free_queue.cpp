@@ -0,0 +1,228 @@
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <string>
+#include <vector>
+
+#include "caffe/layers/base_data_layer.hpp"
+#include "caffe/layers/memory_data_layer.hpp"
+#include "caffe/util/lock_free_queue.hpp"
+
+namespace caffe {
+
+// Failed attempts of a blocking call before it yields, then parks.
+static const int kSpinCount = 1000;
+static const int kYieldCount = 50;
+
+template<typename T>
+class LockFreeQueue<T>::sync {
+ public:
+  struct Cell {
+    boost::atomic<size_t> sequence;
+    T data;
+  };
+
+  explicit sync(size_t capacity)
+      : cells_(new Cell[capacity]), mask_(capacity - 1), enqueue_pos_(0),
+        dequeue_pos_(0), waiters_(0) {
+    for (size_t i = 0; i < capacity; ++i) {
+      cells_[i].sequence.store(i, boost::memory_order_relaxed);
+    }
+  }
+  ~sync() {
+    delete[] cells_;
+  }
+
+  bool enqueue(const T& t) {
+    size_t pos = enqueue_pos_.load(boost::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+      cell = &cells_[pos & mask_];
+      const size_t sequence = cell->sequence.load(boost::memory_order_acquire);
+      const ptrdiff_t diff =
+          static_cast<ptrdiff_t>(sequence) - static_cast<ptrdiff_t>(pos);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+            boost::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;  // full
+      } else {
+        pos = enqueue_pos_.load(boost::memory_order_relaxed);
+      }
+    }
+    cell->data = t;
+    cell->sequence.store(pos + 1, boost::memory_order_release);
+    return true;
+  }
+
+  bool dequeue(T* t) {
+    size_t pos = dequeue_pos_.load(boost::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+      cell = &cells_[pos & mask_];
+      const size_t sequence = cell->sequence.load(boost::memory_order_acquire);
+      const ptrdiff_t diff =
+          static_cast<ptrdiff_t>(sequence) - static_cast<ptrdiff_t>(pos + 1);
+      if (diff == 0) {
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1,
+            boost::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;  // empty
+      } else {
+        pos = dequeue_pos_.load(boost::memory_order_relaxed);
+      }
+    }
+    *t = cell->data;
+    cell->sequence.store(pos + mask_ + 1, boost::memory_order_release);
+    return true;
+  }
+
+  bool front(T* t) {
+    const size_t pos = dequeue_pos_.load(boost::memory_order_relaxed);
+    Cell* cell = &cells_[pos & mask_];
+    if (cell->sequence.load(boost::memory_order_acquire) != pos + 1) {
+      return false;
+    }
+    *t = cell->data;
+    return true;
+  }
+
+  // Wakes up parked threads, if any, after a push or a pop.
+  void notify() {
+    boost::atomic_thread_fence(boost::memory_order_seq_cst);
+    if (waiters_.load(boost::memory_order_relaxed) > 0) {
+      boost::mutex::scoped_lock lock(mutex_);
+      condition_.notify_all();
+    }
+  }
+
+  // Counts the calling thread in waiters_ for its lifetime, so that the
+  // count also drops when a wait is interrupted by boost::thread_interrupted.
+  class WaiterCount {
+   public:
+    explicit WaiterCount(boost::atomic<int>* waiters) : waiters_(waiters) {
+      ++*waiters_;
+    }
+    ~WaiterCount() { --*waiters_; }
+
+   private:
+    boost::atomic<int>* waiters_;
+  };
+
+  Cell* const cells_;
+  const size_t mask_;
+  // Keep the producer and consumer positions on separate cache lines.
+  char pad0_[64];
+  boost::atomic<size_t> enqueue_pos_;
+  char pad1_[64];
+  boost::atomic<size_t> dequeue_pos_;
+  char pad2_[64];
+  // Threads parked on condition_.
+  boost::atomic<int> waiters_;
+  boost::mutex mutex_;
+  boost::condition_variable condition_;
+};
+
+template<typename T>
+LockFreeQueue<T>::LockFreeQueue(int capacity) {
+  CHECK_GT(capacity, 0);
+  capacity_ = 1;
+  while (capacity_ < capacity) {
+    capacity_ *= 2;
+  }
+  sync_.reset(new sync(capacity_));
+}
+
+template<typename T>
+LockFreeQueue<T>::~LockFreeQueue() {
+}
+
+template<typename T>
+template<typename Op>
+void LockFreeQueue<T>::wait(Op try_op, const string& log_on_wait) {
+  for (int i = 0; i < kSpinCount; ++i) {
+    if (try_op()) {
+      return;
+    }
+  }
+  for (int i = 0; i < kYieldCount; ++i) {
+    boost::this_thread::yield();
+    if (try_op()) {
+      return;
+    }
+  }
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  typename sync::WaiterCount waiter(&sync_->waiters_);
+  boost::atomic_thread_fence(boost::memory_order_seq_cst);
+  while (!try_op()) {
+    if (!log_on_wait.empty()) {
+      LOG_EVERY_N(INFO, 1000)<< log_on_wait;
+    }
+    sync_->condition_.wait(lock);
+  }
+}
+
+template<typename T>
+void LockFreeQueue<T>::push(const T& t) {
+  wait(boost::bind(&sync::enqueue, sync_.get(), boost::cref(t)), "");
+  sync_->notify();
+}
+
+template<typename T>
+bool LockFreeQueue<T>::try_push(const T& t) {
+  if (!sync_->enqueue(t)) {
+    return false;
+  }
+  sync_->notify();
+  return true;
+}
+
+template<typename T>
+bool LockFreeQueue<T>::try_pop(T* t) {
+  if (!sync_->dequeue(t)) {
+    return false;
+  }
+  sync_->notify();
+  return true;
+}
+
+template<typename T>
+T LockFreeQueue<T>::pop(const string& log_on_wait) {
+  T t;
+  wait(boost::bind(&sync::dequeue, sync_.get(), &t), log_on_wait);
+  sync_->notify();
+  return t;
+}
+
+template<typename T>
+bool LockFreeQueue<T>::try_peek(T* t) {
+  return sync_->front(t);
+}
+
+template<typename T>
+T LockFreeQueue<T>::peek() {
+  T t;
+  wait(boost::bind(&sync::front, sync_.get(), &t), "");
+  return t;
+}
+
+template<typename T>
+size_t LockFreeQueue<T>::size() const {
+  // Read the consumer position first, it never passes the producer one.
+  const size_t dequeue_pos = sync_->dequeue_pos_.load();
+  return sync_->enqueue_pos_.load() - dequeue_pos;
+}
+
+template class LockFreeQueue<Batch<float>*>;
+template class LockFreeQueue<Batch<double>*>;
+template class LockFreeQueue<Datum*>;
+template class LockFreeQueue<int>;
+template class LockFreeQueue<vector<Datum*>*>;
+template class LockFreeQueue<MemoryDataLayer<float>::Buffer*>;
+template class LockFreeQueue<MemoryDataLayer<double>::Buffer*>;
+
+}  // namespace caffe
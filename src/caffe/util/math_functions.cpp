@@ -1,9 +1,15 @@
+#include <boost/bind.hpp>
 #include <boost/math/special_functions/next.hpp>
 #include <boost/random.hpp>
 
+#include <algorithm>
 #include <limits>
+#include <numeric>
+#include <vector>
 
 #include "caffe/common.hpp"
+#include "caffe/util/fast_math.hpp"
+#include "caffe/util/gemm.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/rng.hpp"
 
@@ -14,10 +20,7 @@ void caffe_cpu_gemm<float>(const CBLAS_TRANSPOSE TransA,
     const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
     const float alpha, const float* A, const float* B, const float beta,
     float* C) {
-  int lda = (TransA == CblasNoTrans) ? K : M;
-  int ldb = (TransB == CblasNoTrans) ? N : K;
-  cblas_sgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B,
-      ldb, beta, C, N);
+  GemmBackend::Get()->Gemm(TransA, TransB, M, N, K, alpha, A, B, beta, C);
 }
 
 template<>
@@ -25,10 +28,7 @@ void caffe_cpu_gemm<double>(const CBLAS_TRANSPOSE TransA,
     const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
     const double alpha, const double* A, const double* B, const double beta,
     double* C) {
-  int lda = (TransA == CblasNoTrans) ? K : M;
-  int ldb = (TransB == CblasNoTrans) ? N : K;
-  cblas_dgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B,
-      ldb, beta, C, N);
+  GemmBackend::Get()->Gemm(TransA, TransB, M, N, K, alpha, A, B, beta, C);
 }
 
 template <>
@@ -53,33 +53,104 @@ template <>
 void caffe_axpy<double>(const int N, const double alpha, const double* X,
     double* Y) { cblas_daxpy(N, alpha, X, 1, Y, 1); }
 
+// Ranges of the element-wise functions below, for caffe_parallel_for: fn
+// is a vector function in the style of vsAdd, applied to [begin, end).
+template <typename Fn, typename Dtype>
+static void unary_range(Fn fn, const Dtype* a, Dtype* y, const int begin,
+    const int end) {
+  fn(end - begin, a + begin, y + begin);
+}
+
+template <typename Fn, typename Dtype>
+static void binary_range(Fn fn, const Dtype* a, const Dtype* b, Dtype* y,
+    const int begin, const int end) {
+  fn(end - begin, a + begin, b + begin, y + begin);
+}
+
+template <typename Fn, typename Dtype>
+static void powx_range(Fn fn, const Dtype* a, const Dtype b, Dtype* y,
+    const int begin, const int end) {
+  fn(end - begin, a + begin, b, y + begin);
+}
+
+template <typename Fn, typename Dtype>
+static void parallel_unary(const int n, const int grain, Fn fn,
+    const Dtype* a, Dtype* y) {
+  caffe_parallel_for(n, grain,
+      boost::bind(&unary_range<Fn, Dtype>, fn, a, y, _1, _2));
+}
+
+template <typename Fn, typename Dtype>
+static void parallel_binary(const int n, Fn fn, const Dtype* a,
+    const Dtype* b, Dtype* y) {
+  caffe_parallel_for(n, CAFFE_CPU_ARITHMETIC_GRAIN,
+      boost::bind(&binary_range<Fn, Dtype>, fn, a, b, y, _1, _2));
+}
+
+template <typename Fn, typename Dtype>
+static void parallel_powx(const int n, Fn fn, const Dtype* a, const Dtype b,
+    Dtype* y) {
+  caffe_parallel_for(n, CAFFE_CPU_TRANSCENDENTAL_GRAIN,
+      boost::bind(&powx_range<Fn, Dtype>, fn, a, b, y, _1, _2));
+}
+
+// fast_math_map over Op, as a vector function.
+template <typename Op>
+struct FastMathFn {
+  template <typename Dtype>
+  void operator()(const int n, const Dtype* a, Dtype* y) const {
+    fast_math_map(n, a, y, Op());
+  }
+};
+
 template <typename Dtype>
-void caffe_set(const int N, const Dtype alpha, Dtype* Y) {
+static void set_range(const Dtype alpha, Dtype* Y, const int begin,
+    const int end) {
   if (alpha == 0) {
-    memset(Y, 0, sizeof(Dtype) * N);  // NOLINT(caffe/alt_fn)
+    // NOLINT_NEXT_LINE(caffe/alt_fn)
+    memset(Y + begin, 0, sizeof(Dtype) * (end - begin));
     return;
   }
-  for (int i = 0; i < N; ++i) {
+  for (int i = begin; i < end; ++i) {
     Y[i] = alpha;
   }
 }
 
+template <typename Dtype>
+void caffe_set(const int N, const Dtype alpha, Dtype* Y) {
+  caffe_parallel_for(N, CAFFE_CPU_ARITHMETIC_GRAIN,
+      boost::bind(&set_range<Dtype>, alpha, Y, _1, _2));
+}
+
 template void caffe_set<int>(const int N, const int alpha, int* Y);
 template void caffe_set<float>(const int N, const float alpha, float* Y);
 template void caffe_set<double>(const int N, const double alpha, double* Y);
 
-template <>
-void caffe_add_scalar(const int N, const float alpha, float* Y) {
-  for (int i = 0; i < N; ++i) {
+template <typename Dtype>
+static void add_scalar_range(const Dtype alpha, Dtype* Y, const int begin,
+    const int end) {
+  for (int i = begin; i < end; ++i) {
     Y[i] += alpha;
   }
 }
 
+template <>
+void caffe_add_scalar(const int N, const float alpha, float* Y) {
+  caffe_parallel_for(N, CAFFE_CPU_ARITHMETIC_GRAIN,
+      boost::bind(&add_scalar_range<float>, alpha, Y, _1, _2));
+}
+
 template <>
 void caffe_add_scalar(const int N, const double alpha, double* Y) {
-  for (int i = 0; i < N; ++i) {
-    Y[i] += alpha;
-  }
+  caffe_parallel_for(N, CAFFE_CPU_ARITHMETIC_GRAIN,
+      boost::bind(&add_scalar_range<double>, alpha, Y, _1, _2));
+}
+
+template <typename Dtype>
+static void copy_range(const Dtype* X, Dtype* Y, const int begin,
+    const int end) {
+  // NOLINT_NEXT_LINE(caffe/alt_fn)
+  memcpy(Y + begin, X + begin, sizeof(Dtype) * (end - begin));
 }
 
 template <typename Dtype>
@@ -93,7 +164,8 @@ void caffe_copy(const int N, const Dtype* X, Dtype* Y) {
       NO_GPU;
 #endif
     } else {
-      memcpy(Y, X, sizeof(Dtype) * N);  // NOLINT(caffe/alt_fn)
+      caffe_parallel_for(N, CAFFE_CPU_ARITHMETIC_GRAIN,
+          boost::bind(&copy_range<Dtype>, X, Y, _1, _2));
     }
   }
 }
@@ -129,101 +201,334 @@ void caffe_cpu_axpby<double>(const int N, const double alpha, const double* X,
 template <>
 void caffe_add<float>(const int n, const float* a, const float* b,
     float* y) {
-  vsAdd(n, a, b, y);
+  parallel_binary(n, &vsAdd, a, b, y);
 }
 
 template <>
 void caffe_add<double>(const int n, const double* a, const double* b,
     double* y) {
-  vdAdd(n, a, b, y);
+  parallel_binary(n, &vdAdd, a, b, y);
 }
 
 template <>
 void caffe_sub<float>(const int n, const float* a, const float* b,
     float* y) {
-  vsSub(n, a, b, y);
+  parallel_binary(n, &vsSub, a, b, y);
 }
 
 template <>
 void caffe_sub<double>(const int n, const double* a, const double* b,
     double* y) {
-  vdSub(n, a, b, y);
+  parallel_binary(n, &vdSub, a, b, y);
 }
 
 template <>
 void caffe_mul<float>(const int n, const float* a, const float* b,
     float* y) {
-  vsMul(n, a, b, y);
+  parallel_binary(n, &vsMul, a, b, y);
 }
 
 template <>
 void caffe_mul<double>(const int n, const double* a, const double* b,
     double* y) {
-  vdMul(n, a, b, y);
+  parallel_binary(n, &vdMul, a, b, y);
 }
 
 template <>
 void caffe_div<float>(const int n, const float* a, const float* b,
     float* y) {
-  vsDiv(n, a, b, y);
+  parallel_binary(n, &vsDiv, a, b, y);
 }
 
 template <>
 void caffe_div<double>(const int n, const double* a, const double* b,
     double* y) {
-  vdDiv(n, a, b, y);
+  parallel_binary(n, &vdDiv, a, b, y);
 }
 
 template <>
-void caffe_powx<float>(const int n, const float* a, const float b,
-    float* y) {
-  vsPowx(n, a, b, y);
+void caffe_sqr<float>(const int n, const float* a, float* y) {
+  parallel_unary(n, CAFFE_CPU_ARITHMETIC_GRAIN, &vsSqr, a, y);
 }
 
 template <>
-void caffe_powx<double>(const int n, const double* a, const double b,
-    double* y) {
-  vdPowx(n, a, b, y);
+void caffe_sqr<double>(const int n, const double* a, double* y) {
+  parallel_unary(n, CAFFE_CPU_ARITHMETIC_GRAIN, &vdSqr, a, y);
 }
 
 template <>
-void caffe_sqr<float>(const int n, const float* a, float* y) {
-  vsSqr(n, a, y);
+void caffe_powx<float>(const int n, const float* a, const float b,
+    float* y) {
+#ifdef USE_MKL
+  parallel_powx(n, &vsPowx, a, b, y);
+#else
+  // Squares stay exact; fast_powx does not take b = 0 or non finite b.
+  if (b == 2) {
+    caffe_sqr(n, a, y);
+  } else if (b != 0 && std::isfinite(b)) {
+    parallel_powx(n, &fast_powx, a, b, y);
+  } else {
+    parallel_powx(n, &vsPowx, a, b, y);
+  }
+#endif
 }
 
 template <>
-void caffe_sqr<double>(const int n, const double* a, double* y) {
-  vdSqr(n, a, y);
+void caffe_powx<double>(const int n, const double* a, const double b,
+    double* y) {
+  parallel_powx(n, &vdPowx, a, b, y);
 }
 
 template <>
 void caffe_exp<float>(const int n, const float* a, float* y) {
-  vsExp(n, a, y);
+#ifdef USE_MKL
+  parallel_unary(n, CAFFE_CPU_TRANSCENDENTAL_GRAIN, &vsExp, a, y);
+#else
+  parallel_unary(n, CAFFE_CPU_TRANSCENDENTAL_GRAIN, FastMathFn<FastExp>(),
+      a, y);
+#endif
 }
 
 template <>
 void caffe_exp<double>(const int n, const double* a, double* y) {
-  vdExp(n, a, y);
+  parallel_unary(n, CAFFE_CPU_TRANSCENDENTAL_GRAIN, &vdExp, a, y);
 }
 
 template <>
 void caffe_log<float>(const int n, const float* a, float* y) {
-  vsLn(n, a, y);
+#ifdef USE_MKL
+  parallel_unary(n, CAFFE_CPU_TRANSCENDENTAL_GRAIN, &vsLn, a, y);
+#else
+  parallel_unary(n, CAFFE_CPU_TRANSCENDENTAL_GRAIN, FastMathFn<FastLog>(),
+      a, y);
+#endif
 }
 
 template <>
 void caffe_log<double>(const int n, const double* a, double* y) {
-  vdLn(n, a, y);
+  parallel_unary(n, CAFFE_CPU_TRANSCENDENTAL_GRAIN, &vdLn, a, y);
+}
+
+template <typename Dtype>
+void caffe_tanh(const int n, const Dtype* a, Dtype* y) {
+  parallel_unary(n, CAFFE_CPU_TRANSCENDENTAL_GRAIN, FastMathFn<FastTanh>(),
+      a, y);
 }
 
+template void caffe_tanh<float>(const int n, const float* a, float* y);
+template void caffe_tanh<double>(const int n, const double* a, double* y);
+
+template <typename Dtype>
+void caffe_sigmoid(const int n, const Dtype* a, Dtype* y) {
+  parallel_unary(n, CAFFE_CPU_TRANSCENDENTAL_GRAIN, FastMathFn<FastSigmoid>(),
+      a, y);
+}
+
+template void caffe_sigmoid<float>(const int n, const float* a, float* y);
+template void caffe_sigmoid<double>(const int n, const double* a,
+    double* y);
+
+// Softmax of the contiguous row x[0, n) into y; returns the log of the
+// normalizer. The max and the sums are kept per lane of a block, so that
+// the loops vectorize.
+template <typename Dtype>
+static Dtype softmax_row(const int n, const Dtype* x, Dtype* y) {
+  const int kBlock = 16;
+  Dtype lanes[kBlock];
+  std::fill(lanes, lanes + kBlock, x[0]);
+  int c = 0;
+  for (; c + kBlock <= n; c += kBlock) {
+    // Not std::max, which selects between references and branches.
+    for (int j = 0; j < kBlock; ++j) {
+      const Dtype x_j = x[c + j];
+      lanes[j] = x_j > lanes[j] ? x_j : lanes[j];
+    }
+  }
+  Dtype max_x = *std::max_element(lanes, lanes + kBlock);
+  for (; c < n; ++c) {
+    max_x = std::max(max_x, x[c]);
+  }
+  std::fill(lanes, lanes + kBlock, Dtype(0));
+  Dtype exp_x[kBlock];
+  for (c = 0; c + kBlock <= n; c += kBlock) {
+    for (int j = 0; j < kBlock; ++j) {
+      exp_x[j] = fast_exp(x[c + j] - max_x);
+    }
+    for (int j = 0; j < kBlock; ++j) {
+      y[c + j] = exp_x[j];
+      lanes[j] += exp_x[j];
+    }
+  }
+  Dtype sum = std::accumulate(lanes, lanes + kBlock, Dtype(0));
+  for (; c < n; ++c) {
+    y[c] = fast_exp(x[c] - max_x);
+    sum += y[c];
+  }
+  const Dtype scale = 1 / sum;
+  for (c = 0; c + kBlock <= n; c += kBlock) {
+    for (int j = 0; j < kBlock; ++j) {
+      y[c + j] *= scale;
+    }
+  }
+  for (; c < n; ++c) {
+    y[c] *= scale;
+  }
+  return max_x + std::log(sum);
+}
+
+// The same over the channels of a channels x inner_num array, for all k in
+// [0, inner_num) at once; max_x and sum are scratch of inner_num elements.
+template <typename Dtype>
+static void softmax_planes(const int channels, const int inner_num,
+    const Dtype* x, Dtype* y, Dtype* log_sum, Dtype* max_x, Dtype* sum) {
+  std::copy(x, x + inner_num, max_x);
+  for (int c = 1; c < channels; ++c) {
+    const Dtype* x_c = x + c * inner_num;
+    for (int k = 0; k < inner_num; ++k) {
+      max_x[k] = std::max(max_x[k], x_c[k]);
+    }
+  }
+  std::fill(sum, sum + inner_num, Dtype(0));
+  for (int c = 0; c < channels; ++c) {
+    const Dtype* x_c = x + c * inner_num;
+    Dtype* y_c = y + c * inner_num;
+    for (int k = 0; k < inner_num; ++k) {
+      y_c[k] = x_c[k] - max_x[k];
+    }
+    fast_math_map(inner_num, y_c, y_c, FastExp());
+    for (int k = 0; k < inner_num; ++k) {
+      sum[k] += y_c[k];
+    }
+  }
+  for (int k = 0; k < inner_num; ++k) {
+    if (log_sum) {
+      log_sum[k] = max_x[k] + std::log(sum[k]);
+    }
+    sum[k] = 1 / sum[k];
+  }
+  for (int c = 0; c < channels; ++c) {
+    Dtype* y_c = y + c * inner_num;
+    for (int k = 0; k < inner_num; ++k) {
+      y_c[k] *= sum[k];
+    }
+  }
+}
+
+// caffe_cpu_softmax over the outer indices [begin, end).
+template <typename Dtype>
+static void softmax_range(const int channels, const int inner_num,
+    const Dtype* x, Dtype* y, Dtype* log_sum, const int begin,
+    const int end) {
+  const int dim = channels * inner_num;
+  if (inner_num == 1) {
+    for (int i = begin; i < end; ++i) {
+      const Dtype row_log_sum = softmax_row(channels, x + i * dim,
+          y + i * dim);
+      if (log_sum) {
+        log_sum[i] = row_log_sum;
+      }
+    }
+    return;
+  }
+  std::vector<Dtype> scratch(2 * inner_num);
+  for (int i = begin; i < end; ++i) {
+    softmax_planes(channels, inner_num, x + i * dim, y + i * dim,
+        log_sum ? log_sum + i * inner_num : NULL, &scratch[0],
+        &scratch[inner_num]);
+  }
+}
+
+template <typename Dtype>
+void caffe_cpu_softmax(const int outer_num, const int channels,
+    const int inner_num, const Dtype* x, Dtype* y, Dtype* log_sum) {
+  const int grain = std::max(1,
+      CAFFE_CPU_TRANSCENDENTAL_GRAIN / (channels * inner_num));
+  caffe_parallel_for(outer_num, grain, boost::bind(&softmax_range<Dtype>,
+      channels, inner_num, x, y, log_sum, _1, _2));
+}
+
+template void caffe_cpu_softmax<float>(const int outer_num,
+    const int channels, const int inner_num, const float* x, float* y,
+    float* log_sum);
+template void caffe_cpu_softmax<double>(const int outer_num,
+    const int channels, const int inner_num, const double* x, double* y,
+    double* log_sum);
+
+// caffe_cpu_scale_shift over the rows [begin, end) when inner_num is 1,
+// e.g. after InnerProduct.
+template <typename Dtype>
+static void scale_shift_rows(const int channels, const Dtype* scale,
+    const Dtype* shift, const Dtype* x, Dtype* y, const int begin,
+    const int end) {
+  for (int i = begin; i < end; ++i) {
+    const Dtype* row_x = x + i * channels;
+    Dtype* row_y = y + i * channels;
+    if (shift) {
+      for (int c = 0; c < channels; ++c) {
+        row_y[c] = row_x[c] * scale[c] + shift[c];
+      }
+    } else {
+      for (int c = 0; c < channels; ++c) {
+        row_y[c] = row_x[c] * scale[c];
+      }
+    }
+  }
+}
+
+// The same over the planes [begin, end) of outer_num * channels otherwise.
+template <typename Dtype>
+static void scale_shift_planes(const int channels, const int inner_num,
+    const Dtype* scale, const Dtype* shift, const Dtype* x, Dtype* y,
+    const int begin, const int end) {
+  for (int i = begin; i < end; ++i) {
+    const int c = i % channels;
+    const Dtype a = scale[c];
+    const Dtype* plane_x = x + i * inner_num;
+    Dtype* plane_y = y + i * inner_num;
+    if (shift) {
+      const Dtype b = shift[c];
+      for (int j = 0; j < inner_num; ++j) {
+        plane_y[j] = plane_x[j] * a + b;
+      }
+    } else {
+      for (int j = 0; j < inner_num; ++j) {
+        plane_y[j] = plane_x[j] * a;
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void caffe_cpu_scale_shift(const int outer_num, const int channels,
+    const int inner_num, const Dtype* scale, const Dtype* shift,
+    const Dtype* x, Dtype* y) {
+  if (inner_num == 1) {
+    const int grain = std::max(1, CAFFE_CPU_ARITHMETIC_GRAIN / channels);
+    caffe_parallel_for(outer_num, grain, boost::bind(
+        &scale_shift_rows<Dtype>, channels, scale, shift, x, y, _1, _2));
+    return;
+  }
+  const int grain = std::max(1, CAFFE_CPU_ARITHMETIC_GRAIN / inner_num);
+  caffe_parallel_for(outer_num * channels, grain, boost::bind(
+      &scale_shift_planes<Dtype>, channels, inner_num, scale, shift, x, y,
+      _1, _2));
+}
+
+template void caffe_cpu_scale_shift<float>(const int outer_num,
+    const int channels, const int inner_num, const float* scale,
+    const float* shift, const float* x, float* y);
+template void caffe_cpu_scale_shift<double>(const int outer_num,
+    const int channels, const int inner_num, const double* scale,
+    const double* shift, const double* x, double* y);
+
 template <>
 void caffe_abs<float>(const int n, const float* a, float* y) {
-    vsAbs(n, a, y);
+  parallel_unary(n, CAFFE_CPU_ARITHMETIC_GRAIN, &vsAbs, a, y);
 }
 
 template <>
 void caffe_abs<double>(const int n, const double* a, double* y) {
-    vdAbs(n, a, y);
+  parallel_unary(n, CAFFE_CPU_ARITHMETIC_GRAIN, &vdAbs, a, y);
 }
 
 unsigned int caffe_rng_rand() {
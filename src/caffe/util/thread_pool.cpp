@@ -0,0 +1,205 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <exception>
+#include <vector>
+
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+class ThreadPool::sync {
+ public:
+  sync() : fn_(NULL), num_items_(0), next_item_(0), pending_items_(0),
+      generation_(0), stop_(false) {}
+
+  // Serializes concurrent ParallelFor calls on the same pool.
+  boost::mutex call_mutex_;
+  boost::mutex mutex_;
+  boost::condition_variable work_;
+  boost::condition_variable done_;
+
+  const boost::function<void(int)>* fn_;
+  int num_items_;
+  int next_item_;
+  int pending_items_;
+  int generation_;
+  bool stop_;
+};
+
+ThreadPool::ThreadPool(int num_threads)
+    : num_threads_(num_threads > 0 ? num_threads : 1),
+      sync_(new sync()) {
+  // The caller participates, so only num_threads_ - 1 workers are needed.
+  try {
+    for (int i = 1; i < num_threads_; ++i) {
+      threads_.push_back(shared_ptr<boost::thread>(
+          new boost::thread(&ThreadPool::WorkerEntry, this)));
+    }
+  } catch (std::exception& e) {
+    LOG(FATAL) << "Thread exception: " << e.what();
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    sync_->stop_ = true;
+  }
+  sync_->work_.notify_all();
+  for (int i = 0; i < threads_.size(); ++i) {
+    threads_[i]->join();
+  }
+}
+
+void ThreadPool::ParallelFor(int n, const boost::function<void(int)>& fn) {
+  if (n <= 0) {
+    return;
+  }
+  if (threads_.empty() || n == 1) {
+    for (int i = 0; i < n; ++i) {
+      fn(i);
+    }
+    return;
+  }
+  boost::mutex::scoped_lock call_lock(sync_->call_mutex_);
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    sync_->fn_ = &fn;
+    sync_->num_items_ = n;
+    sync_->next_item_ = 0;
+    sync_->pending_items_ = n;
+    ++sync_->generation_;
+  }
+  sync_->work_.notify_all();
+  RunItems();
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  while (sync_->pending_items_ > 0) {
+    sync_->done_.wait(lock);
+  }
+  sync_->fn_ = NULL;
+}
+
+// The shares of a ParallelForRange, one per thread.
+class RangeShares {
+ public:
+  RangeShares(int n, int num_shares, int grain)
+      : shares_(num_shares), grain_(grain) {
+    for (int i = 0; i < num_shares; ++i) {
+      shares_[i].begin = static_cast<int64_t>(n) * i / num_shares;
+      shares_[i].end = static_cast<int64_t>(n) * (i + 1) / num_shares;
+    }
+  }
+
+  // Runs the ranges of share i, then steals from the others until none
+  // is left.
+  void Run(int i, const boost::function<void(int, int)>* fn) {
+    Share& own = shares_[i];
+    while (true) {
+      int begin, end;
+      {
+        boost::mutex::scoped_lock lock(own.mutex);
+        begin = own.begin;
+        end = std::min(own.end, begin + grain_);
+        own.begin = end;
+      }
+      if (begin < end) {
+        (*fn)(begin, end);
+      } else if (!Steal(i)) {
+        return;
+      }
+    }
+  }
+
+ protected:
+  struct Share {
+    boost::mutex mutex;
+    int begin, end;
+  };
+
+  // Moves the second half of the largest other share to share i.
+  bool Steal(int i) {
+    int victim = -1, largest = 0;
+    for (int j = 0; j < shares_.size(); ++j) {
+      if (j == i) {
+        continue;
+      }
+      boost::mutex::scoped_lock lock(shares_[j].mutex);
+      const int size = shares_[j].end - shares_[j].begin;
+      if (size > largest) {
+        victim = j;
+        largest = size;
+      }
+    }
+    if (victim < 0) {
+      return false;
+    }
+    int begin, end;
+    {
+      boost::mutex::scoped_lock lock(shares_[victim].mutex);
+      const int size = shares_[victim].end - shares_[victim].begin;
+      if (size <= 0) {
+        return true;  // Emptied meanwhile, look again.
+      }
+      end = shares_[victim].end;
+      begin = size > grain_ ? end - size / 2 : shares_[victim].begin;
+      shares_[victim].end = begin;
+    }
+    boost::mutex::scoped_lock lock(shares_[i].mutex);
+    shares_[i].begin = begin;
+    shares_[i].end = end;
+    return true;
+  }
+
+  std::vector<Share> shares_;
+  const int grain_;
+};
+
+void ThreadPool::ParallelForRange(int n, int grain,
+    const boost::function<void(int, int)>& fn) {
+  if (n <= 0) {
+    return;
+  }
+  grain = std::max(grain, 1);
+  const int num_shares = std::min<int64_t>(num_threads_,
+      (static_cast<int64_t>(n) + grain - 1) / grain);
+  if (num_shares <= 1) {
+    fn(0, n);
+    return;
+  }
+  RangeShares shares(n, num_shares, grain);
+  ParallelFor(num_shares, boost::bind(&RangeShares::Run, &shares, _1, &fn));
+}
+
+void ThreadPool::WorkerEntry() {
+  int seen_generation = 0;
+  while (true) {
+    {
+      boost::mutex::scoped_lock lock(sync_->mutex_);
+      while (!sync_->stop_ && sync_->generation_ == seen_generation) {
+        sync_->work_.wait(lock);
+      }
+      if (sync_->stop_) {
+        return;
+      }
+      seen_generation = sync_->generation_;
+    }
+    RunItems();
+  }
+}
+
+void ThreadPool::RunItems() {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  while (sync_->next_item_ < sync_->num_items_) {
+    const int item = sync_->next_item_++;
+    const boost::function<void(int)>& fn = *sync_->fn_;
+    lock.unlock();
+    fn(item);
+    lock.lock();
+    if (--sync_->pending_items_ == 0) {
+      sync_->done_.notify_all();
+    }
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,248 @@
+#include <algorithm>
+
+#include "caffe/common.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/winograd.hpp"
+
+namespace caffe {
+
+// One-dimensional transforms of F(m, 3), from Lavin and Gray, "Fast
+// Algorithms for Convolutional Neural Networks". Each one reads its input
+// with stride in_step and writes its output with stride out_step; the 2D
+// transforms apply them to the rows, then to the columns.
+template <typename Dtype>
+struct WinogradF2 {
+  static const int kTile = 2;
+  static const int kAlpha = 4;
+
+  // B^T d
+  static inline void input(const Dtype* d, const int in_step, Dtype* v,
+      const int out_step) {
+    const Dtype d0 = d[0], d1 = d[in_step], d2 = d[2 * in_step],
+        d3 = d[3 * in_step];
+    v[0] = d0 - d2;
+    v[out_step] = d1 + d2;
+    v[2 * out_step] = d2 - d1;
+    v[3 * out_step] = d1 - d3;
+  }
+  // G g
+  static inline void filter(const Dtype* g, const int in_step, Dtype* u,
+      const int out_step) {
+    const Dtype g0 = g[0], g1 = g[in_step], g2 = g[2 * in_step];
+    u[0] = g0;
+    u[out_step] = (g0 + g1 + g2) / 2;
+    u[2 * out_step] = (g0 - g1 + g2) / 2;
+    u[3 * out_step] = g2;
+  }
+  // A^T m
+  static inline void output(const Dtype* m, const int in_step, Dtype* y,
+      const int out_step) {
+    const Dtype m1 = m[in_step], m2 = m[2 * in_step];
+    y[0] = m[0] + m1 + m2;
+    y[out_step] = m1 - m2 - m[3 * in_step];
+  }
+};
+
+template <typename Dtype>
+struct WinogradF4 {
+  static const int kTile = 4;
+  static const int kAlpha = 6;
+
+  static inline void input(const Dtype* d, const int in_step, Dtype* v,
+      const int out_step) {
+    const Dtype d0 = d[0], d1 = d[in_step], d2 = d[2 * in_step],
+        d3 = d[3 * in_step], d4 = d[4 * in_step], d5 = d[5 * in_step];
+    v[0] = 4 * d0 - 5 * d2 + d4;
+    v[out_step] = d3 + d4 - 4 * (d1 + d2);
+    v[2 * out_step] = 4 * (d1 - d2) + d4 - d3;
+    v[3 * out_step] = 2 * (d3 - d1) + d4 - d2;
+    v[4 * out_step] = 2 * (d1 - d3) + d4 - d2;
+    v[5 * out_step] = 4 * d1 - 5 * d3 + d5;
+  }
+  static inline void filter(const Dtype* g, const int in_step, Dtype* u,
+      const int out_step) {
+    const Dtype g0 = g[0], g1 = g[in_step], g2 = g[2 * in_step];
+    u[0] = g0 / 4;
+    u[out_step] = -(g0 + g1 + g2) / 6;
+    u[2 * out_step] = -(g0 - g1 + g2) / 6;
+    u[3 * out_step] = g0 / 24 + g1 / 12 + g2 / 6;
+    u[4 * out_step] = g0 / 24 - g1 / 12 + g2 / 6;
+    u[5 * out_step] = g2;
+  }
+  static inline void output(const Dtype* m, const int in_step, Dtype* y,
+      const int out_step) {
+    const Dtype m1 = m[in_step], m2 = m[2 * in_step], m3 = m[3 * in_step],
+        m4 = m[4 * in_step];
+    y[0] = m[0] + m1 + m2 + m3 + m4;
+    y[out_step] = m1 - m2 + 2 * (m3 - m4);
+    y[2 * out_step] = m1 + m2 + 4 * (m3 + m4);
+    y[3 * out_step] = m1 - m2 + 8 * (m3 - m4) + m[5 * in_step];
+  }
+};
+
+bool winograd_supported(const int tile, const int kernel_h,
+    const int kernel_w, const int stride_h, const int stride_w) {
+  return (tile == 2 || tile == 4) && kernel_h == 3 && kernel_w == 3 &&
+      stride_h == 1 && stride_w == 1;
+}
+
+int winograd_weights_size(const int tile, const int channels,
+    const int num_output) {
+  return (tile + 2) * (tile + 2) * num_output * channels;
+}
+
+int winograd_workspace_size(const int tile, const int channels,
+    const int num_output, const int output_h, const int output_w) {
+  const int tiles = ((output_h + tile - 1) / tile) *
+      ((output_w + tile - 1) / tile);
+  return (tile + 2) * (tile + 2) * tiles * (channels + num_output);
+}
+
+template <typename Transform, typename Dtype>
+static void winograd_transform_weights(const Dtype* weights,
+    const int channels, const int num_output, Dtype* transformed_weights) {
+  const int alpha = Transform::kAlpha;
+  const int points = num_output * channels;
+  for (int i = 0; i < points; ++i) {
+    const Dtype* g = weights + i * 9;
+    Dtype rows[3 * alpha], u[alpha * alpha];
+    for (int r = 0; r < 3; ++r) {
+      Transform::filter(g + r * 3, 1, rows + r * alpha, 1);
+    }
+    for (int c = 0; c < alpha; ++c) {
+      Transform::filter(rows + c, alpha, u + c, alpha);
+    }
+    for (int xi = 0; xi < alpha * alpha; ++xi) {
+      transformed_weights[xi * points + i] = u[xi];
+    }
+  }
+}
+
+template <typename Transform, typename Dtype>
+static void winograd_conv(const Dtype* data_im, const int channels,
+    const int height, const int width, const Dtype* transformed_weights,
+    const int num_output, const int pad_h, const int pad_w,
+    const int output_h, const int output_w, Dtype* workspace,
+    Dtype* data_out) {
+  const int m = Transform::kTile;
+  const int alpha = Transform::kAlpha;
+  const int tiles_h = (output_h + m - 1) / m;
+  const int tiles_w = (output_w + m - 1) / m;
+  const int tiles = tiles_h * tiles_w;
+  // alpha^2 matrices of channels x tiles, then of num_output x tiles.
+  Dtype* transformed_input = workspace;
+  Dtype* transformed_output = workspace + alpha * alpha * channels * tiles;
+  for (int c = 0; c < channels; ++c) {
+    const Dtype* image = data_im + c * height * width;
+    for (int ty = 0; ty < tiles_h; ++ty) {
+      const int h0 = ty * m - pad_h;
+      for (int tx = 0; tx < tiles_w; ++tx) {
+        const int w0 = tx * m - pad_w;
+        Dtype d[alpha * alpha], rows[alpha * alpha], v[alpha * alpha];
+        for (int i = 0; i < alpha; ++i) {
+          const int h = h0 + i;
+          for (int j = 0; j < alpha; ++j) {
+            const int w = w0 + j;
+            d[i * alpha + j] = (h >= 0 && h < height && w >= 0 && w < width) ?
+                image[h * width + w] : Dtype(0);
+          }
+        }
+        for (int i = 0; i < alpha; ++i) {
+          Transform::input(d + i * alpha, 1, rows + i * alpha, 1);
+        }
+        for (int j = 0; j < alpha; ++j) {
+          Transform::input(rows + j, alpha, v + j, alpha);
+        }
+        Dtype* out = transformed_input + c * tiles + ty * tiles_w + tx;
+        for (int xi = 0; xi < alpha * alpha; ++xi) {
+          out[xi * channels * tiles] = v[xi];
+        }
+      }
+    }
+  }
+  // One (num_output x channels) x (channels x tiles) product per point of
+  // the transform domain, over all the tiles of the image at once.
+  for (int xi = 0; xi < alpha * alpha; ++xi) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_output, tiles,
+        channels, (Dtype)1., transformed_weights + xi * num_output * channels,
+        transformed_input + xi * channels * tiles, (Dtype)0.,
+        transformed_output + xi * num_output * tiles);
+  }
+  for (int o = 0; o < num_output; ++o) {
+    Dtype* image = data_out + o * output_h * output_w;
+    for (int ty = 0; ty < tiles_h; ++ty) {
+      for (int tx = 0; tx < tiles_w; ++tx) {
+        const Dtype* in = transformed_output + o * tiles + ty * tiles_w + tx;
+        Dtype mm[alpha * alpha], rows[alpha * m], y[m * m];
+        for (int xi = 0; xi < alpha * alpha; ++xi) {
+          mm[xi] = in[xi * num_output * tiles];
+        }
+        for (int i = 0; i < alpha; ++i) {
+          Transform::output(mm + i * alpha, 1, rows + i * m, 1);
+        }
+        for (int j = 0; j < m; ++j) {
+          Transform::output(rows + j, m, y + j, m);
+        }
+        // The last tiles may hang over the output.
+        const int rows_out = std::min(m, output_h - ty * m);
+        const int cols_out = std::min(m, output_w - tx * m);
+        for (int i = 0; i < rows_out; ++i) {
+          for (int j = 0; j < cols_out; ++j) {
+            image[(ty * m + i) * output_w + tx * m + j] = y[i * m + j];
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void winograd_transform_weights_cpu(const int tile, const Dtype* weights,
+    const int channels, const int num_output, Dtype* transformed_weights) {
+  CHECK(winograd_supported(tile, 3, 3, 1, 1)) << "Unsupported tile " << tile;
+  if (tile == 2) {
+    winograd_transform_weights<WinogradF2<Dtype> >(weights, channels,
+        num_output, transformed_weights);
+  } else {
+    winograd_transform_weights<WinogradF4<Dtype> >(weights, channels,
+        num_output, transformed_weights);
+  }
+}
+
+template <typename Dtype>
+void winograd_conv_cpu(const int tile, const Dtype* data_im,
+    const int channels, const int height, const int width,
+    const Dtype* transformed_weights, const int num_output, const int pad_h,
+    const int pad_w, const int output_h, const int output_w,
+    Dtype* workspace, Dtype* data_out) {
+  CHECK(winograd_supported(tile, 3, 3, 1, 1)) << "Unsupported tile " << tile;
+  if (tile == 2) {
+    winograd_conv<WinogradF2<Dtype> >(data_im, channels, height, width,
+        transformed_weights, num_output, pad_h, pad_w, output_h, output_w,
+        workspace, data_out);
+  } else {
+    winograd_conv<WinogradF4<Dtype> >(data_im, channels, height, width,
+        transformed_weights, num_output, pad_h, pad_w, output_h, output_w,
+        workspace, data_out);
+  }
+}
+
+// Explicit instantiation
+template void winograd_transform_weights_cpu<float>(const int tile,
+    const float* weights, const int channels, const int num_output,
+    float* transformed_weights);
+template void winograd_transform_weights_cpu<double>(const int tile,
+    const double* weights, const int channels, const int num_output,
+    double* transformed_weights);
+template void winograd_conv_cpu<float>(const int tile, const float* data_im,
+    const int channels, const int height, const int width,
+    const float* transformed_weights, const int num_output, const int pad_h,
+    const int pad_w, const int output_h, const int output_w,
+    float* workspace, float* data_out);
+template void winograd_conv_cpu<double>(const int tile,
+    const double* data_im, const int channels, const int height,
+    const int width, const double* transformed_weights, const int num_output,
+    const int pad_h, const int pad_w, const int output_h, const int output_w,
+    double* workspace, double* data_out);
+
+}  // namespace caffe
@@ -13,6 +13,7 @@ namespace bp = boost::python;
 
 #include "boost/algorithm/string.hpp"
 #include "caffe/caffe.hpp"
+#include "caffe/util/gemm.hpp"
 #include "caffe/util/signal_handler.h"
 
 using caffe::Blob;
@@ -54,6 +55,14 @@ DEFINE_string(sigint_effect, "stop",
 DEFINE_string(sighup_effect, "snapshot",
              "Optional; action to take when a SIGHUP signal is received: "
              "snapshot, stop or none.");
+DEFINE_string(gemm, "blas",
+    "Optional; the CPU matrix multiplication: blas, the linked BLAS "
+    "library, or caffe, the bundled blocked GEMM.");
+DEFINE_int32(gemm_threads, 1,
+    "Optional; the number of threads of the caffe GEMM.");
+DEFINE_int32(cpu_threads, 1,
+    "Optional; the number of threads the element-wise, pooling and LRN "
+    "loops of CPU layers are split between.");
 
 // A simple registry for caffe commands.
 typedef int (*BrewFunction)();
@@ -436,6 +445,9 @@ int main(int argc, char** argv) {
       "  time            benchmark model execution time");
   // Run tool or show usage.
   caffe::GlobalInit(&argc, &argv);
+  caffe::GemmBackend::Set(FLAGS_gemm);
+  caffe::GemmBackend::set_num_threads(FLAGS_gemm_threads);
+  caffe::Caffe::set_cpu_threads(FLAGS_cpu_threads);
   if (argc == 2) {
 #ifdef WITH_PYTHON_LAYER
     try {
@@ -1,16 +1,30 @@
+// Computes the mean image of a leveldb/lmdb, and optionally the
+// per-channel standard deviation. Usage:
+//   compute_image_mean [FLAGS] INPUT_DB [OUTPUT_FILE]
+//
+// The db is read in chunks on the main thread while the previous chunk is
+// parsed, decoded and accumulated by --threads threads, each into its own
+// double buffer. The partial sums are reduced at the end.
+
 #include <stdint.h>
 #include <algorithm>
+#include <cmath>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "boost/bind.hpp"
 #include "boost/scoped_ptr.hpp"
+#include "boost/thread.hpp"
 #include "gflags/gflags.h"
 #include "glog/logging.h"
 
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/db.hpp"
+#include "caffe/util/format.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 using namespace caffe;  // NOLINT(build/namespaces)
 
@@ -20,6 +34,121 @@ using boost::scoped_ptr;
 
 DEFINE_string(backend, "lmdb",
         "The backend {leveldb, lmdb} containing the images");
+DEFINE_int32(threads, 1,
+    "Number of threads parsing, decoding and accumulating the images");
+DEFINE_int32(shards, 1,
+    "Optional: Number of input shards INPUT_DB_<i>, as written by "
+    "convert_imageset --shards");
+DEFINE_double(sample, 1.0,
+    "Optional: Fraction of the images to use, sampled at random");
+DEFINE_int32(seed, 1701, "Random seed used with --sample");
+DEFINE_bool(std, false,
+    "When this option is on, also compute the per-channel standard "
+    "deviation");
+
+#ifdef USE_OPENCV
+// Partial sums of one thread.
+struct Accumulator {
+  std::vector<double> sum;
+  // Sum of squared values per channel, only filled with --std.
+  std::vector<double> channel_sum_sq;
+  int count;
+};
+
+// Accumulates the thread_id-th slice of the chunk into its accumulator.
+static void AccumulateSlice(int thread_id, const std::vector<string>& values,
+    int num_threads, int channels, int data_size,
+    std::vector<Accumulator>* accumulators) {
+  Accumulator& acc = (*accumulators)[thread_id];
+  double* sum = &acc.sum[0];
+  const int dim = data_size / channels;
+  const int begin = values.size() * thread_id / num_threads;
+  const int end = values.size() * (thread_id + 1) / num_threads;
+  Datum datum;
+  for (int v = begin; v < end; ++v) {
+    datum.ParseFromString(values[v]);
+    DecodeDatumNative(&datum);
+
+    const std::string& data = datum.data();
+    const int size_in_datum = std::max<int>(datum.data().size(),
+        datum.float_data_size());
+    CHECK_EQ(size_in_datum, data_size) << "Incorrect data field size " <<
+        size_in_datum;
+    if (data.size() != 0) {
+      const uint8_t* pixels = reinterpret_cast<const uint8_t*>(data.data());
+      for (int i = 0; i < data_size; ++i) {
+        sum[i] += pixels[i];
+      }
+      if (FLAGS_std) {
+        for (int c = 0; c < channels; ++c) {
+          const uint8_t* plane = pixels + c * dim;
+          // Squares of uint8 fit in an integer sum for any image size used
+          // in practice.
+          int64_t sum_sq = 0;
+          for (int i = 0; i < dim; ++i) {
+            sum_sq += plane[i] * plane[i];
+          }
+          acc.channel_sum_sq[c] += sum_sq;
+        }
+      }
+    } else {
+      const float* pixels = datum.float_data().data();
+      for (int i = 0; i < data_size; ++i) {
+        sum[i] += pixels[i];
+      }
+      if (FLAGS_std) {
+        for (int c = 0; c < channels; ++c) {
+          const float* plane = pixels + c * dim;
+          double sum_sq = 0;
+          for (int i = 0; i < dim; ++i) {
+            sum_sq += plane[i] * plane[i];
+          }
+          acc.channel_sum_sq[c] += sum_sq;
+        }
+      }
+    }
+    ++acc.count;
+  }
+}
+
+static void AccumulateChunk(ThreadPool* pool,
+    const std::vector<string>& values, int channels, int data_size,
+    std::vector<Accumulator>* accumulators) {
+  pool->ParallelFor(pool->num_threads(), boost::bind(&AccumulateSlice, _1,
+      boost::cref(values), pool->num_threads(), channels, data_size,
+      accumulators));
+}
+
+// Reads up to size sampled values, moving to the next shard when needed.
+// Returns false once all shards are exhausted and nothing was read.
+static bool ReadChunk(const std::vector<string>& sources, int* shard,
+    scoped_ptr<db::DB>* db, scoped_ptr<db::Cursor>* cursor, int size,
+    std::vector<string>* values) {
+  values->clear();
+  while (values->size() < size) {
+    if (!(*cursor)->valid()) {
+      if (*shard + 1 >= sources.size()) {
+        break;
+      }
+      ++*shard;
+      cursor->reset();
+      (*db)->Close();
+      (*db)->Open(sources[*shard], db::READ);
+      cursor->reset((*db)->NewCursor());
+      continue;
+    }
+    int keep = 1;
+    if (FLAGS_sample < 1) {
+      caffe_rng_bernoulli(1, FLAGS_sample, &keep);
+    }
+    if (keep) {
+      values->push_back((*cursor)->value());
+    }
+    (*cursor)->Next();
+  }
+  return !values->empty();
+}
+#endif  // USE_OPENCV
 
 int main(int argc, char** argv) {
   ::google::InitGoogleLogging(argv[0]);
@@ -40,9 +169,21 @@ int main(int argc, char** argv) {
     gflags::ShowUsageWithFlagsRestrict(argv[0], "tools/compute_image_mean");
     return 1;
   }
+  CHECK_GT(FLAGS_sample, 0) << "--sample must be in (0, 1]";
+  CHECK_LE(FLAGS_sample, 1) << "--sample must be in (0, 1]";
+  Caffe::set_random_seed(FLAGS_seed);
 
+  std::vector<string> sources;
+  if (FLAGS_shards > 1) {
+    for (int shard = 0; shard < FLAGS_shards; ++shard) {
+      sources.push_back(string(argv[1]) + "_" + caffe::format_int(shard, 5));
+    }
+  } else {
+    sources.push_back(argv[1]);
+  }
+  int shard = 0;
   scoped_ptr<db::DB> db(db::GetDB(FLAGS_backend));
-  db->Open(argv[1], db::READ);
+  db->Open(sources[shard], db::READ);
   scoped_ptr<db::Cursor> cursor(db->NewCursor());
 
   BlobProto sum_blob;
@@ -59,54 +200,59 @@ int main(int argc, char** argv) {
   sum_blob.set_channels(datum.channels());
   sum_blob.set_height(datum.height());
   sum_blob.set_width(datum.width());
+  const int channels = datum.channels();
   const int data_size = datum.channels() * datum.height() * datum.width();
-  int size_in_datum = std::max<int>(datum.data().size(),
-                                    datum.float_data_size());
-  for (int i = 0; i < size_in_datum; ++i) {
-    sum_blob.add_data(0.);
-  }
-  LOG(INFO) << "Starting Iteration";
-  while (cursor->valid()) {
-    Datum datum;
-    datum.ParseFromString(cursor->value());
-    DecodeDatumNative(&datum);
 
-    const std::string& data = datum.data();
-    size_in_datum = std::max<int>(datum.data().size(),
-        datum.float_data_size());
-    CHECK_EQ(size_in_datum, data_size) << "Incorrect data field size " <<
-        size_in_datum;
-    if (data.size() != 0) {
-      CHECK_EQ(data.size(), size_in_datum);
-      for (int i = 0; i < size_in_datum; ++i) {
-        sum_blob.set_data(i, sum_blob.data(i) + (uint8_t)data[i]);
-      }
-    } else {
-      CHECK_EQ(datum.float_data_size(), size_in_datum);
-      for (int i = 0; i < size_in_datum; ++i) {
-        sum_blob.set_data(i, sum_blob.data(i) +
-            static_cast<float>(datum.float_data(i)));
-      }
-    }
-    ++count;
-    if (count % 10000 == 0) {
+  ThreadPool pool(FLAGS_threads);
+  std::vector<Accumulator> accumulators(pool.num_threads());
+  for (int t = 0; t < accumulators.size(); ++t) {
+    accumulators[t].sum.resize(data_size, 0.);
+    accumulators[t].channel_sum_sq.resize(channels, 0.);
+    accumulators[t].count = 0;
+  }
+  LOG(INFO) << "Starting Iteration with " << pool.num_threads()
+      << " threads";
+  // Accumulate one chunk while the next one is read.
+  const int chunk_size = 256 * pool.num_threads();
+  std::vector<string> chunks[2];
+  bool more = ReadChunk(sources, &shard, &db, &cursor, chunk_size,
+                        &chunks[0]);
+  for (int c = 0; more; ++c) {
+    boost::thread accumulator(&AccumulateChunk, &pool,
+        boost::cref(chunks[c % 2]), channels, data_size, &accumulators);
+    const int previous_count = count;
+    count += chunks[c % 2].size();
+    if (count / 10000 != previous_count / 10000) {
       LOG(INFO) << "Processed " << count << " files.";
     }
-    cursor->Next();
+    more = ReadChunk(sources, &shard, &db, &cursor, chunk_size,
+                     &chunks[(c + 1) % 2]);
+    accumulator.join();
   }
+  CHECK_GT(count, 0) << "No image was sampled";
 
   if (count % 10000 != 0) {
     LOG(INFO) << "Processed " << count << " files.";
   }
-  for (int i = 0; i < sum_blob.data_size(); ++i) {
-    sum_blob.set_data(i, sum_blob.data(i) / count);
+  // Reduce the partial sums.
+  std::vector<double> sum(data_size, 0.);
+  std::vector<double> channel_sum_sq(channels, 0.);
+  for (int t = 0; t < accumulators.size(); ++t) {
+    for (int i = 0; i < data_size; ++i) {
+      sum[i] += accumulators[t].sum[i];
+    }
+    for (int c = 0; c < channels; ++c) {
+      channel_sum_sq[c] += accumulators[t].channel_sum_sq[c];
+    }
+  }
+  for (int i = 0; i < data_size; ++i) {
+    sum_blob.add_data(sum[i] / count);
   }
   // Write to disk
   if (argc == 3) {
     LOG(INFO) << "Write to " << argv[2];
     WriteProtoToBinaryFile(sum_blob, argv[2]);
   }
-  const int channels = sum_blob.channels();
   const int dim = sum_blob.height() * sum_blob.width();
   std::vector<float> mean_values(channels, 0.0);
   LOG(INFO) << "Number of channels: " << channels;
@@ -116,6 +262,15 @@ int main(int argc, char** argv) {
     }
     LOG(INFO) << "mean_value channel [" << c << "]:" << mean_values[c] / dim;
   }
+  if (FLAGS_std) {
+    for (int c = 0; c < channels; ++c) {
+      const double mean = mean_values[c] / dim;
+      const double variance =
+          channel_sum_sq[c] / (static_cast<double>(count) * dim) - mean * mean;
+      LOG(INFO) << "std_value channel [" << c << "]:"
+          << std::sqrt(std::max(variance, 0.));
+    }
+  }
 #else
   LOG(FATAL) << "This tool requires OpenCV; compile with USE_OPENCV.";
 #endif  // USE_OPENCV
@@ -7,6 +7,12 @@
 // should be a list of files as well as their labels, in the format as
 //   subfolder1/file1.JPEG 7
 //   ....
+//
+// Images are read, decoded, resized and encoded by --threads threads, one
+// chunk of the list at a time, while the previous chunk is written. With
+// --shards N > 1, image i is written to DB_NAME_<i % N> instead of DB_NAME,
+// with the shard index zero-padded to five digits: DB_NAME_00000,
+// DB_NAME_00001, ...
 
 #include <algorithm>
 #include <fstream>  // NOLINT(readability/streams)
@@ -14,15 +20,19 @@
 #include <utility>
 #include <vector>
 
+#include "boost/bind.hpp"
 #include "boost/scoped_ptr.hpp"
+#include "boost/thread.hpp"
 #include "gflags/gflags.h"
 #include "glog/logging.h"
 
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/benchmark.hpp"
 #include "caffe/util/db.hpp"
 #include "caffe/util/format.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/rng.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 using namespace caffe;  // NOLINT(build/namespaces)
 using std::pair;
@@ -42,6 +52,63 @@ DEFINE_bool(encoded, false,
     "When this option is on, the encoded image will be save in datum");
 DEFINE_string(encode_type, "",
     "Optional: What type should we encode the image as ('png','jpg',...).");
+DEFINE_int32(threads, 1,
+    "Number of threads reading, decoding and encoding the images");
+DEFINE_int32(shards, 1,
+    "Optional: Number of output databases, image i goes to shard i % shards");
+DEFINE_int32(commit_size, 1000,
+    "Number of images per database transaction and shard");
+
+#ifdef USE_OPENCV
+// A range of consecutive lines, converted in parallel and written in order.
+struct Chunk {
+  int begin;
+  int end;
+  // Serialized datums, empty if the image could not be read.
+  std::vector<string> values;
+};
+
+struct ConvertOptions {
+  string root_folder;
+  int resize_height;
+  int resize_width;
+  bool is_color;
+  bool encoded;
+  string encode_type;
+};
+
+static void ConvertLine(int item_id,
+    const std::vector<std::pair<std::string, int> >& lines,
+    const ConvertOptions& options, Chunk* chunk) {
+  const int line_id = chunk->begin + item_id;
+  std::string enc = options.encode_type;
+  if (options.encoded && !enc.size()) {
+    // Guess the encoding type from the file name
+    string fn = lines[line_id].first;
+    size_t p = fn.rfind('.');
+    if ( p == fn.npos )
+      LOG(WARNING) << "Failed to guess the encoding of '" << fn << "'";
+    enc = fn.substr(p);
+    std::transform(enc.begin(), enc.end(), enc.begin(), ::tolower);
+  }
+  Datum datum;
+  string& out = chunk->values[item_id];
+  out.clear();
+  if (ReadImageToDatum(options.root_folder + lines[line_id].first,
+      lines[line_id].second, options.resize_height, options.resize_width,
+      options.is_color, enc, &datum)) {
+    CHECK(datum.SerializeToString(&out));
+  }
+}
+
+static void ConvertChunk(ThreadPool* pool,
+    const std::vector<std::pair<std::string, int> >& lines,
+    const ConvertOptions& options, Chunk* chunk) {
+  chunk->values.resize(chunk->end - chunk->begin);
+  pool->ParallelFor(chunk->end - chunk->begin, boost::bind(&ConvertLine, _1,
+      boost::cref(lines), boost::cref(options), chunk));
+}
+#endif  // USE_OPENCV
 
 int main(int argc, char** argv) {
 #ifdef USE_OPENCV
@@ -91,66 +158,90 @@ int main(int argc, char** argv) {
   if (encode_type.size() && !encoded)
     LOG(INFO) << "encode_type specified, assuming encoded=true.";
 
-  int resize_height = std::max<int>(0, FLAGS_resize_height);
-  int resize_width = std::max<int>(0, FLAGS_resize_width);
-
-  // Create new DB
-  scoped_ptr<db::DB> db(db::GetDB(FLAGS_backend));
-  db->Open(argv[3], db::NEW);
-  scoped_ptr<db::Transaction> txn(db->NewTransaction());
+  ConvertOptions options;
+  options.root_folder = argv[1];
+  options.resize_height = std::max<int>(0, FLAGS_resize_height);
+  options.resize_width = std::max<int>(0, FLAGS_resize_width);
+  options.is_color = is_color;
+  options.encoded = encoded;
+  options.encode_type = encode_type;
+  const int num_shards = std::max<int>(1, FLAGS_shards);
+  const int commit_size = std::max<int>(1, FLAGS_commit_size);
+
+  // Create new DBs
+  std::vector<shared_ptr<db::DB> > dbs(num_shards);
+  std::vector<shared_ptr<db::Transaction> > txns(num_shards);
+  for (int shard = 0; shard < num_shards; ++shard) {
+    string db_name(argv[3]);
+    if (num_shards > 1) {
+      db_name += "_" + caffe::format_int(shard, 5);
+    }
+    dbs[shard].reset(db::GetDB(FLAGS_backend));
+    dbs[shard]->Open(db_name, db::NEW);
+    txns[shard].reset(dbs[shard]->NewTransaction());
+  }
 
   // Storing to db
-  std::string root_folder(argv[1]);
-  Datum datum;
+  ThreadPool pool(FLAGS_threads);
+  LOG(INFO) << "Converting with " << pool.num_threads() << " threads into "
+      << num_shards << " shard(s).";
+  const int chunk_size = commit_size * num_shards;
+  Chunk chunks[2];
   int count = 0;
+  int64_t bytes = 0;
   int data_size = 0;
   bool data_size_initialized = false;
-
-  for (int line_id = 0; line_id < lines.size(); ++line_id) {
-    bool status;
-    std::string enc = encode_type;
-    if (encoded && !enc.size()) {
-      // Guess the encoding type from the file name
-      string fn = lines[line_id].first;
-      size_t p = fn.rfind('.');
-      if ( p == fn.npos )
-        LOG(WARNING) << "Failed to guess the encoding of '" << fn << "'";
-      enc = fn.substr(p);
-      std::transform(enc.begin(), enc.end(), enc.begin(), ::tolower);
-    }
-    status = ReadImageToDatum(root_folder + lines[line_id].first,
-        lines[line_id].second, resize_height, resize_width, is_color,
-        enc, &datum);
-    if (status == false) continue;
-    if (check_size) {
-      if (!data_size_initialized) {
-        data_size = datum.channels() * datum.height() * datum.width();
-        data_size_initialized = true;
-      } else {
-        const std::string& data = datum.data();
-        CHECK_EQ(data.size(), data_size) << "Incorrect data field size "
-            << data.size();
+  double seconds = 0;
+  CPUTimer timer;
+  timer.Start();
+
+  chunks[0].begin = 0;
+  chunks[0].end = std::min<int>(chunk_size, lines.size());
+  ConvertChunk(&pool, lines, options, &chunks[0]);
+  for (int c = 0; chunks[c % 2].begin < lines.size(); ++c) {
+    Chunk& chunk = chunks[c % 2];
+    // Convert the next chunk while this one is written.
+    Chunk& next = chunks[(c + 1) % 2];
+    next.begin = chunk.end;
+    next.end = std::min<int>(next.begin + chunk_size, lines.size());
+    boost::thread converter(&ConvertChunk, &pool, boost::cref(lines),
+        boost::cref(options), &next);
+
+    for (int line_id = chunk.begin; line_id < chunk.end; ++line_id) {
+      const string& out = chunk.values[line_id - chunk.begin];
+      if (out.empty()) continue;
+      if (check_size) {
+        Datum datum;
+        CHECK(datum.ParseFromString(out));
+        if (!data_size_initialized) {
+          data_size = datum.channels() * datum.height() * datum.width();
+          data_size_initialized = true;
+        } else {
+          const std::string& data = datum.data();
+          CHECK_EQ(data.size(), data_size) << "Incorrect data field size "
+              << data.size();
+        }
       }
+      // sequential
+      string key_str =
+          caffe::format_int(line_id, 8) + "_" + lines[line_id].first;
+
+      // Put in db
+      txns[line_id % num_shards]->Put(key_str, out);
+      bytes += out.size();
+      ++count;
     }
-    // sequential
-    string key_str = caffe::format_int(line_id, 8) + "_" + lines[line_id].first;
-
-    // Put in db
-    string out;
-    CHECK(datum.SerializeToString(&out));
-    txn->Put(key_str, out);
-
-    if (++count % 1000 == 0) {
-      // Commit db
-      txn->Commit();
-      txn.reset(db->NewTransaction());
-      LOG(INFO) << "Processed " << count << " files.";
+    // Commit dbs
+    for (int shard = 0; shard < num_shards; ++shard) {
+      txns[shard]->Commit();
+      txns[shard].reset(dbs[shard]->NewTransaction());
     }
-  }
-  // write the last batch
-  if (count % 1000 != 0) {
-    txn->Commit();
-    LOG(INFO) << "Processed " << count << " files.";
+    seconds += std::max<float>(timer.Seconds(), 1e-3);
+    timer.Start();
+    LOG(INFO) << "Processed " << count << " files, "
+        << count / seconds << " files/s, "
+        << bytes / seconds / (1 << 20) << " MB/s.";
+    converter.join();
   }
 #else
   LOG(FATAL) << "This tool requires OpenCV; compile with USE_OPENCV.";
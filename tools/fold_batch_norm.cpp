@@ -0,0 +1,39 @@
+// Folds the BatchNorm and Scale layers that follow Convolution and
+// InnerProduct layers into their weights, for inference; see
+// caffe/util/fold_batch_norm.hpp. The net is taken in the TEST phase.
+// Usage:
+//    fold_batch_norm net_proto_file weights_file folded_net_proto_file
+//        folded_weights_file
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/fold_batch_norm.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;  // Print output to stderr (while still logging)
+  ::google::InitGoogleLogging(argv[0]);
+  if (argc != 5) {
+    LOG(ERROR) << "Usage: fold_batch_norm net_proto_file weights_file "
+        << "folded_net_proto_file folded_weights_file";
+    return 1;
+  }
+
+  NetParameter param, weights;
+  ReadNetParamsFromTextFileOrDie(argv[1], &param);
+  ReadNetParamsFromBinaryFileOrDie(argv[2], &weights);
+  param.mutable_state()->set_phase(TEST);
+  NetParameter filtered_param;
+  Net<float>::FilterNet(param, &filtered_param);
+
+  NetParameter folded_param, folded_weights;
+  const int num_folded = FoldBatchNorm(filtered_param, weights,
+      &folded_param, &folded_weights);
+  WriteProtoToTextFile(folded_param, argv[3]);
+  WriteProtoToBinaryFile(folded_weights, argv[4]);
+  LOG(INFO) << "Folded " << num_folded << " BatchNorm layers; wrote "
+      << argv[3] << " and " << argv[4];
+  return 0;
+}
@@ -0,0 +1,109 @@
+// Compares the GEMM backends on the products of common layers: the
+// convolutions as im2col + GEMM and the inner products, with and without
+// packed weights. Usage:
+//   gemm_benchmark [FLAGS]
+
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/gemm.hpp"
+#include "caffe/util/math_functions.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_int32(iterations, 10, "Number of products timed per shape");
+DEFINE_int32(threads, 1, "Number of threads of the caffe backend");
+
+struct GemmShape {
+  const char* name;
+  // C (M x N) = A (M x K) * B (K x N), A being the weights for
+  // convolutions; for inner products, C = A * B^T with B the weights.
+  int M, N, K;
+  bool weights_are_b;
+};
+
+static const GemmShape kShapes[] = {
+  {"alexnet/conv2", 128, 729, 1200, false},
+  {"vgg16/conv3_2", 256, 3136, 2304, false},
+  {"resnet50/res2a_branch2b", 64, 3136, 576, false},
+  {"resnet50/res4a_branch2a", 256, 196, 512, false},
+  {"alexnet/fc6 batch 1", 1, 4096, 9216, true},
+  {"alexnet/fc6 batch 32", 32, 4096, 9216, true},
+  {"resnet50/fc1000 batch 8", 8, 1000, 2048, true},
+};
+
+// Returns the GFLOP/s of the product of shape, packing the weights first
+// if packed; the packing is not timed.
+static double Run(const GemmShape& s, bool packed, const Blob<float>& A,
+    const Blob<float>& B, Blob<float>* C) {
+  const CBLAS_TRANSPOSE trans_b = s.weights_are_b ? CblasTrans : CblasNoTrans;
+  GemmPackedA<float> packed_a;
+  GemmPackedB<float> packed_b;
+  if (packed && s.weights_are_b) {
+    packed_b.Pack(trans_b, s.K, s.N, B.cpu_data());
+  } else if (packed) {
+    packed_a.Pack(CblasNoTrans, s.M, s.K, A.cpu_data());
+  }
+  CPUTimer timer;
+  timer.Start();
+  for (int i = 0; i < FLAGS_iterations; ++i) {
+    if (packed && s.weights_are_b) {
+      caffe_cpu_gemm<float>(CblasNoTrans, s.M, 1., A.cpu_data(), packed_b,
+          0., C->mutable_cpu_data());
+    } else if (packed) {
+      caffe_cpu_gemm<float>(packed_a, trans_b, s.N, 1., B.cpu_data(), 0.,
+          C->mutable_cpu_data());
+    } else {
+      caffe_cpu_gemm<float>(CblasNoTrans, trans_b, s.M, s.N, s.K, 1.,
+          A.cpu_data(), B.cpu_data(), 0., C->mutable_cpu_data());
+    }
+  }
+  return 2e-6 * s.M * s.N * s.K * FLAGS_iterations / timer.MilliSeconds();
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  // Print output to stderr (while still logging)
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Compares the GEMM backends\n"
+        "Usage:\n"
+        "    gemm_benchmark [FLAGS]\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  CHECK_GT(FLAGS_iterations, 0);
+  GemmBackend::set_num_threads(FLAGS_threads);
+
+  FillerParameter filler_param;
+  GaussianFiller<float> filler(filler_param);
+  const vector<string> backends = GemmBackend::Names();
+  const int num_shapes = sizeof(kShapes) / sizeof(kShapes[0]);
+  for (int i = 0; i < num_shapes; ++i) {
+    const GemmShape& s = kShapes[i];
+    Blob<float> A(1, 1, s.M, s.K), C(1, 1, s.M, s.N);
+    Blob<float> B(1, 1, s.weights_are_b ? s.N : s.K,
+        s.weights_are_b ? s.K : s.N);
+    filler.Fill(&A);
+    filler.Fill(&B);
+    for (int b = 0; b < backends.size(); ++b) {
+      GemmBackend::Set(backends[b]);
+      Run(s, false, A, B, &C);  // Warm up.
+      const double gflops = Run(s, false, A, B, &C);
+      const double packed_gflops = Run(s, true, A, B, &C);
+      LOG(INFO) << s.name << " (" << s.M << "x" << s.N << "x" << s.K << ") "
+          << backends[b] << ": " << gflops << " GFLOP/s, packed weights "
+          << packed_gflops << " GFLOP/s";
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,103 @@
+// Times im2col_cpu and col2im_cpu on the convolution shapes of common
+// networks, single-threaded and with the channels split between threads.
+// Usage:
+//   im2col_benchmark [FLAGS]
+
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/im2col.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_int32(iterations, 20, "Number of calls timed per shape");
+DEFINE_int32(threads, 4, "Number of threads of the threaded runs");
+
+struct ConvShape {
+  const char* name;
+  int channels, height, width, kernel, pad, stride;
+};
+
+static const ConvShape kShapes[] = {
+  {"alexnet/conv1", 3, 227, 227, 11, 0, 4},
+  {"alexnet/conv2", 48, 27, 27, 5, 2, 1},
+  {"alexnet/conv3", 256, 13, 13, 3, 1, 1},
+  {"vgg16/conv1_2", 64, 224, 224, 3, 1, 1},
+  {"vgg16/conv3_2", 256, 56, 56, 3, 1, 1},
+  {"vgg16/conv5_2", 512, 14, 14, 3, 1, 1},
+  {"resnet50/conv1", 3, 224, 224, 7, 3, 2},
+  {"resnet50/res2a_branch2b", 64, 56, 56, 3, 1, 1},
+  {"resnet50/res3a_branch2b", 128, 56, 56, 3, 1, 2},
+  {"resnet50/res5a_branch2b", 512, 14, 14, 3, 1, 1},
+};
+
+// Returns the milliseconds per call of im2col (or col2im) on shape.
+static double Run(const ConvShape& s, bool im2col, ThreadPool* pool,
+    Blob<float>* image, Blob<float>* columns) {
+  CPUTimer timer;
+  timer.Start();
+  for (int i = 0; i < FLAGS_iterations; ++i) {
+    if (im2col) {
+      im2col_cpu(image->cpu_data(), s.channels, s.height, s.width, s.kernel,
+          s.kernel, s.pad, s.pad, s.stride, s.stride, 1, 1,
+          columns->mutable_cpu_data(), pool);
+    } else {
+      col2im_cpu(columns->cpu_data(), s.channels, s.height, s.width,
+          s.kernel, s.kernel, s.pad, s.pad, s.stride, s.stride, 1, 1,
+          image->mutable_cpu_data(), pool);
+    }
+  }
+  return timer.MilliSeconds() / FLAGS_iterations;
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  // Print output to stderr (while still logging)
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Times im2col and col2im on common conv shapes\n"
+        "Usage:\n"
+        "    im2col_benchmark [FLAGS]\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  CHECK_GT(FLAGS_iterations, 0);
+  CHECK_GT(FLAGS_threads, 0);
+
+  ThreadPool pool(FLAGS_threads);
+  FillerParameter filler_param;
+  GaussianFiller<float> filler(filler_param);
+  const int num_shapes = sizeof(kShapes) / sizeof(kShapes[0]);
+  for (int i = 0; i < num_shapes; ++i) {
+    const ConvShape& s = kShapes[i];
+    const int output_h = (s.height + 2 * s.pad - s.kernel) / s.stride + 1;
+    const int output_w = (s.width + 2 * s.pad - s.kernel) / s.stride + 1;
+    Blob<float> image(1, s.channels, s.height, s.width);
+    Blob<float> columns(1, s.channels * s.kernel * s.kernel, output_h,
+        output_w);
+    filler.Fill(&image);
+    filler.Fill(&columns);
+    // The bandwidth counts the column buffer, which dominates the traffic.
+    const double mb = columns.count() * sizeof(float) / 1e6;
+    for (int im2col = 1; im2col >= 0; --im2col) {
+      Run(s, im2col, NULL, &image, &columns);  // Warm up.
+      const double single = Run(s, im2col, NULL, &image, &columns);
+      const double threaded = Run(s, im2col, &pool, &image, &columns);
+      LOG(INFO) << s.name << (im2col ? " im2col: " : " col2im: ")
+          << single << " ms (" << mb / single << " GB/s), "
+          << FLAGS_threads << " threads " << threaded << " ms ("
+          << mb / threaded << " GB/s)";
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,108 @@
+// Compares the throughput of the single precision caffe_exp, caffe_log,
+// caffe_tanh, caffe_sigmoid and caffe_powx with the same loops over the
+// <cmath> functions. Usage:
+//   math_benchmark [FLAGS]
+
+#include <cmath>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/math_functions.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_int32(count, 1 << 20, "Number of elements per call");
+DEFINE_int32(iterations, 20, "Number of calls timed per function");
+
+static void LibmExp(const int n, const float* a, float* y) {
+  for (int i = 0; i < n; ++i) { y[i] = std::exp(a[i]); }
+}
+
+static void LibmLog(const int n, const float* a, float* y) {
+  for (int i = 0; i < n; ++i) { y[i] = std::log(a[i]); }
+}
+
+static void LibmTanh(const int n, const float* a, float* y) {
+  for (int i = 0; i < n; ++i) { y[i] = std::tanh(a[i]); }
+}
+
+static void LibmSigmoid(const int n, const float* a, float* y) {
+  for (int i = 0; i < n; ++i) { y[i] = 1.f / (1.f + std::exp(-a[i])); }
+}
+
+static void LibmPowx(const int n, const float* a, float* y) {
+  for (int i = 0; i < n; ++i) { y[i] = std::pow(a[i], -0.75f); }
+}
+
+static void CaffePowx(const int n, const float* a, float* y) {
+  caffe_powx(n, a, -0.75f, y);
+}
+
+struct MathFunction {
+  const char* name;
+  void (*caffe)(const int, const float*, float*);
+  void (*libm)(const int, const float*, float*);
+  // Log and powx take the absolute values of the inputs.
+  bool positive;
+};
+
+static const MathFunction kFunctions[] = {
+  {"exp", &caffe_exp<float>, &LibmExp, false},
+  {"log", &caffe_log<float>, &LibmLog, true},
+  {"tanh", &caffe_tanh<float>, &LibmTanh, false},
+  {"sigmoid", &caffe_sigmoid<float>, &LibmSigmoid, false},
+  {"powx -0.75", &CaffePowx, &LibmPowx, true},
+};
+
+// Returns the nanoseconds per element of fn on x.
+static double Run(void (*fn)(const int, const float*, float*),
+    const Blob<float>& x, Blob<float>* y) {
+  CPUTimer timer;
+  timer.Start();
+  for (int i = 0; i < FLAGS_iterations; ++i) {
+    fn(x.count(), x.cpu_data(), y->mutable_cpu_data());
+  }
+  return timer.MicroSeconds() * 1e3 / FLAGS_iterations / x.count();
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  // Print output to stderr (while still logging)
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Times the vectorized math functions\n"
+        "Usage:\n"
+        "    math_benchmark [FLAGS]\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  CHECK_GT(FLAGS_count, 0);
+  CHECK_GT(FLAGS_iterations, 0);
+
+  Blob<float> x(1, 1, 1, FLAGS_count), y(1, 1, 1, FLAGS_count);
+  FillerParameter filler_param;
+  filler_param.set_std(4);
+  GaussianFiller<float> filler(filler_param);
+  const int num_functions = sizeof(kFunctions) / sizeof(kFunctions[0]);
+  for (int i = 0; i < num_functions; ++i) {
+    const MathFunction& f = kFunctions[i];
+    filler.Fill(&x);
+    if (f.positive) {
+      caffe_abs(x.count(), x.cpu_data(), x.mutable_cpu_data());
+    }
+    Run(f.caffe, x, &y);  // Warm up.
+    const double caffe_ns = Run(f.caffe, x, &y);
+    const double libm_ns = Run(f.libm, x, &y);
+    LOG(INFO) << f.name << ": " << caffe_ns << " ns per element, <cmath> "
+        << libm_ns << " ns (" << libm_ns / caffe_ns << "x)";
+  }
+  return 0;
+}
@@ -0,0 +1,88 @@
+// Measures the rate at which datums go back and forth between a reader
+// thread and a consumer through a free/full queue pair, as in DataReader,
+// for both BlockingQueue and LockFreeQueue. Usage:
+//   queue_benchmark [FLAGS]
+
+#include <vector>
+
+#include "boost/thread.hpp"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/lock_free_queue.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_int32(items, 1000000, "Number of datums transferred per queue type");
+DEFINE_int32(capacity, 256,
+    "Number of datums in flight, i.e. prefetch * batch_size");
+DEFINE_int32(iterations, 3, "Number of runs per queue type");
+
+// The reader side: takes free datums and hands them over as full ones.
+template <typename Queue>
+static void Produce(Queue* free, Queue* full, int items) {
+  for (int i = 0; i < items; ++i) {
+    Datum* datum = free->pop();
+    datum->set_label(i);
+    full->push(datum);
+  }
+}
+
+// Returns the number of datums per second going through the queue pair.
+template <typename Queue>
+static double Run(Queue* free, Queue* full, int capacity, int items) {
+  std::vector<Datum> datums(capacity);
+  for (int i = 0; i < capacity; ++i) {
+    free->push(&datums[i]);
+  }
+  CPUTimer timer;
+  timer.Start();
+  boost::thread producer(&Produce<Queue>, free, full, items);
+  for (int i = 0; i < items; ++i) {
+    Datum* datum = full->pop();
+    CHECK_EQ(i, datum->label());
+    free->push(datum);
+  }
+  producer.join();
+  const double seconds = timer.Seconds();
+  for (int i = 0; i < capacity; ++i) {
+    free->pop();
+  }
+  return items / seconds;
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  // Print output to stderr (while still logging)
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Compares the datum queues of the data pipeline\n"
+        "Usage:\n"
+        "    queue_benchmark [FLAGS]\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  CHECK_GT(FLAGS_items, 0);
+  CHECK_GT(FLAGS_capacity, 0);
+
+  for (int iter = 0; iter < FLAGS_iterations; ++iter) {
+    BlockingQueue<Datum*> blocking_free, blocking_full;
+    const double blocking = Run(&blocking_free, &blocking_full,
+        FLAGS_capacity, FLAGS_items);
+    LockFreeQueue<Datum*> lock_free_free(FLAGS_capacity);
+    LockFreeQueue<Datum*> lock_free_full(FLAGS_capacity);
+    const double lock_free = Run(&lock_free_free, &lock_free_full,
+        FLAGS_capacity, FLAGS_items);
+    LOG(INFO) << "Iteration " << iter << ": BlockingQueue "
+        << static_cast<int>(blocking) << " datums/s, LockFreeQueue "
+        << static_cast<int>(lock_free) << " datums/s ("
+        << lock_free / blocking << "x)";
+  }
+  return 0;
+}